@@ -166,6 +166,7 @@ while (Serial.available() > 0) {
   }
 
   if(incomingByte == 's') {
+      unsigned long sample_time = micros();
       current_average = myRA.getAverage();
       Serial.print("strain gauge reading: ");
       Serial.print(current_average);
@@ -177,7 +178,10 @@ while (Serial.available() > 0) {
       Serial.print("acutal PWM: ");
       Serial.print(PWM_VALUE);
       Serial.print("P: ");
-      Serial.println(analogRead(POT_PIN));
+      Serial.print(analogRead(POT_PIN));
+      Serial.print('\t');
+      Serial.print("T: ");
+      Serial.println(sample_time);
   }
 
 
@@ -1,5 +1,7 @@
 #include "app.hpp"
 #include "common/ws.hpp"
+#include "common/port_discovery.hpp"
+#include "common/trace.hpp"
 #include <GLFW/glfw3.h>
 
 #define ENABLE_RENDER_WIN_COPY (0)
@@ -47,8 +49,12 @@ namespace ws {
         }
         auto imgui_context = gui_res.value();
 
-        auto* lever_sys = ws::lever::get_global_lever_system();
+        lever_system = ws::lever::get_global_lever_system();
+        pump_system = ws::pump::get_global_pump_system();
+        auto* lever_sys = lever_system;
+        levers.resize(1);
         ws::lever::initialize(lever_sys, 1, levers.data()); // one lever, but treats it as two (two directions) 
+        ws::start_port_discovery(2.0);
 
         glfwMakeContextCurrent(render_win.window);
         ws::gfx::init_rendering();
@@ -60,17 +66,24 @@ namespace ws {
 #endif
 
         setup();
+        ws::trace::set_thread_name("main");
 
 #if ENABLE_RENDER_WIN_COPY
         while (!glfwWindowShouldClose(gui_win.window) && !glfwWindowShouldClose(render_win.window) && !glfwWindowShouldClose(render_win_copy.window)) {
 #else
         while (!glfwWindowShouldClose(gui_win.window) && !glfwWindowShouldClose(render_win.window)) {
 #endif
-            glfwPollEvents();
+            {
+                WS_TRACE_ZONE("poll");
+                glfwPollEvents();
 
-            ws::lever::update(lever_sys);
-            ws::pump::submit_commands();
+                ws::lever::update(lever_sys);
+                if (auto discovered = ws::read_discovered_ports(&ports_version)) {
+                    ports = std::move(discovered.value());
+                }
+            }
             {
+                WS_TRACE_ZONE("gui");
                 glfwMakeContextCurrent(gui_win.window);
                 ws::update_framebuffer_dimensions(&gui_win);
                 ws::new_frame(&imgui_context, gui_win.framebuffer_width, gui_win.framebuffer_height);
@@ -78,8 +91,10 @@ namespace ws {
                 gui_update();
 
                 ws::render(&imgui_context);
+            }
+            {
+                WS_TRACE_ZONE("swap");
                 glfwSwapBuffers(gui_win.window);
-
             }
 
             if (!start_render)
@@ -88,6 +103,7 @@ namespace ws {
                 ws::update_framebuffer_dimensions(&render_win);
                 ws::gfx::new_frame(render_win.framebuffer_width, render_win.framebuffer_height);
 
+                WS_TRACE_ZONE("swap");
                 glfwSwapBuffers(render_win.window);
 
 #if ENABLE_RENDER_WIN_COPY
@@ -117,9 +133,13 @@ namespace ws {
                 ws::update_framebuffer_dimensions(&render_win);
                 ws::gfx::new_frame(render_win.framebuffer_width, render_win.framebuffer_height);
 
-                task_update();
+                {
+                    WS_TRACE_ZONE("task");
+                    task_update();
+                    ws::gfx::submit_frame();
+                }
 
-                ws::gfx::submit_frame();
+                WS_TRACE_ZONE("swap");
                 glfwSwapBuffers(render_win.window);
 
             }
@@ -127,10 +147,11 @@ namespace ws {
 
         shutdown();
 
+        ws::stop_port_discovery();
         ws::audio::terminate_audio();
         ws::gfx::terminate_rendering();
         ws::lever::terminate(lever_sys);
-        ws::pump::terminate_pump_system();
+        ws::pump::terminate_pump_system(pump_system);
         ws::destroy_imgui_context(&imgui_context);
         ws::destroy_glfw_context(&gui_win);
         ws::destroy_glfw_context(&render_win);
@@ -2,7 +2,12 @@
 
 #include "serial_lever.hpp"
 #include "lever_system.hpp"
-#include <array>
+#include "audio.hpp"
+#include <vector>
+
+namespace ws::pump {
+struct PumpSystem;
+}
 
 namespace ws {
 
@@ -15,7 +20,12 @@ struct App {
   int run();
 
   std::vector<ws::PortDescriptor> ports;
-  std::array<ws::lever::SerialLeverHandle, 1> levers{}; // 1 lever, but treats as two (two directions)
+  std::vector<ws::lever::SerialLeverHandle> levers; // 1 lever at startup, but treats as two (two directions)
+  // the rig's devices: the global systems under `run`, or the rig's own under a RigHost
+  lever::LeverSystem* lever_system{};
+  pump::PumpSystem* pump_system{};
+  audio::OutputRoute audio_route{ audio::make_default_output_route() };
+  uint64_t ports_version{};
   bool start_render{};
 };
 
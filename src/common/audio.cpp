@@ -1,10 +1,15 @@
 #include "audio.hpp"
-#include "ringbuffer.hpp"
+#include "channel.hpp"
 #include "common.hpp"
+#include "trace.hpp"
 #include "AudioFile/AudioFile.h"
 #include "portaudio.h"
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <unordered_map>
 #include <iostream>
 
@@ -26,13 +31,15 @@ namespace ws::audio {
 
     struct PendingPlayingBuffer {
         BufferHandle buffer;
-        float gain[max_num_buffer_output_channels];
+        OutputRoute route;
+        float gain[2];
     };
 
     struct PlayingBuffer {
         Buffer* buffer;
         double frame;
-        float gain[max_num_buffer_output_channels];
+        OutputRoute route;
+        float gain[2];
     };
 
     struct PlayingBuffers {
@@ -54,12 +61,19 @@ namespace ws::audio {
             PaStream* stream{};
 
             std::unordered_map<uint32_t, Buffer*> render_buffers;
+            //  Buffers can be created from any thread; creation is serialized by `buffers_mutex`,
+            //  so `push_buffers` still has one writer at a time.
+            std::mutex buffers_mutex;
             std::unordered_map<uint32_t, std::unique_ptr<Buffer>> main_buffers;
-            RingBuffer<PushBuffer, 1024> push_buffers;
+            std::unordered_map<std::string, BufferHandle> file_buffers;
+            SPSCChannel<PushBuffer, 1024> push_buffers{ "audio/push_buffers" };
             uint32_t next_buffer_id{ 1 };
 
-            RingBuffer<PendingPlayingBuffer, 1024> pending_play;
+            //  Played from any thread, e.g. by several rigs' tasks.
+            MPSCChannel<PendingPlayingBuffer, 1024> pending_play{ "audio/pending_play" };
             PlayingBuffers playing;
+            //  The stream callback's; reserved up front, since the callback must not block or allocate.
+            trace::ThreadBuffer* callback_trace_buffer{};
         } globals;
 
         float interp_sample(Buffer* buff, uint64_t i0, uint64_t i1, double frame, int channel) {
@@ -83,16 +97,18 @@ namespace ws::audio {
 
                     float samples[2];
                     samples[0] = interp_sample(buff.buffer, i0, i1, buff.frame, 0);
-                    if (globals.num_output_channels > 1 && buff.buffer->channels > 1) {
+                    if (buff.buffer->channels > 1) {
                         samples[1] = interp_sample(buff.buffer, i0, i1, buff.frame, 1);
                     }
                     else {
                         samples[1] = samples[0];
                     }
 
-                    for (int j = 0; j < std::min(2, globals.num_output_channels); j++) {
-                        assert(j < max_num_buffer_output_channels);
-                        out[s * globals.num_output_channels + j] += samples[j] * buff.gain[j];
+                    for (int j = 0; j < 2; j++) {
+                        const int channel = buff.route.channels[j];
+                        if (channel >= 0 && channel < globals.num_output_channels) {
+                            out[s * globals.num_output_channels + channel] += samples[j] * buff.gain[j];
+                        }
                     }
 
                     buff.frame += buff.buffer->sample_rate / globals.sample_rate;
@@ -126,9 +142,9 @@ namespace ws::audio {
                 }
                 else {
                     PlayingBuffer playing{};
-                    for (int i = 0; i < max_num_buffer_output_channels; i++) {
-                        playing.gain[i] = pend.gain[i];
-                    }
+                    playing.route = pend.route;
+                    playing.gain[0] = pend.gain[0];
+                    playing.gain[1] = pend.gain[1];
                     playing.buffer = it->second;
                     buffs->buffers[buffs->num_playing_buffers++] = playing;
                     return true;
@@ -139,34 +155,63 @@ namespace ws::audio {
         int stream_callback(const void*, void* output_buffer,
             unsigned long, const PaStreamCallbackTimeInfo*,
             unsigned long, void*) {
-                {
-                    int num_buffs = globals.push_buffers.size();
-                    for (int i = 0; i < num_buffs; i++) {
-                        auto buff = globals.push_buffers.read();
-                        globals.render_buffers[buff.handle_id] = buff.buffer;
-                    }
-                }
-                {
-                    int num_buffs = globals.pending_play.size();
-                    for (int i = 0; i < num_buffs; i++) {
-                        auto pend = globals.pending_play.read();
-                        push_playing(&globals.playing, pend);
-                    }
-                }
+                trace::use_thread_buffer(globals.callback_trace_buffer);
+                WS_TRACE_ZONE("audio/stream_callback");
+
+                globals.push_buffers.read_all([](PushBuffer&& buff) {
+                    globals.render_buffers[buff.handle_id] = buff.buffer;
+                });
+                globals.pending_play.read_all([](PendingPlayingBuffer&& pend) {
+                    push_playing(&globals.playing, pend);
+                });
 
                 auto* out = static_cast<float*>(output_buffer);
                 std::fill(out, out + globals.frames_per_buffer * globals.num_output_channels, 0.0f);
                 play_buffers(&globals.playing, out);
+                trace::counter("audio/playing_buffers", double(globals.playing.num_playing_buffers));
                 return 0;
         }
 
+        std::optional<BufferHandle> create_buffer_locked(const float* data, double sr, int channels, int frames) {
+            if (!globals.pa_stream_started || globals.push_buffers.full()) {
+                return std::nullopt;
+            }
+
+            Buffer buff{};
+            buff.sample_rate = sr;
+            buff.channels = channels;
+            buff.frames = frames;
+            buff.data = std::make_unique<float[]>(channels * frames);
+            memcpy(buff.data.get(), data, channels * frames * sizeof(float));
+
+            BufferHandle result{ globals.next_buffer_id++ };
+            auto res_buff = std::make_unique<Buffer>(std::move(buff));
+            auto* buff_ptr = res_buff.get();
+            globals.main_buffers[result.id] = std::move(res_buff);
+
+            PushBuffer push{};
+            push.buffer = buff_ptr;
+            push.handle_id = result.id;
+            const bool pushed = globals.push_buffers.maybe_write(push);
+            assert(pushed);
+            (void) pushed;
+            return result;
+        }
+
     } //  anon
 
-    void init_audio() {
+    OutputRoute make_default_output_route() {
+        return OutputRoute{ { 0, 1 } };
+    }
+
+    void init_audio(int num_output_channels) {
         assert(!globals.pa_initialized);
+        assert(num_output_channels > 0);
+        globals.num_output_channels = num_output_channels;
         auto err = Pa_Initialize();
         assert(err == paNoError);
         globals.pa_initialized = true;
+        globals.callback_trace_buffer = trace::reserve_thread_buffer("audio callback");
 
         PaStream* stream{};
         err = Pa_OpenDefaultStream(
@@ -177,6 +222,7 @@ namespace ws::audio {
             return;
         }
 
+        globals.stream = stream;
         err = Pa_StartStream(stream);
         assert(err == paNoError);
         globals.pa_stream_started = true;
@@ -191,39 +237,27 @@ namespace ws::audio {
             }
             Pa_Terminate();
             globals.pa_initialized = false;
+            trace::release_thread_buffer(globals.callback_trace_buffer);
+            globals.callback_trace_buffer = nullptr;
         }
     }
 
+    int num_output_channels() {
+        return globals.num_output_channels;
+    }
+
     std::optional<BufferHandle> create_buffer(const float* data, double sr, int channels, int frames) {
         assert(channels > 0 && frames > 0);
-        if (!globals.pa_stream_started || globals.push_buffers.full()) {
-            return std::nullopt;
-        }
-
-        Buffer buff{};
-        buff.sample_rate = sr;
-        buff.channels = channels;
-        buff.frames = frames;
-        buff.data = std::make_unique<float[]>(channels * frames);
-        memcpy(buff.data.get(), data, channels * frames * sizeof(float));
-
-        BufferHandle result{ globals.next_buffer_id++ };
-        auto res_buff = std::make_unique<Buffer>(std::move(buff));
-        auto* buff_ptr = res_buff.get();
-        globals.main_buffers[result.id] = std::move(res_buff);
-
-        PushBuffer push{};
-        push.buffer = buff_ptr;
-        push.handle_id = result.id;
-        globals.push_buffers.write(push);
-        return result;
+        std::lock_guard<std::mutex> lock(globals.buffers_mutex);
+        return create_buffer_locked(data, sr, channels, frames);
     }
 
     std::optional<BufferHandle> read_buffer(const char* filepath) {
-        static std::unordered_map<std::string, BufferHandle> handle_cache;
-
-        if (auto it = handle_cache.find(std::string{ filepath }); it != handle_cache.end()) {
-            return it->second;
+        {
+            std::lock_guard<std::mutex> lock(globals.buffers_mutex);
+            if (auto it = globals.file_buffers.find(std::string{ filepath }); it != globals.file_buffers.end()) {
+                return it->second;
+            }
         }
 
         AudioFile<float> file;
@@ -250,54 +284,58 @@ namespace ws::audio {
             }
         }
 
-        auto res = create_buffer(data.data(), file.getSampleRate(), num_channels, spc);
+        //  Another thread may have loaded the same file in the meantime.
+        std::lock_guard<std::mutex> lock(globals.buffers_mutex);
+        if (auto it = globals.file_buffers.find(std::string{ filepath }); it != globals.file_buffers.end()) {
+            return it->second;
+        }
+        auto res = create_buffer_locked(data.data(), file.getSampleRate(), num_channels, spc);
         if (res) {
-            handle_cache[std::string{ filepath }] = res.value();
+            globals.file_buffers[std::string{ filepath }] = res.value();
         }
         return res;
     }
 
     namespace {
 
-        bool play_buffer(BufferHandle buff, float gain_l, float gain_r) {
+        bool play_buffer(const OutputRoute& route, BufferHandle buff, float gain_l, float gain_r) {
             assert(globals.pa_stream_started);
-            if (globals.pending_play.full()) {
-                assert(false);
-                return false;
+            PendingPlayingBuffer pend{};
+            pend.buffer = buff;
+            pend.route = route;
+            pend.gain[0] = gain_l;
+            pend.gain[1] = gain_r;
+            if (globals.pending_play.maybe_write(pend)) {
+                return true;
             }
             else {
-                PendingPlayingBuffer pend{};
-                pend.buffer = buff;
-                pend.gain[0] = gain_l;
-                pend.gain[1] = gain_r;
-                globals.pending_play.write(pend);
-                return true;
+                assert(false);
+                return false;
             }
         }
 
-        bool play_buffer_channel_l(BufferHandle buff, float gain) {
-            return play_buffer(buff, gain, 0.0f);
-        }
-
-        bool play_buffer_channel_r(BufferHandle buff, float gain) {
-            return play_buffer(buff, 0.0f, gain);
-        }
-
     } //  anon
 
-    bool play_buffer_both(BufferHandle buff, float gain) {
-        return play_buffer(buff, gain, gain);
+    bool play_buffer_both(const OutputRoute& route, BufferHandle buff, float gain) {
+        return play_buffer(route, buff, gain, gain);
     }
 
-    bool play_buffer_on_channel(BufferHandle buff, int channel, float gain) {
-        //  @TODO: Could set gain in PendingPlayingBuffer directly.
+    bool play_buffer_on_channel(const OutputRoute& route, BufferHandle buff, int channel, float gain) {
         assert(channel >= 0 && channel < 2);
         if (channel == 0) {
-            return play_buffer_channel_l(buff, gain);
+            return play_buffer(route, buff, gain, 0.0f);
         }
         else {
-            return play_buffer_channel_r(buff, gain);
+            return play_buffer(route, buff, 0.0f, gain);
         }
     }
 
+    bool play_buffer_both(BufferHandle buff, float gain) {
+        return play_buffer_both(make_default_output_route(), buff, gain);
+    }
+
+    bool play_buffer_on_channel(BufferHandle buff, int channel, float gain) {
+        return play_buffer_on_channel(make_default_output_route(), buff, channel, gain);
+    }
+
 }
@@ -11,10 +11,28 @@ struct BufferHandle {
   uint32_t id;
 };
 
-void init_audio();
+/*
+ * OutputRoute - The device output channels that a buffer's left and right channels are played on;
+ * a mono buffer is played on both. A channel of -1, or one the device does not have, is silent.
+ * Rigs that share the process's audio device each play on their own speakers this way.
+ */
+struct OutputRoute {
+  int channels[2];
+};
+
+//  Output channels 0 and 1.
+OutputRoute make_default_output_route();
+
+void init_audio(int num_output_channels = 2);
 void terminate_audio();
+int num_output_channels();
+
+//  Buffers can be created and played from any thread.
 std::optional<BufferHandle> create_buffer(const float* data, double sr, int channels, int frames);
 std::optional<BufferHandle> read_buffer(const char* file_path);
+bool play_buffer_both(const OutputRoute& route, BufferHandle buff, float gain);
+bool play_buffer_on_channel(const OutputRoute& route, BufferHandle buff, int channel, float gain);
+//  On the default route.
 bool play_buffer_both(BufferHandle buff, float gain);
 bool play_buffer_on_channel(BufferHandle buff, int channel, float gain);
 
@@ -0,0 +1,67 @@
+#include "channel.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace ws {
+
+namespace {
+
+struct ChannelRegistry {
+  std::mutex mutex;
+  std::vector<const ChannelMetrics*> channels;
+};
+
+//  Function-local, so that channels that are themselves globals can register during static
+//  initialization.
+ChannelRegistry& get_channel_registry() {
+  static ChannelRegistry registry;
+  return registry;
+}
+
+} //  anon
+
+void register_channel(const ChannelMetrics* metrics) {
+  auto& registry = get_channel_registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.channels.push_back(metrics);
+}
+
+void unregister_channel(const ChannelMetrics* metrics) {
+  auto& registry = get_channel_registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  auto it = std::find(registry.channels.begin(), registry.channels.end(), metrics);
+  if (it != registry.channels.end()) {
+    registry.channels.erase(it);
+  } else {
+    assert(false);
+  }
+}
+
+ChannelStats read_channel_stats(const ChannelMetrics& metrics) {
+  ChannelStats result{};
+  result.name = metrics.name;
+  result.capacity = metrics.capacity;
+  result.high_water_mark = metrics.high_water_mark.load(std::memory_order_relaxed);
+  result.num_read = metrics.num_read.load(std::memory_order_relaxed);
+  result.num_written = metrics.num_written.load(std::memory_order_relaxed);
+  result.num_dropped = metrics.num_dropped.load(std::memory_order_relaxed);
+  result.last_drop_time = TimePoint{
+    TimePoint::duration{metrics.last_drop_time.load(std::memory_order_relaxed)}};
+  //  Counters are read independently, so clamp in case a read is observed before its write.
+  result.depth = result.num_written > result.num_read ?
+    int(std::min(result.num_written - result.num_read, uint64_t(result.capacity))) : 0;
+  return result;
+}
+
+std::vector<ChannelStats> read_all_channel_stats() {
+  auto& registry = get_channel_registry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  std::vector<ChannelStats> result;
+  result.reserve(registry.channels.size());
+  for (auto* metrics : registry.channels) {
+    result.push_back(read_channel_stats(*metrics));
+  }
+  return result;
+}
+
+}
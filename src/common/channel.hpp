@@ -0,0 +1,455 @@
+#pragma once
+
+#include "ringbuffer.hpp"
+#include "mpsc_queue.hpp"
+#include "time.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace ws {
+
+/*
+ * Channels - Typed, fixed-capacity message queues between threads. `SPSCChannel` wraps a
+ * `RingBuffer` (1 writer, 1 reader); `MPSCChannel` wraps an `MPSCQueue` (any number of writers,
+ * 1 reader). Every channel registers itself with a process-wide list on construction, so depth,
+ * high water mark and failed (dropped) writes of all channels can be observed in one place.
+ */
+
+struct ChannelStats {
+  const char* name;
+  int depth;
+  int capacity;
+  int high_water_mark;
+  uint64_t num_written;
+  uint64_t num_read;
+  uint64_t num_dropped;
+  //  Valid if num_dropped > 0.
+  TimePoint last_drop_time;
+};
+
+struct ChannelMetrics {
+  const char* name{};
+  int capacity{};
+  std::atomic<int> high_water_mark{};
+  std::atomic<uint64_t> num_written{};
+  std::atomic<uint64_t> num_read{};
+  std::atomic<uint64_t> num_dropped{};
+  //  TimePoint::time_since_epoch(), in clock ticks.
+  std::atomic<int64_t> last_drop_time{};
+};
+
+void register_channel(const ChannelMetrics* metrics);
+void unregister_channel(const ChannelMetrics* metrics);
+ChannelStats read_channel_stats(const ChannelMetrics& metrics);
+std::vector<ChannelStats> read_all_channel_stats();
+
+/*
+ * Wakeup - Lets a reader sleep until a writer signals new data, or until a timeout elapses.
+ */
+
+struct Wakeup {
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool signaled{};
+};
+
+inline void notify(Wakeup* wakeup) {
+  {
+    std::lock_guard<std::mutex> lock(wakeup->mutex);
+    wakeup->signaled = true;
+  }
+  wakeup->condition.notify_one();
+}
+
+//  Returns true if woken by `notify`, false on timeout.
+template <typename Rep, typename Period>
+bool wait_for(Wakeup* wakeup, const std::chrono::duration<Rep, Period>& timeout) {
+  std::unique_lock<std::mutex> lock(wakeup->mutex);
+  wakeup->condition.wait_for(lock, timeout, [wakeup]() { return wakeup->signaled; });
+  const bool signaled = wakeup->signaled;
+  wakeup->signaled = false;
+  return signaled;
+}
+
+namespace detail {
+
+inline void update_high_water_mark(std::atomic<int>& mark, int size) {
+  int prev = mark.load(std::memory_order_relaxed);
+  while (size > prev && !mark.compare_exchange_weak(prev, size, std::memory_order_relaxed)) {
+    //
+  }
+}
+
+//  For counters with a single modifying thread, a load + store avoids a locked read-modify-write.
+inline void increment_single_writer(std::atomic<uint64_t>& counter, uint64_t n = 1) {
+  counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline void record_drop(ChannelMetrics& metrics, uint64_t n = 1) {
+  const auto t = int64_t(now().time_since_epoch().count());
+  metrics.last_drop_time.store(t, std::memory_order_relaxed);
+  metrics.num_dropped.fetch_add(n, std::memory_order_relaxed);
+}
+
+}
+
+/*
+ * SPSCChannel
+ */
+
+template <typename T, int N>
+class SPSCChannel {
+public:
+  explicit SPSCChannel(const char* name);
+  ~SPSCChannel();
+
+  SPSCChannel(const SPSCChannel&) = delete;
+  SPSCChannel& operator=(const SPSCChannel&) = delete;
+
+  //  by writer
+  template <typename U = T>
+  bool maybe_write(U&& element) noexcept;
+  //  Like `maybe_write`, but a failed write is not counted as dropped; for writers that retry.
+  template <typename U = T>
+  bool try_write(U&& element) noexcept;
+  //  Copy as many elements of [begin, end) as fit; returns the number written.
+  int write_range(const T* begin, const T* end) noexcept;
+  //  In-place write: fill the slot returned by `prepare_write` (nullptr if full, counted as a
+  //  drop), then publish it with `commit_write`.
+  T* prepare_write() noexcept;
+  void commit_write() noexcept;
+  bool full() const noexcept;
+
+  //  by reader
+  bool maybe_read(T* element) noexcept;
+  //  In-place read: process the element returned by `peek_read` (nullptr if empty), then hand its
+  //  slot back with `release_read`.
+  T* peek_read() noexcept;
+  void release_read() noexcept;
+  //  Read up to `max_count` elements into `dst`; returns the number read.
+  int read_range(T* dst, int max_count) noexcept;
+  //  Invoke `f(T&&)` for every element pending read; returns the number read.
+  template <typename F>
+  int read_all(F&& f);
+
+  int size() const noexcept;
+  int write_capacity() const noexcept;
+
+  void set_wakeup(Wakeup* wakeup) noexcept;
+  ChannelStats stats() const;
+
+private:
+  void on_write(int count) noexcept;
+  void on_read(int count) noexcept;
+
+private:
+  RingBuffer<T, N> ring;
+  ChannelMetrics metrics;
+  Wakeup* wakeup{};
+};
+
+/*
+ * MPSCChannel
+ */
+
+template <typename T, int N>
+class MPSCChannel {
+public:
+  explicit MPSCChannel(const char* name);
+  ~MPSCChannel();
+
+  MPSCChannel(const MPSCChannel&) = delete;
+  MPSCChannel& operator=(const MPSCChannel&) = delete;
+
+  //  by writers
+  template <typename U = T>
+  bool maybe_write(U&& element) noexcept;
+  template <typename U = T>
+  bool try_write(U&& element) noexcept;
+  int write_range(const T* begin, const T* end) noexcept;
+  bool full() const noexcept;
+
+  //  by reader
+  bool maybe_read(T* element) noexcept;
+  int read_range(T* dst, int max_count) noexcept;
+  template <typename F>
+  int read_all(F&& f);
+
+  int size() const noexcept;
+  int write_capacity() const noexcept;
+
+  void set_wakeup(Wakeup* wakeup) noexcept;
+  ChannelStats stats() const;
+
+private:
+  void on_write() noexcept;
+
+private:
+  MPSCQueue<T, N> queue;
+  ChannelMetrics metrics;
+  Wakeup* wakeup{};
+};
+
+/*
+ * Impl
+ */
+
+template <typename T, int N>
+SPSCChannel<T, N>::SPSCChannel(const char* name) {
+  metrics.name = name;
+  metrics.capacity = ring.write_capacity();
+  register_channel(&metrics);
+}
+
+template <typename T, int N>
+SPSCChannel<T, N>::~SPSCChannel() {
+  unregister_channel(&metrics);
+}
+
+template <typename T, int N>
+void SPSCChannel<T, N>::on_write(int count) noexcept {
+  detail::increment_single_writer(metrics.num_written, uint64_t(count));
+  detail::update_high_water_mark(metrics.high_water_mark, ring.size());
+  if (wakeup) {
+    notify(wakeup);
+  }
+}
+
+template <typename T, int N>
+void SPSCChannel<T, N>::on_read(int count) noexcept {
+  detail::increment_single_writer(metrics.num_read, uint64_t(count));
+}
+
+template <typename T, int N>
+template <typename U>
+bool SPSCChannel<T, N>::try_write(U&& element) noexcept {
+  if (ring.maybe_write(std::forward<U>(element))) {
+    on_write(1);
+    return true;
+  } else {
+    return false;
+  }
+}
+
+template <typename T, int N>
+template <typename U>
+bool SPSCChannel<T, N>::maybe_write(U&& element) noexcept {
+  if (try_write(std::forward<U>(element))) {
+    return true;
+  } else {
+    detail::record_drop(metrics);
+    return false;
+  }
+}
+
+template <typename T, int N>
+int SPSCChannel<T, N>::write_range(const T* begin, const T* end) noexcept {
+  const int count = int(end - begin);
+  const int num_free = ring.num_free();
+  const int num_write = count < num_free ? count : num_free;
+  if (num_write > 0) {
+    ring.write_range_copy(begin, begin + num_write);
+    on_write(num_write);
+  }
+  if (num_write < count) {
+    detail::record_drop(metrics, uint64_t(count - num_write));
+  }
+  return num_write;
+}
+
+template <typename T, int N>
+T* SPSCChannel<T, N>::prepare_write() noexcept {
+  T* slot = ring.prepare_write();
+  if (!slot) {
+    detail::record_drop(metrics);
+  }
+  return slot;
+}
+
+template <typename T, int N>
+void SPSCChannel<T, N>::commit_write() noexcept {
+  ring.commit_write();
+  on_write(1);
+}
+
+template <typename T, int N>
+bool SPSCChannel<T, N>::full() const noexcept {
+  return ring.full();
+}
+
+template <typename T, int N>
+bool SPSCChannel<T, N>::maybe_read(T* element) noexcept {
+  return read_range(element, 1) == 1;
+}
+
+template <typename T, int N>
+T* SPSCChannel<T, N>::peek_read() noexcept {
+  return ring.peek_read();
+}
+
+template <typename T, int N>
+void SPSCChannel<T, N>::release_read() noexcept {
+  ring.release_read();
+  on_read(1);
+}
+
+template <typename T, int N>
+int SPSCChannel<T, N>::read_range(T* dst, int max_count) noexcept {
+  const int num_read = ring.read_range(dst, max_count);
+  on_read(num_read);
+  return num_read;
+}
+
+template <typename T, int N>
+template <typename F>
+int SPSCChannel<T, N>::read_all(F&& f) {
+  int num_read{};
+  T* data;
+  while (int count = ring.peek(&data, N)) {
+    for (int i = 0; i < count; i++) {
+      f(std::move(data[i]));
+    }
+    ring.skip(count);
+    num_read += count;
+  }
+  on_read(num_read);
+  return num_read;
+}
+
+template <typename T, int N>
+int SPSCChannel<T, N>::size() const noexcept {
+  return ring.size();
+}
+
+template <typename T, int N>
+int SPSCChannel<T, N>::write_capacity() const noexcept {
+  return ring.write_capacity();
+}
+
+template <typename T, int N>
+void SPSCChannel<T, N>::set_wakeup(Wakeup* w) noexcept {
+  wakeup = w;
+}
+
+template <typename T, int N>
+ChannelStats SPSCChannel<T, N>::stats() const {
+  return read_channel_stats(metrics);
+}
+
+template <typename T, int N>
+MPSCChannel<T, N>::MPSCChannel(const char* name) {
+  metrics.name = name;
+  metrics.capacity = queue.write_capacity();
+  register_channel(&metrics);
+}
+
+template <typename T, int N>
+MPSCChannel<T, N>::~MPSCChannel() {
+  unregister_channel(&metrics);
+}
+
+template <typename T, int N>
+void MPSCChannel<T, N>::on_write() noexcept {
+  metrics.num_written.fetch_add(1, std::memory_order_relaxed);
+  detail::update_high_water_mark(metrics.high_water_mark, queue.size());
+  if (wakeup) {
+    notify(wakeup);
+  }
+}
+
+template <typename T, int N>
+template <typename U>
+bool MPSCChannel<T, N>::try_write(U&& element) noexcept {
+  if (queue.maybe_write(std::forward<U>(element))) {
+    on_write();
+    return true;
+  } else {
+    return false;
+  }
+}
+
+template <typename T, int N>
+template <typename U>
+bool MPSCChannel<T, N>::maybe_write(U&& element) noexcept {
+  if (try_write(std::forward<U>(element))) {
+    return true;
+  } else {
+    detail::record_drop(metrics);
+    return false;
+  }
+}
+
+template <typename T, int N>
+int MPSCChannel<T, N>::write_range(const T* begin, const T* end) noexcept {
+  int num_write{};
+  for (auto* it = begin; it != end; ++it) {
+    if (maybe_write(*it)) {
+      num_write++;
+    }
+  }
+  return num_write;
+}
+
+template <typename T, int N>
+bool MPSCChannel<T, N>::full() const noexcept {
+  return queue.full();
+}
+
+template <typename T, int N>
+bool MPSCChannel<T, N>::maybe_read(T* element) noexcept {
+  if (queue.maybe_read(element)) {
+    detail::increment_single_writer(metrics.num_read);
+    return true;
+  } else {
+    return false;
+  }
+}
+
+template <typename T, int N>
+int MPSCChannel<T, N>::read_range(T* dst, int max_count) noexcept {
+  int num_read{};
+  while (num_read < max_count && queue.maybe_read(dst + num_read)) {
+    num_read++;
+  }
+  detail::increment_single_writer(metrics.num_read, uint64_t(num_read));
+  return num_read;
+}
+
+template <typename T, int N>
+template <typename F>
+int MPSCChannel<T, N>::read_all(F&& f) {
+  int num_read{};
+  T element;
+  while (queue.maybe_read(&element)) {
+    f(std::move(element));
+    num_read++;
+  }
+  detail::increment_single_writer(metrics.num_read, uint64_t(num_read));
+  return num_read;
+}
+
+template <typename T, int N>
+int MPSCChannel<T, N>::size() const noexcept {
+  return queue.size();
+}
+
+template <typename T, int N>
+int MPSCChannel<T, N>::write_capacity() const noexcept {
+  return queue.write_capacity();
+}
+
+template <typename T, int N>
+void MPSCChannel<T, N>::set_wakeup(Wakeup* w) noexcept {
+  wakeup = w;
+}
+
+template <typename T, int N>
+ChannelStats MPSCChannel<T, N>::stats() const {
+  return read_channel_stats(metrics);
+}
+
+}
@@ -0,0 +1,27 @@
+#include "channel_gui.hpp"
+#include "channel.hpp"
+#include <imgui.h>
+
+namespace ws {
+
+void gui::render_channel_gui() {
+  for (auto& stats : ws::read_all_channel_stats()) {
+    if (ImGui::TreeNode(stats.name)) {
+      render_channel_stats(stats);
+      ImGui::TreePop();
+    }
+  }
+}
+
+void gui::render_channel_stats(const ChannelStats& stats) {
+  ImGui::Text("Depth: %d / %d", stats.depth, stats.capacity);
+  ImGui::Text("High water mark: %d", stats.high_water_mark);
+  ImGui::Text("Written: %llu", (unsigned long long) stats.num_written);
+  ImGui::Text("Read: %llu", (unsigned long long) stats.num_read);
+  ImGui::Text("Dropped: %llu", (unsigned long long) stats.num_dropped);
+  if (stats.num_dropped > 0) {
+    ImGui::Text("Last drop: %0.1fs ago", elapsed_time(stats.last_drop_time, now()));
+  }
+}
+
+}
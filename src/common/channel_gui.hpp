@@ -0,0 +1,12 @@
+#pragma once
+
+namespace ws {
+struct ChannelStats;
+}
+
+namespace ws::gui {
+
+void render_channel_gui();
+void render_channel_stats(const ChannelStats& stats);
+
+}
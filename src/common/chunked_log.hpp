@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace ws {
+
+/*
+ * ChunkedLog - Append-only storage for records, in fixed-size chunks of N elements. Appending
+ * never moves existing elements: when the last chunk is full a new one is started, so appends are
+ * O(1) with no reallocate-and-copy of everything logged so far, and pointers to elements stay
+ * valid until their chunk is flushed. N must be a power of two.
+ *
+ * Full chunks can be handed to a sink with `flush_full_chunks` and released, which keeps memory
+ * bounded for logs that are written out as the session runs. Released chunks are kept for reuse,
+ * so a log that is flushed regularly stops allocating. Element indices count from the start of
+ * the log, including flushed elements; only elements from `first_index()` on can be accessed.
+ */
+
+template <typename T, int N = 1024>
+class ChunkedLog {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "Expected N to be a power of two.");
+
+  static constexpr int64_t chunk_size = N;
+  static constexpr int64_t chunk_mask = N - 1;
+
+  using Chunk = std::unique_ptr<T[]>;
+
+public:
+  T& push_back(const T& element);
+  void clear();
+
+  //  Call `f(const T* elements, int count)` for each full chunk, oldest first, then release those
+  //  chunks. The partially filled last chunk is kept.
+  template <typename F>
+  void flush_full_chunks(F&& f);
+
+  //  Call `f(const T* elements, int count)` for each retained chunk, oldest first.
+  template <typename F>
+  void for_each_chunk(F&& f) const;
+
+  template <typename F>
+  void for_each(F&& f) const;
+
+  //  Total number of elements appended, including flushed ones.
+  int64_t size() const {
+    return num_flushed + num_retained;
+  }
+  bool empty() const {
+    return size() == 0;
+  }
+  int64_t first_index() const {
+    return num_flushed;
+  }
+
+  T& operator[](int64_t i);
+  const T& operator[](int64_t i) const;
+  T& back();
+
+private:
+  Chunk acquire_chunk();
+
+private:
+  std::vector<Chunk> chunks;
+  std::vector<Chunk> free_chunks;
+  int64_t num_retained{};
+  int64_t num_flushed{};
+};
+
+/*
+ * Impl
+ */
+
+template <typename T, int N>
+typename ChunkedLog<T, N>::Chunk ChunkedLog<T, N>::acquire_chunk() {
+  if (free_chunks.empty()) {
+    return Chunk{new T[N]};
+  }
+  auto chunk = std::move(free_chunks.back());
+  free_chunks.pop_back();
+  return chunk;
+}
+
+template <typename T, int N>
+T& ChunkedLog<T, N>::push_back(const T& element) {
+  if (num_retained == int64_t(chunks.size()) * chunk_size) {
+    chunks.push_back(acquire_chunk());
+  }
+  auto& slot = chunks.back()[num_retained & chunk_mask];
+  slot = element;
+  num_retained++;
+  return slot;
+}
+
+template <typename T, int N>
+void ChunkedLog<T, N>::clear() {
+  for (auto& chunk : chunks) {
+    free_chunks.push_back(std::move(chunk));
+  }
+  chunks.clear();
+  num_retained = 0;
+  num_flushed = 0;
+}
+
+template <typename T, int N>
+template <typename F>
+void ChunkedLog<T, N>::flush_full_chunks(F&& f) {
+  const auto num_full = size_t(num_retained / chunk_size);
+  for (size_t i = 0; i < num_full; i++) {
+    f(static_cast<const T*>(chunks[i].get()), N);
+    free_chunks.push_back(std::move(chunks[i]));
+  }
+  chunks.erase(chunks.begin(), chunks.begin() + num_full);
+  num_retained -= int64_t(num_full) * chunk_size;
+  num_flushed += int64_t(num_full) * chunk_size;
+}
+
+template <typename T, int N>
+template <typename F>
+void ChunkedLog<T, N>::for_each_chunk(F&& f) const {
+  int64_t remaining = num_retained;
+  for (auto& chunk : chunks) {
+    const int count = int(remaining < chunk_size ? remaining : chunk_size);
+    f(static_cast<const T*>(chunk.get()), count);
+    remaining -= count;
+  }
+}
+
+template <typename T, int N>
+template <typename F>
+void ChunkedLog<T, N>::for_each(F&& f) const {
+  for_each_chunk([&f](const T* elements, int count) {
+    for (int i = 0; i < count; i++) {
+      f(elements[i]);
+    }
+  });
+}
+
+template <typename T, int N>
+T& ChunkedLog<T, N>::operator[](int64_t i) {
+  assert(i >= num_flushed && i < size());
+  i -= num_flushed;
+  return chunks[size_t(i / chunk_size)][i & chunk_mask];
+}
+
+template <typename T, int N>
+const T& ChunkedLog<T, N>::operator[](int64_t i) const {
+  return const_cast<ChunkedLog*>(this)->operator[](i);
+}
+
+template <typename T, int N>
+T& ChunkedLog<T, N>::back() {
+  assert(num_retained > 0);
+  return (*this)[size() - 1];
+}
+
+}
@@ -0,0 +1,117 @@
+#include "clock_sync.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace ws {
+
+namespace {
+
+double device_seconds(const ClockSync& sync, uint64_t device_time_us) {
+  return double(int64_t(device_time_us - sync.device_epoch_us)) * 1e-6;
+}
+
+double host_seconds(const ClockSync& sync, const TimePoint& t) {
+  return elapsed_time(sync.host_epoch, t);
+}
+
+uint64_t unwrap(ClockSync* sync, uint32_t counter) {
+  sync->device_counter_high += uint64_t(uint32_t(counter - sync->last_device_counter));
+  sync->last_device_counter = counter;
+  return sync->device_counter_high;
+}
+
+//  Fit host_s - device_s = offset + drift * device_s.
+void fit(ClockSync* sync) {
+  double min_round_trip{INFINITY};
+  for (int i = 0; i < sync->num_observations; i++) {
+    min_round_trip = std::min(min_round_trip, sync->observations[i].round_trip_s);
+  }
+
+  const double max_round_trip = min_round_trip * ClockSync::max_round_trip_ratio + 1e-4;
+  int n{};
+  double sx{};
+  double sy{};
+  double sxx{};
+  double sxy{};
+  for (int i = 0; i < sync->num_observations; i++) {
+    auto& obs = sync->observations[i];
+    if (obs.round_trip_s <= max_round_trip) {
+      const double x = obs.device_s;
+      const double y = obs.host_s - obs.device_s;
+      n++;
+      sx += x;
+      sy += y;
+      sxx += x * x;
+      sxy += x * y;
+    }
+  }
+
+  if (n < ClockSync::min_num_fit) {
+    return;
+  }
+
+  const double denom = double(n) * sxx - sx * sx;
+  //  Too little spread in device time to estimate drift; assume none.
+  const double drift = std::abs(denom) > 1e-9 ? (double(n) * sxy - sx * sy) / denom : 0.0;
+  const double offset = (sy - drift * sx) / double(n);
+
+  double ss{};
+  for (int i = 0; i < sync->num_observations; i++) {
+    auto& obs = sync->observations[i];
+    if (obs.round_trip_s <= max_round_trip) {
+      const double r = obs.host_s - obs.device_s - (offset + drift * obs.device_s);
+      ss += r * r;
+    }
+  }
+
+  sync->offset_s = offset;
+  sync->drift = drift;
+  sync->residual_s = std::sqrt(ss / double(n));
+  sync->synchronized = true;
+}
+
+} //  anon
+
+void reset(ClockSync* sync) {
+  *sync = {};
+}
+
+uint64_t add_round_trip(ClockSync* sync, const TimePoint& sent, const TimePoint& received,
+                        uint32_t device_counter_us) {
+  if (sync->initialized && int32_t(device_counter_us - sync->last_device_counter) < 0) {
+    reset(sync);
+  }
+
+  if (!sync->initialized) {
+    sync->initialized = true;
+    sync->host_epoch = sent;
+    sync->device_epoch_us = device_counter_us;
+    sync->last_device_counter = device_counter_us;
+    sync->device_counter_high = device_counter_us;
+  }
+
+  const uint64_t device_time_us = unwrap(sync, device_counter_us);
+
+  ClockSyncObservation obs{};
+  obs.device_s = device_seconds(*sync, device_time_us);
+  obs.host_s = 0.5 * (host_seconds(*sync, sent) + host_seconds(*sync, received));
+  obs.round_trip_s = elapsed_time(sent, received);
+  sync->observations[sync->next_observation] = obs;
+  sync->next_observation = (sync->next_observation + 1) % ClockSync::window_size;
+  sync->num_observations = std::min(sync->num_observations + 1, ClockSync::window_size);
+
+  fit(sync);
+  return device_time_us;
+}
+
+std::optional<TimePoint> to_host_time(const ClockSync& sync, uint64_t device_time_us) {
+  if (!sync.synchronized) {
+    return std::nullopt;
+  }
+
+  const double x = device_seconds(sync, device_time_us);
+  const double host_s = x + sync.offset_s + sync.drift * x;
+  return sync.host_epoch + std::chrono::duration_cast<TimePoint::duration>(Duration(host_s));
+}
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "time.hpp"
+#include <array>
+#include <cstdint>
+#include <optional>
+
+namespace ws {
+
+/*
+ * ClockSync - Maps a device's microsecond counter onto host time. Each request / response round
+ * trip that returns a device timestamp bounds the host time at which the device took it to
+ * [sent, received]. Host time is modeled as a linear function of device time (offset + drift), fit
+ * by least squares over recent round trips, using only those whose round trip time is close to
+ * the window's minimum, since those have the least uncertainty.
+ *
+ * The device counter is 32 bits and wraps (~71 minutes for `micros()`); it is unwrapped to 64
+ * bits. A counter that moves backwards means the device restarted, and the estimate is reset.
+ */
+
+struct ClockSyncObservation {
+  double device_s;
+  double host_s;
+  double round_trip_s;
+};
+
+struct ClockSync {
+  static constexpr int window_size = 128;
+  //  Round trips up to this many times the window's minimum round trip time are used in the fit.
+  static constexpr double max_round_trip_ratio = 1.5;
+  static constexpr int min_num_fit = 4;
+
+  bool initialized;
+  TimePoint host_epoch;
+  uint64_t device_epoch_us;
+  uint32_t last_device_counter;
+  uint64_t device_counter_high;
+
+  std::array<ClockSyncObservation, window_size> observations;
+  int num_observations;
+  int next_observation;
+
+  bool synchronized;
+  double offset_s;
+  double drift;
+  //  RMS residual of the fit.
+  double residual_s;
+};
+
+void reset(ClockSync* sync);
+//  `received` should exclude the time taken to transmit the response itself, which for long
+//  responses at low baud rates dominates the round trip. Returns the unwrapped device time in
+//  microseconds.
+uint64_t add_round_trip(ClockSync* sync, const TimePoint& sent, const TimePoint& received,
+                        uint32_t device_counter_us);
+std::optional<TimePoint> to_host_time(const ClockSync& sync, uint64_t device_time_us);
+
+}
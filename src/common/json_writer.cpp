@@ -0,0 +1,185 @@
+#include "json_writer.hpp"
+#include <cassert>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+namespace ws {
+
+JsonWriter::~JsonWriter() {
+  (void) close();
+}
+
+bool JsonWriter::open(const std::string& file_path) {
+  (void) close();
+  file = std::fopen(file_path.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  if (!buffer) {
+    buffer = std::make_unique<char[]>(buffer_size);
+  }
+  buffer_pos = 0;
+  failed = false;
+  has_element.clear();
+  after_key = false;
+  return true;
+}
+
+bool JsonWriter::close() {
+  if (!file) {
+    return false;
+  }
+  assert(has_element.empty());
+  flush_buffer();
+  failed |= std::fclose(file) != 0;
+  file = nullptr;
+  return !failed;
+}
+
+void JsonWriter::flush_buffer() {
+  if (buffer_pos > 0) {
+    failed |= std::fwrite(buffer.get(), 1, buffer_pos, file) != buffer_pos;
+    buffer_pos = 0;
+  }
+}
+
+char* JsonWriter::reserve(size_t n) {
+  assert(n <= buffer_size);
+  if (buffer_size - buffer_pos < n) {
+    flush_buffer();
+  }
+  return buffer.get() + buffer_pos;
+}
+
+void JsonWriter::put(char c) {
+  *reserve(1) = c;
+  buffer_pos++;
+}
+
+void JsonWriter::put_string(const char* s, size_t size) {
+  put('"');
+  for (size_t i = 0; i < size; i++) {
+    const auto c = static_cast<unsigned char>(s[i]);
+    if (c == '"' || c == '\\') {
+      put('\\');
+      put(char(c));
+    } else if (c == '\n') {
+      put('\\');
+      put('n');
+    } else if (c == '\t') {
+      put('\\');
+      put('t');
+    } else if (c < 0x20) {
+      //  One more byte than the escape, for the terminating null snprintf writes.
+      char* dst = reserve(7);
+      std::snprintf(dst, 7, "\\u%04x", unsigned(c));
+      buffer_pos += 6;
+    } else {
+      put(char(c));
+    }
+  }
+  put('"');
+}
+
+template <typename T>
+void JsonWriter::put_number(T v) {
+  char* dst = reserve(max_number_size);
+  const auto res = std::to_chars(dst, dst + max_number_size, v);
+  assert(res.ec == std::errc{});
+  buffer_pos += size_t(res.ptr - dst);
+}
+
+void JsonWriter::put_integer(int64_t v) {
+  put_number(v);
+}
+
+void JsonWriter::put_integer(uint64_t v) {
+  put_number(v);
+}
+
+void JsonWriter::put_null() {
+  std::memcpy(reserve(4), "null", 4);
+  buffer_pos += 4;
+}
+
+void JsonWriter::begin_value() {
+  if (after_key) {
+    after_key = false;
+  } else if (!has_element.empty()) {
+    if (has_element.back()) {
+      put(',');
+    }
+    has_element.back() = 1;
+  }
+}
+
+void JsonWriter::begin_array() {
+  begin_value();
+  put('[');
+  has_element.push_back(0);
+}
+
+void JsonWriter::end_array() {
+  assert(!has_element.empty() && !after_key);
+  has_element.pop_back();
+  put(']');
+}
+
+void JsonWriter::begin_object() {
+  begin_value();
+  put('{');
+  has_element.push_back(0);
+}
+
+void JsonWriter::end_object() {
+  assert(!has_element.empty() && !after_key);
+  has_element.pop_back();
+  put('}');
+}
+
+void JsonWriter::key(const char* name) {
+  assert(!has_element.empty() && !after_key);
+  begin_value();
+  put_string(name, std::strlen(name));
+  put(':');
+  after_key = true;
+}
+
+void JsonWriter::value(bool v) {
+  begin_value();
+  const char* s = v ? "true" : "false";
+  const size_t size = v ? 4 : 5;
+  std::memcpy(reserve(size), s, size);
+  buffer_pos += size;
+}
+
+void JsonWriter::value(float v) {
+  begin_value();
+  if (std::isfinite(v)) {
+    put_number(v);
+  } else {
+    put_null();
+  }
+}
+
+void JsonWriter::value(double v) {
+  begin_value();
+  if (std::isfinite(v)) {
+    put_number(v);
+  } else {
+    put_null();
+  }
+}
+
+void JsonWriter::value(const char* v) {
+  begin_value();
+  put_string(v, std::strlen(v));
+}
+
+void JsonWriter::value(const std::string& v) {
+  begin_value();
+  put_string(v.data(), v.size());
+}
+
+}
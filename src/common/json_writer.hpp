@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace ws {
+
+/*
+ * JsonWriter - Streams JSON to a file as it is produced, without building a document in memory.
+ * Output goes through a fixed-size buffer, and numbers are formatted with `std::to_chars`
+ * (shortest representation that reads back to the same value), so memory use stays constant
+ * however many records are written.
+ *
+ * The caller is responsible for well-formed nesting: `key` only inside objects, and each
+ * `begin_*` matched by its `end_*`. Non-finite floating point values are written as null.
+ */
+
+class JsonWriter {
+public:
+  JsonWriter() = default;
+  ~JsonWriter();
+
+  JsonWriter(const JsonWriter&) = delete;
+  JsonWriter& operator=(const JsonWriter&) = delete;
+
+  bool open(const std::string& file_path);
+  //  Write any buffered output and close the file. Returns false if any write failed.
+  bool close();
+  bool is_open() const {
+    return file != nullptr;
+  }
+
+  void begin_array();
+  void end_array();
+  void begin_object();
+  void end_object();
+  void key(const char* name);
+
+  void value(bool v);
+  void value(float v);
+  void value(double v);
+  void value(const char* v);
+  void value(const std::string& v);
+  template <typename T>
+  std::enable_if_t<std::is_integral_v<T>> value(T v);
+  template <typename T>
+  void value(const std::vector<T>& v);
+
+  template <typename T>
+  void field(const char* name, const T& v) {
+    key(name);
+    value(v);
+  }
+
+private:
+  void begin_value();
+  //  Returns a pointer to at least `n` free bytes of the buffer.
+  char* reserve(size_t n);
+  void put(char c);
+  void put_string(const char* s, size_t size);
+  void flush_buffer();
+  template <typename T>
+  void put_number(T v);
+  void put_integer(int64_t v);
+  void put_integer(uint64_t v);
+  void put_null();
+
+private:
+  static constexpr size_t buffer_size = 64 * 1024;
+  static constexpr size_t max_number_size = 32;
+
+  std::FILE* file{};
+  std::unique_ptr<char[]> buffer;
+  size_t buffer_pos{};
+  bool failed{};
+  //  One entry per open array or object: whether it has an element yet.
+  std::vector<uint8_t> has_element;
+  bool after_key{};
+};
+
+/*
+ * Impl
+ */
+
+template <typename T>
+std::enable_if_t<std::is_integral_v<T>> JsonWriter::value(T v) {
+  begin_value();
+  if constexpr (std::is_signed_v<T>) {
+    put_integer(int64_t(v));
+  } else {
+    put_integer(uint64_t(v));
+  }
+}
+
+template <typename T>
+void JsonWriter::value(const std::vector<T>& v) {
+  begin_array();
+  for (auto& element : v) {
+    value(element);
+  }
+  end_array();
+}
+
+}
@@ -1,6 +1,7 @@
 #include "juice_pump.hpp"
 #include "serial.hpp"
-#include "ringbuffer.hpp"
+#include "channel.hpp"
+#include "trace.hpp"
 #include <cassert>
 #include <thread>
 #include <mutex>
@@ -94,16 +95,24 @@ PumpCommand make_set_address_command(pump::PumpHandle pump, int addr) {
   return result;
 }
 
-std::string make_set_rate_command_string(int addr, int rate, std::optional<pump::RateUnits> units) {
-  std::string result;
-  result += std::to_string(addr);
-  result += " RAT ";
-  result += std::to_string(rate);
+//  Command strings are formatted into a caller-provided buffer; these return the number of
+//  characters written, or 0 if the command does not fit.
+int finish_command_string(int size, int capacity) {
+  if (size > 0 && size < capacity) {
+    return size;
+  } else {
+    assert(false);
+    return 0;
+  }
+}
+
+int make_set_rate_command_string(char* dst, int capacity, int addr, int rate,
+                                 std::optional<pump::RateUnits> units) {
+  const char* units_str = "";
   if (units) {
-    result += " ";
     switch (units.value()) {
       case pump::RateUnits::mLPerHour: {
-        result += "MH";
+        units_str = " MH";
         break;
       }
       default: {
@@ -111,33 +120,18 @@ std::string make_set_rate_command_string(int addr, int rate, std::optional<pump:
       }
     }
   }
-  result += Config::serial_terminator;
-  return result;
-}
-
-std::string to_float_limit_trailing_digits(float v) {
-  char buff[128];
-  int cx = std::snprintf(buff, 128, "%0.3f", v);
-  if (cx >= 0 && cx < 128) {
-    return std::string{buff};
-  } else {
-    assert(false);
-    return "";
-  }
+  const int size = std::snprintf(
+    dst, size_t(capacity), "%d RAT %d%s%c", addr, rate, units_str, Config::serial_terminator);
+  return finish_command_string(size, capacity);
 }
 
-std::string make_set_volume_command_string(int addr, float vol,
-                                           std::optional<pump::VolumeUnits> units) {
-  std::string result;
-  result += std::to_string(addr);
-  result += " VOL ";
-  result += to_float_limit_trailing_digits(vol);
+int make_set_volume_command_string(char* dst, int capacity, int addr, float vol,
+                                   std::optional<pump::VolumeUnits> units) {
 #if 0
   if (units) {
-    result += " ";
     switch (units.value()) {
       case pump::VolumeUnits::mL: {
-        result += "ML";
+        //  " ML"
         break;
       }
       default: {
@@ -148,40 +142,44 @@ std::string make_set_volume_command_string(int addr, float vol,
 #else
   (void) units;
 #endif
-  result += Config::serial_terminator;
-  return result;
+  const int size = std::snprintf(
+    dst, size_t(capacity), "%d VOL %0.3f%c", addr, vol, Config::serial_terminator);
+  return finish_command_string(size, capacity);
 }
 
-std::string make_run_program_command_string(int addr) {
-  auto result = std::to_string(addr) + " RUN";
-  result += Config::serial_terminator;
-  return result;
+int make_run_program_command_string(char* dst, int capacity, int addr) {
+  const int size = std::snprintf(
+    dst, size_t(capacity), "%d RUN%c", addr, Config::serial_terminator);
+  return finish_command_string(size, capacity);
 }
 
-std::string make_stop_program_command_string(int addr) {
-  auto result = std::to_string(addr) + " STP";
-  result += Config::serial_terminator;
-  return result;
+int make_stop_program_command_string(char* dst, int capacity, int addr) {
+  const int size = std::snprintf(
+    dst, size_t(capacity), "%d STP%c", addr, Config::serial_terminator);
+  return finish_command_string(size, capacity);
 }
 
-std::optional<std::string> command_to_string(const pump::PumpState& state, const PumpCommand& cmd) {
+int command_to_string(const pump::PumpState& state, const PumpCommand& cmd,
+                      char* dst, int capacity) {
   switch (cmd.type) {
     case PumpCommandType::SetRate: {
       auto& set_rate = cmd.set_rate;
-      return make_set_rate_command_string(state.address, set_rate.rate, set_rate.units);
+      return make_set_rate_command_string(
+        dst, capacity, state.address, set_rate.rate, set_rate.units);
     }
     case PumpCommandType::SetVolume: {
       auto& set_vol = cmd.set_volume;
-      return make_set_volume_command_string(state.address, set_vol.volume, set_vol.units);
+      return make_set_volume_command_string(
+        dst, capacity, state.address, set_vol.volume, set_vol.units);
     }
     case PumpCommandType::RunProgram: {
-      return make_run_program_command_string(state.address);
+      return make_run_program_command_string(dst, capacity, state.address);
     }
     case PumpCommandType::StopProgram: {
-      return make_stop_program_command_string(state.address);
+      return make_stop_program_command_string(dst, capacity, state.address);
     }
     default: {
-      return std::nullopt;
+      return 0;
     }
   }
 }
@@ -213,190 +211,290 @@ void apply_command(pump::PumpState& state, const PumpCommand& cmd) {
   }
 }
 
-struct {
+} //  anon
+
+struct pump::PumpSystem {
+  PumpSystem() {
+    //  Submitted commands wake the worker rather than waiting out its poll interval.
+    commands_to_pump.set_wakeup(&worker_wakeup);
+  }
+
   bool initialized{};
   int num_pumps{};
   std::optional<SerialContext> open_context;
+  //  Of the current (or most recent) connection.
+  SerialStats serial_stats;
 
   std::array<pump::PumpState, Config::max_num_pumps> desired_pump_state{};
   std::array<pump::PumpState, Config::max_num_pumps> canonical_pump_state{};
 
-  RingBuffer<PumpCommand, 1024> commands_to_pump;
-  std::vector<PumpCommand> pending_commands_to_pump;
+  MPSCChannel<PumpCommand, 1024> commands_to_pump{"pump/commands_to_pump"};
+  Wakeup worker_wakeup;
+  std::atomic<uint64_t> num_waited_commands{};
+  std::atomic<uint64_t> num_unsent_commands{};
+  std::atomic<pump::CommandQueueFullPolicy> command_queue_full_policy{
+    pump::CommandQueueFullPolicy::WaitForSpace};
 
   std::vector<PumpCommand> pending_commands_to_execute;
   std::thread worker_thread;
   std::atomic<bool> keep_processing{};
   std::mutex canonical_pump_state_mutex;
+  std::mutex desired_pump_state_mutex;
+};
 
-} global_data;
+namespace {
 
-void push_pending_command(PumpCommand cmd) {
-  global_data.pending_commands_to_pump.push_back(cmd);
+using pump::PumpSystem;
+
+struct {
+  PumpSystem pump_system;
+} globals;
+
+//  Callable from any thread. Commands are consumed directly by the worker; if the queue is full,
+//  either drop the command or wait for the worker to drain the queue, depending on the policy.
+void push_pending_command(PumpSystem* sys, const PumpCommand& cmd) {
+  auto& queue = sys->commands_to_pump;
+  const auto policy = sys->command_queue_full_policy.load(std::memory_order_relaxed);
+
+  bool waited{};
+  while (!queue.try_write(cmd)) {
+    if (policy == pump::CommandQueueFullPolicy::DropNewest ||
+        !sys->keep_processing.load()) {
+      //  Counted as dropped if the queue is still full.
+      (void) queue.maybe_write(cmd);
+      return;
+    }
+    waited = true;
+    std::this_thread::yield();
+  }
+
+  if (waited) {
+    sys->num_waited_commands.fetch_add(1, std::memory_order_relaxed);
+  }
 }
 
-void apply_to_desired_state(pump::PumpHandle pump, const PumpCommand& cmd) {
+void apply_to_desired_state(PumpSystem* sys, pump::PumpHandle pump, const PumpCommand& cmd) {
   assert(pump.index < uint32_t(Config::max_num_pumps));
-  apply_command(global_data.desired_pump_state[pump.index], cmd);
+  std::lock_guard<std::mutex> lock(sys->desired_pump_state_mutex);
+  apply_command(sys->desired_pump_state[pump.index], cmd);
 }
 
-pump::PumpState* worker_read_canonical_pump_state(pump::PumpHandle pump) {
+void submit_command(PumpSystem* sys, pump::PumpHandle pump, const PumpCommand& cmd) {
+  apply_to_desired_state(sys, pump, cmd);
+  push_pending_command(sys, cmd);
+}
+
+pump::PumpState* worker_read_canonical_pump_state(PumpSystem* sys, pump::PumpHandle pump) {
   assert(pump.index < uint32_t(Config::max_num_pumps));
-  return &global_data.canonical_pump_state[pump.index];
+  return &sys->canonical_pump_state[pump.index];
 }
 
-void worker_execute_commands(const SerialContext& context) {
-  for (auto& cmd : global_data.pending_commands_to_execute) {
-    auto* state = worker_read_canonical_pump_state(cmd.pump);
+//  Consecutive commands are sent with one gathered write, flushed whenever the next command would
+//  not fit in the context's write buffer.
+void worker_execute_commands(PumpSystem* sys, SerialContext& context) {
+  constexpr int max_command_size = 64;
+  constexpr int max_batch_size = SerialBuffers::write_capacity / max_command_size;
+  char cmd_strs[max_batch_size][max_command_size];
+  SerialWriteSpan spans[max_batch_size];
+  int num_spans{};
+
+  auto flush = [&]() {
+    if (num_spans > 0) {
+      const auto t0 = now();
+      const auto err = write_gather(context, spans, num_spans);
+      record_request_latency(context.stats, t0, now());
+      if (err != SerialError::None) {
+        std::cerr << "Failed to write pump commands: " << to_string(err) << std::endl;
+      }
+      num_spans = 0;
+    }
+  };
+
+  for (auto& cmd : sys->pending_commands_to_execute) {
+    auto* state = worker_read_canonical_pump_state(sys, cmd.pump);
     {
-      std::lock_guard<std::mutex> lock(global_data.canonical_pump_state_mutex);
+      std::lock_guard<std::mutex> lock(sys->canonical_pump_state_mutex);
       apply_command(*state, cmd);
     }
-    if (auto cmd_str = command_to_string(*state, cmd)) {
-      context.instance->write(cmd_str.value());
+    if (num_spans == max_batch_size) {
+      flush();
+    }
+    char* dst = cmd_strs[num_spans];
+    if (int size = command_to_string(*state, cmd, dst, max_command_size)) {
+      spans[num_spans++] = SerialWriteSpan{dst, size};
     }
   }
+  flush();
 }
 
-void set_connection_open(int num_pumps, bool open) {
-  std::lock_guard<std::mutex> lock(global_data.canonical_pump_state_mutex);
+void set_connection_open(PumpSystem* sys, int num_pumps, bool open) {
+  std::lock_guard<std::mutex> lock(sys->canonical_pump_state_mutex);
   for (int i = 0; i < num_pumps; i++) {
-    global_data.canonical_pump_state[i].connection_open = open;
+    sys->canonical_pump_state[i].connection_open = open;
   }
 }
 
-void worker(std::string port, int num_pumps) {
+void worker(PumpSystem* sys, std::string port, int num_pumps) {
+  trace::set_thread_name("pump worker");
+
   bool connection_open{};
-  if (auto ctx = make_context(port, Config::serial_baud_rate, Config::serial_timeout)) {
-    global_data.open_context = std::move(ctx.value());
+  SerialError err{};
+  if (auto ctx = make_context(port, Config::serial_baud_rate, Config::serial_timeout, &err)) {
+    sys->open_context = std::move(ctx.value());
+    sys->open_context.value().stats = &sys->serial_stats;
     connection_open = true;
   } else {
-    std::cerr << "Failed to open serial context on port: " << port << std::endl;
+    std::cerr << "Failed to open serial context on port: " << port
+              << " (" << to_string(err) << ")" << std::endl;
   }
 
-  set_connection_open(num_pumps, connection_open);
+  set_connection_open(sys, num_pumps, connection_open);
+  sys->pending_commands_to_execute.reserve(sys->commands_to_pump.write_capacity());
 
-  while (global_data.keep_processing.load()) {
-    int num_commands = global_data.commands_to_pump.size();
-    auto& pending_exec = global_data.pending_commands_to_execute;
-    for (int i = 0; i < num_commands; i++) {
-      auto cmd = global_data.commands_to_pump.read();
+  while (sys->keep_processing.load()) {
+    auto& pending_exec = sys->pending_commands_to_execute;
+    sys->commands_to_pump.read_all([&pending_exec](PumpCommand&& cmd) {
       pending_exec.push_back(cmd);
+    });
+
+    trace::counter("pump/commands", double(pending_exec.size()));
+    if (sys->open_context) {
+      WS_TRACE_ZONE("pump/execute_commands");
+      worker_execute_commands(sys, sys->open_context.value());
+    } else if (!pending_exec.empty()) {
+      //  Nowhere to send them; the desired state still reflects them.
+      sys->num_unsent_commands.fetch_add(pending_exec.size(), std::memory_order_relaxed);
     }
+    pending_exec.clear();
 
-    if (global_data.open_context) {
-      worker_execute_commands(global_data.open_context.value());
-      pending_exec.clear();
-    }
-
-    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    //  Woken by submitted commands and by `terminate_pump_system`.
+    (void) wait_for(&sys->worker_wakeup, std::chrono::milliseconds(100));
   }
 
-  global_data.open_context = std::nullopt;
-  set_connection_open(num_pumps, false);
+  sys->open_context = std::nullopt;
+  set_connection_open(sys, num_pumps, false);
 }
 
 } //  anon
 
-int pump::num_initialized_pumps() {
-  return global_data.num_pumps;
+pump::PumpSystem* pump::create_pump_system() {
+  return new PumpSystem();
+}
+
+void pump::destroy_pump_system(PumpSystem* sys) {
+  terminate_pump_system(sys);
+  delete sys;
+}
+
+pump::PumpSystem* pump::get_global_pump_system() {
+  return &globals.pump_system;
+}
+
+int pump::num_initialized_pumps(PumpSystem* sys) {
+  return sys->num_pumps;
 }
 
 pump::PumpHandle pump::ith_pump(int i) {
   return pump::PumpHandle{uint32_t(i)};
 }
 
-void pump::initialize_pump_system(std::string port, int num_pumps) {
+void pump::initialize_pump_system(PumpSystem* sys, std::string port, int num_pumps) {
   assert(num_pumps < Config::max_num_pumps);
 
-  if (global_data.initialized) {
-    terminate_pump_system();
+  if (sys->initialized) {
+    terminate_pump_system(sys);
   }
 
-  global_data.num_pumps = num_pumps;
+  sys->num_pumps = num_pumps;
 
-  assert(!global_data.keep_processing.load());
-  global_data.keep_processing.store(true);
-  global_data.worker_thread = std::thread(worker, std::move(port), num_pumps);
-  global_data.initialized = true;
+  assert(!sys->keep_processing.load());
+  reset(&sys->serial_stats);
+  sys->keep_processing.store(true);
+  sys->worker_thread = std::thread(worker, sys, std::move(port), num_pumps);
+  sys->initialized = true;
 
   for (int i = 0; i < num_pumps; i++) {
-    pump::set_address_rate_volume(pump::PumpHandle{uint32_t(i)}, global_data.desired_pump_state[i]);
+    auto handle = pump::PumpHandle{uint32_t(i)};
+    pump::set_address_rate_volume(sys, handle, pump::read_desired_pump_state(sys, handle));
   }
 }
 
-void pump::terminate_pump_system() {
-  if (global_data.worker_thread.joinable()) {
-    global_data.keep_processing.store(false);
-    global_data.worker_thread.join();
+void pump::terminate_pump_system(PumpSystem* sys) {
+  if (sys->worker_thread.joinable()) {
+    sys->keep_processing.store(false);
+    notify(&sys->worker_wakeup);
+    sys->worker_thread.join();
   } else {
-    assert(!global_data.keep_processing.load());
+    assert(!sys->keep_processing.load());
   }
 
-  global_data.initialized = false;
-  global_data.num_pumps = 0;
+  sys->initialized = false;
+  sys->num_pumps = 0;
 }
 
-void pump::set_dispensed_volume(PumpHandle pump, float vol, VolumeUnits units) {
-  auto cmd = make_set_volume_command(pump, vol, units);
-  apply_to_desired_state(pump, cmd);
-  push_pending_command(cmd);
+void pump::set_dispensed_volume(PumpSystem* sys, PumpHandle pump, float vol, VolumeUnits units) {
+  submit_command(sys, pump, make_set_volume_command(pump, vol, units));
 }
 
-void pump::set_pump_rate(PumpHandle pump, int rate, RateUnits units) {
-  auto cmd = make_set_rate_command(pump, rate, units);
-  apply_to_desired_state(pump, cmd);
-  push_pending_command(cmd);
+void pump::set_pump_rate(PumpSystem* sys, PumpHandle pump, int rate, RateUnits units) {
+  submit_command(sys, pump, make_set_rate_command(pump, rate, units));
 }
 
-void pump::set_address(PumpHandle pump, int address) {
-  auto cmd = make_set_address_command(pump, address);
-  apply_to_desired_state(pump, cmd);
-  push_pending_command(cmd);
+void pump::set_address(PumpSystem* sys, PumpHandle pump, int address) {
+  submit_command(sys, pump, make_set_address_command(pump, address));
 }
 
-void pump::run_dispense_program(PumpHandle pump){
-  auto cmd = make_run_program_command(pump);
-  apply_to_desired_state(pump, cmd);
-  push_pending_command(cmd);
+void pump::run_dispense_program(PumpSystem* sys, PumpHandle pump){
+  submit_command(sys, pump, make_run_program_command(pump));
 }
 
-void pump::stop_dispense_program(PumpHandle pump) {
-  auto cmd = make_stop_program_command(pump);
-  apply_to_desired_state(pump, cmd);
-  push_pending_command(cmd);
+void pump::stop_dispense_program(PumpSystem* sys, PumpHandle pump) {
+  submit_command(sys, pump, make_stop_program_command(pump));
 }
 
-void pump::set_address_rate_volume(PumpHandle pump, PumpState state) {
-  set_address(pump, state.address);
-  set_pump_rate(pump, state.rate, state.rate_units);
-  set_dispensed_volume(pump, state.volume, state.volume_units);
+void pump::set_address_rate_volume(PumpSystem* sys, PumpHandle pump, PumpState state) {
+  set_address(sys, pump, state.address);
+  set_pump_rate(sys, pump, state.rate, state.rate_units);
+  set_dispensed_volume(sys, pump, state.volume, state.volume_units);
 }
 
-void pump::submit_commands() {
-  auto& pend = global_data.pending_commands_to_pump;
-  auto it = pend.begin();
-  while (it != pend.end()) {
-    auto& dst = global_data.commands_to_pump;
-    if (dst.maybe_write(*it)) {
-      it = pend.erase(it);
-    } else {
-      break;
-    }
-  }
+void pump::set_command_queue_full_policy(PumpSystem* sys, CommandQueueFullPolicy policy) {
+  sys->command_queue_full_policy.store(policy);
+}
+
+pump::CommandQueueFullPolicy pump::get_command_queue_full_policy(PumpSystem* sys) {
+  return sys->command_queue_full_policy.load();
+}
+
+pump::CommandQueueStats pump::read_command_queue_stats(PumpSystem* sys) {
+  auto channel_stats = sys->commands_to_pump.stats();
+  pump::CommandQueueStats result{};
+  result.size = channel_stats.depth;
+  result.capacity = channel_stats.capacity;
+  result.high_water_mark = channel_stats.high_water_mark;
+  result.num_submitted = channel_stats.num_written;
+  result.num_dropped = channel_stats.num_dropped;
+  result.num_waited = sys->num_waited_commands.load(std::memory_order_relaxed);
+  result.num_unsent = sys->num_unsent_commands.load(std::memory_order_relaxed);
+  return result;
+}
+
+SerialStatsSnapshot pump::read_serial_stats(PumpSystem* sys) {
+  return ws::read_serial_stats(sys->serial_stats);
 }
 
-pump::PumpState pump::read_desired_pump_state(PumpHandle pump) {
+pump::PumpState pump::read_desired_pump_state(PumpSystem* sys, PumpHandle pump) {
   assert(pump.index < uint32_t(Config::max_num_pumps));
-  return global_data.desired_pump_state[pump.index];
+  std::lock_guard<std::mutex> lock(sys->desired_pump_state_mutex);
+  return sys->desired_pump_state[pump.index];
 }
 
-pump::PumpState pump::read_canonical_pump_state(PumpHandle pump) {
+pump::PumpState pump::read_canonical_pump_state(PumpSystem* sys, PumpHandle pump) {
   assert(pump.index < uint32_t(Config::max_num_pumps));
   pump::PumpState result;
   {
-    std::lock_guard<std::mutex> lock(global_data.canonical_pump_state_mutex);
-    result = global_data.canonical_pump_state[pump.index];
+    std::lock_guard<std::mutex> lock(sys->canonical_pump_state_mutex);
+    result = sys->canonical_pump_state[pump.index];
   }
   return result;
 }
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "identifier.hpp"
+#include "serial_stats.hpp"
+#include <cstdint>
 #include <string>
 
 namespace ws::pump {
@@ -23,27 +25,61 @@ struct PumpState {
   pump::VolumeUnits volume_units;
 };
 
+//  What to do when a command is submitted while the command queue is full.
+enum class CommandQueueFullPolicy {
+  DropNewest,
+  WaitForSpace
+};
+
+struct CommandQueueStats {
+  int size;
+  int capacity;
+  int high_water_mark;
+  uint64_t num_submitted;
+  uint64_t num_dropped;
+  uint64_t num_waited;
+  //  Discarded by the worker because the pump's port is not open.
+  uint64_t num_unsent;
+};
+
 struct PumpHandle {
   WS_INTEGER_IDENTIFIER_EQUALITY(PumpHandle, index)
   uint32_t index;
 };
 
-void initialize_pump_system(std::string port, int num_pumps);
-void terminate_pump_system();
+/*
+ * PumpSystem - The pumps on one serial connection, and the worker thread that sends them commands.
+ * Systems are independent of each other; a rig's task uses its own. The global system is the one
+ * driven by the app's GUI.
+ */
+
+struct PumpSystem;
+
+PumpSystem* create_pump_system();
+//  Terminates the system first, if it is running.
+void destroy_pump_system(PumpSystem* sys);
+PumpSystem* get_global_pump_system();
+
+void initialize_pump_system(PumpSystem* sys, std::string port, int num_pumps);
+void terminate_pump_system(PumpSystem* sys);
 
-int num_initialized_pumps();
+int num_initialized_pumps(PumpSystem* sys);
 pump::PumpHandle ith_pump(int i);
 
-PumpState read_desired_pump_state(PumpHandle pump);
-PumpState read_canonical_pump_state(PumpHandle pump);
+PumpState read_desired_pump_state(PumpSystem* sys, PumpHandle pump);
+PumpState read_canonical_pump_state(PumpSystem* sys, PumpHandle pump);
 
-void set_dispensed_volume(PumpHandle pump, float vol, VolumeUnits units);
-void set_pump_rate(PumpHandle pump, int rate, RateUnits units);
-void set_address(PumpHandle pump, int address);
-void set_address_rate_volume(PumpHandle pump, PumpState state);
-void run_dispense_program(PumpHandle pump);
-void stop_dispense_program(PumpHandle pump);
+void set_dispensed_volume(PumpSystem* sys, PumpHandle pump, float vol, VolumeUnits units);
+void set_pump_rate(PumpSystem* sys, PumpHandle pump, int rate, RateUnits units);
+void set_address(PumpSystem* sys, PumpHandle pump, int address);
+void set_address_rate_volume(PumpSystem* sys, PumpHandle pump, PumpState state);
+void run_dispense_program(PumpSystem* sys, PumpHandle pump);
+void stop_dispense_program(PumpSystem* sys, PumpHandle pump);
 
-void submit_commands();
+void set_command_queue_full_policy(PumpSystem* sys, CommandQueueFullPolicy policy);
+CommandQueueFullPolicy get_command_queue_full_policy(PumpSystem* sys);
+CommandQueueStats read_command_queue_stats(PumpSystem* sys);
+//  Of the serial connection shared by all of the system's pumps.
+SerialStatsSnapshot read_serial_stats(PumpSystem* sys);
 
 }
\ No newline at end of file
@@ -1,65 +1,94 @@
 #include "juice_pump_gui.hpp"
 #include "juice_pump.hpp"
 #include "serial.hpp"
+#include "serial_stats_gui.hpp"
 #include <imgui/imgui.h>
 
 namespace ws {
 
 gui::JuicePumpGUIResult gui::render_juice_pump_gui(const JuicePumpGUIParams& params) {
   gui::JuicePumpGUIResult result{};
+  auto* pump_sys = params.pump_system;
 
   for (int i = 0; i < params.num_ports; i++) {
     if (ImGui::Button(params.serial_ports[i].port.c_str())) {
-      ws::pump::initialize_pump_system(params.serial_ports[i].port, params.num_pumps);
+      ws::pump::initialize_pump_system(pump_sys, params.serial_ports[i].port, params.num_pumps);
     }
   }
 
   if (ImGui::Button("TerminateSystem")) {
-    ws::pump::terminate_pump_system();
+    ws::pump::terminate_pump_system(pump_sys);
   }
 
   const auto enter_flag = ImGuiInputTextFlags_EnterReturnsTrue;
 
-  if (ws::pump::num_initialized_pumps() > 0) {
+  if (ws::pump::num_initialized_pumps(pump_sys) > 0) {
     bool allow_run = params.allow_automated_run;
     if (ImGui::Checkbox("AllowAutomatedRun", &allow_run)) {
       result.allow_automated_run = allow_run;
     }
   }
 
-  for (int i = 0; i < ws::pump::num_initialized_pumps(); i++) {
+  if (ImGui::TreeNode("CommandQueue")) {
+    auto stats = ws::pump::read_command_queue_stats(pump_sys);
+    ImGui::Text("Size: %d / %d (high water mark: %d)",
+                stats.size, stats.capacity, stats.high_water_mark);
+    ImGui::Text("Submitted: %llu", (unsigned long long) stats.num_submitted);
+    ImGui::Text("Dropped: %llu", (unsigned long long) stats.num_dropped);
+    ImGui::Text("Waited for space: %llu", (unsigned long long) stats.num_waited);
+    ImGui::Text("Unsent (port closed): %llu", (unsigned long long) stats.num_unsent);
+
+    bool drop_when_full =
+      ws::pump::get_command_queue_full_policy(pump_sys) == ws::pump::CommandQueueFullPolicy::DropNewest;
+    if (ImGui::Checkbox("DropWhenFull", &drop_when_full)) {
+      ws::pump::set_command_queue_full_policy(
+        pump_sys,
+        drop_when_full ?
+        ws::pump::CommandQueueFullPolicy::DropNewest :
+        ws::pump::CommandQueueFullPolicy::WaitForSpace);
+    }
+
+    ImGui::TreePop();
+  }
+
+  if (ImGui::TreeNode("SerialStats")) {
+    gui::render_serial_stats(ws::pump::read_serial_stats(pump_sys));
+    ImGui::TreePop();
+  }
+
+  for (int i = 0; i < ws::pump::num_initialized_pumps(pump_sys); i++) {
     auto pump_handle = ws::pump::ith_pump(i);
 
     std::string handle_label{"Pump"};
     handle_label += std::to_string(pump_handle.index);
 
     if (ImGui::TreeNode(handle_label.c_str())) {
-      auto desired_pump_state = ws::pump::read_desired_pump_state(pump_handle);
+      auto desired_pump_state = ws::pump::read_desired_pump_state(pump_sys, pump_handle);
       if (ImGui::InputInt("Address", &desired_pump_state.address)) {
         if (desired_pump_state.address >= 0) {
-          ws::pump::set_address(pump_handle, desired_pump_state.address);
+          ws::pump::set_address(pump_sys, pump_handle, desired_pump_state.address);
         }
       }
       if (ImGui::InputInt("Rate", &desired_pump_state.rate)) {
         if (desired_pump_state.rate >= 0) {
           ws::pump::set_pump_rate(
-            pump_handle, desired_pump_state.rate, desired_pump_state.rate_units);
+            pump_sys, pump_handle, desired_pump_state.rate, desired_pump_state.rate_units);
         }
       }
       if (ImGui::InputFloat("Volume", &desired_pump_state.volume, 0.00f, 0.00f, "%0.4f", enter_flag)) {
         if (desired_pump_state.volume >= 0.000f) {
           ws::pump::set_dispensed_volume(
-            pump_handle, desired_pump_state.volume, desired_pump_state.volume_units);
+            pump_sys, pump_handle, desired_pump_state.volume, desired_pump_state.volume_units);
         }
       }
 
-      auto canonical_pump_state = ws::pump::read_canonical_pump_state(pump_handle);
+      auto canonical_pump_state = ws::pump::read_canonical_pump_state(pump_sys, pump_handle);
       if (canonical_pump_state.connection_open) {
         if (ImGui::Button("Run")) {
-          ws::pump::run_dispense_program(pump_handle);
+          ws::pump::run_dispense_program(pump_sys, pump_handle);
         }
         if (ImGui::Button("Stop")) {
-          ws::pump::stop_dispense_program(pump_handle);
+          ws::pump::stop_dispense_program(pump_sys, pump_handle);
         }
       } else {
         ImGui::Text("Connection is closed.");
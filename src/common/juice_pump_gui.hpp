@@ -6,9 +6,14 @@ namespace ws {
 struct PortDescriptor;
 }
 
+namespace ws::pump {
+struct PumpSystem;
+}
+
 namespace ws::gui {
 
 struct JuicePumpGUIParams {
+  pump::PumpSystem* pump_system;
   const ws::PortDescriptor* serial_ports;
   int num_ports;
   int num_pumps;
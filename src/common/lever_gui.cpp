@@ -1,10 +1,49 @@
 #include "lever_gui.hpp"
 #include "lever_system.hpp"
 #include "serial.hpp"
+#include "channel_gui.hpp"
+#include "serial_stats_gui.hpp"
 #include <imgui.h>
+#include <algorithm>
 
 namespace ws {
 
+namespace {
+
+//  Moving average length of a filter, or 0 if it is not a moving average.
+int num_average_taps(const SignalFilterParams& filter) {
+  return filter.type == SignalFilterType::FIR ? filter.num_taps : 0;
+}
+
+SignalFilterParams make_average_filter(int num_taps) {
+  num_taps = std::min(num_taps, SignalFilterParams::max_num_taps);
+  return num_taps > 1 ? make_moving_average_filter(num_taps) : make_pass_through_filter();
+}
+
+void render_signal_pipeline_gui(lever::LeverSystem* lever_sys, lever::SerialLeverHandle lever) {
+  const auto enter_flag = ImGuiInputTextFlags_EnterReturnsTrue;
+  auto params = ws::lever::get_signal_params(lever_sys, lever);
+  bool modified{};
+
+  int position_taps = num_average_taps(params.position_filter);
+  if (ImGui::InputInt("PositionAverage", &position_taps, 1, 5, enter_flag)) {
+    params.position_filter = make_average_filter(position_taps);
+    modified = true;
+  }
+
+  int force_taps = num_average_taps(params.force_filter);
+  if (ImGui::InputInt("ForceAverage", &force_taps, 1, 5, enter_flag)) {
+    params.force_filter = make_average_filter(force_taps);
+    modified = true;
+  }
+
+  if (modified) {
+    ws::lever::set_signal_params(lever_sys, lever, params);
+  }
+}
+
+} //  anon
+
 gui::LeverGUIResult gui::render_lever_gui(const LeverGUIParams& params) {
   gui::LeverGUIResult result{};
   auto* lever_sys = params.lever_system;
@@ -76,15 +115,38 @@ gui::LeverGUIResult gui::render_lever_gui(const LeverGUIParams& params) {
           //ws::lever::set_force(lever_sys, lever, commanded_force);
       }
 
+      if (ImGui::TreeNode("SignalPipeline")) {
+        render_signal_pipeline_gui(lever_sys, lever);
+        ImGui::TreePop();
+      }
+
+      if (ImGui::TreeNode("SerialStats")) {
+        gui::render_serial_stats(ws::lever::read_serial_stats(lever_sys, lever));
+        ImGui::TreePop();
+      }
+
+      if (ImGui::TreeNode("MessageQueue")) {
+        gui::render_channel_stats(ws::lever::get_channel_stats(lever_sys, lever));
+        ImGui::TreePop();
+      }
+
       if (open) {
         if (ImGui::Button("Terminate serial context")) {
           ws::lever::close_connection(lever_sys, lever);
         }
       }
 
+      if (ImGui::Button("Remove lever")) {
+        result.remove_lever_index = li;
+      }
+
       ImGui::TreePop();
     }
   }
+
+  if (ImGui::Button("Add lever")) {
+    result.add_lever = true;
+  }
   return result;
 }
 
@@ -26,6 +26,8 @@ struct LeverGUIParams {
 struct LeverGUIResult {
    std::optional<int> force_limit0;
    std::optional<int> force_limit1;
+   bool add_lever{};
+   std::optional<int> remove_lever_index;
 };
 
 LeverGUIResult render_lever_gui(const LeverGUIParams& params);
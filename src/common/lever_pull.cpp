@@ -1,4 +1,5 @@
 #include "lever_pull.hpp"
+#include <algorithm>
 
 namespace ws::lever {
 
@@ -30,4 +31,108 @@ namespace ws::lever {
   return result;
 }
 
+namespace {
+
+TimePoint interpolate_crossing(const TimePoint& t0, float p0, const TimePoint& t1, float p1,
+                               float edge) {
+  const float dp = p1 - p0;
+  const double frac = dp == 0.0f ? 1.0 : std::min(1.0, std::max(0.0, double((edge - p0) / dp)));
+  const auto dt = Duration(elapsed_time(t0, t1) * frac);
+  return t0 + std::chrono::duration_cast<TimePoint::duration>(dt);
+}
+
+void push_event(PullEvent* events, int max_num_events, int* num_events, const PullEvent& event) {
+  if (*num_events < max_num_events) {
+    events[(*num_events)++] = event;
+  }
+}
+
+} //  anon
+
+int detect_pulls(PullDetector* detector, const PullSamples& samples,
+                 PullEvent* events, int max_num_events) {
+  const auto& params = detector->params;
+  int num_events{};
+
+  for (int i = 0; i < samples.count; i++) {
+    const float p = samples.position[i];
+    const auto& t = samples.time[i];
+    const bool gap = !detector->has_previous ||
+      (params.max_sample_interval_s > 0.0 &&
+       elapsed_time(detector->previous_time, t) > params.max_sample_interval_s);
+    const float p0 = gap ? p : detector->previous_position;
+    const auto& t0 = gap ? t : detector->previous_time;
+
+    switch (detector->state) {
+      case PullDetectorState::Low: {
+        if (p > params.rising_edge) {
+          detector->crossing_time = interpolate_crossing(t0, p0, t, p, params.rising_edge);
+          detector->crossing_velocity = samples.velocity[i];
+          detector->crossing_after_gap = gap;
+          if (samples.velocity[i] < params.min_pull_velocity) {
+            detector->state = PullDetectorState::RejectedHigh;
+          } else {
+            detector->state = PullDetectorState::PendingHigh;
+          }
+        }
+        break;
+      }
+      case PullDetectorState::PendingHigh: {
+        if (p < params.falling_edge) {
+          //  Bounce: released before the hold elapsed.
+          detector->state = PullDetectorState::Low;
+        }
+        break;
+      }
+      case PullDetectorState::High: {
+        if (p < params.falling_edge) {
+          PullEvent event{};
+          event.released = true;
+          event.time = interpolate_crossing(t0, p0, t, p, params.falling_edge);
+          event.velocity = samples.velocity[i];
+          event.sample_index = i;
+          event.after_gap = gap;
+          push_event(events, max_num_events, &num_events, event);
+          detector->state = PullDetectorState::Low;
+        }
+        break;
+      }
+      case PullDetectorState::RejectedHigh: {
+        if (p < params.falling_edge) {
+          detector->state = PullDetectorState::Low;
+        }
+        break;
+      }
+    }
+
+    if (detector->state == PullDetectorState::PendingHigh &&
+        elapsed_time(detector->crossing_time, t) >= params.min_hold_s) {
+      PullEvent event{};
+      event.pulled = true;
+      event.time = detector->crossing_time;
+      event.velocity = detector->crossing_velocity;
+      event.sample_index = i;
+      event.after_gap = detector->crossing_after_gap;
+      push_event(events, max_num_events, &num_events, event);
+      detector->state = PullDetectorState::High;
+    }
+
+    detector->has_previous = true;
+    detector->previous_position = p;
+    detector->previous_time = t;
+  }
+
+  return num_events;
+}
+
+void mark_sample_gap(PullDetector* detector) {
+  detector->has_previous = false;
+}
+
+void reset_pull_detector(PullDetector* detector) {
+  const auto params = detector->params;
+  *detector = {};
+  detector->params = params;
+}
+
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "time.hpp"
+
 namespace ws::lever {
 
 struct PullDetect {
@@ -19,4 +21,76 @@ struct PullDetectResult {
 
 PullDetectResult detect_pull(PullDetect* pd, const PullDetectParams& params);
 
+/*
+ * PullDetector - Streaming pull detection over timestamped position samples, with the same
+ * rising / falling edge hysteresis as `detect_pull`. Event times are interpolated linearly between
+ * the two samples that straddle the threshold, so they are as accurate as the sample timestamps
+ * rather than the rate at which the detector is polled.
+ *
+ * A pull must cross the rising edge with at least `min_pull_velocity`, and stay above the falling
+ * edge for `min_hold_s`, to count; it is reported with the time of the crossing once the hold has
+ * elapsed. A crossing that is too slow is ignored until the position returns below the falling
+ * edge.
+ *
+ * Crossings are not interpolated across a gap in the samples (see `mark_sample_gap` and
+ * `max_sample_interval_s`): the event is given the time of the first sample after the gap, and
+ * flagged.
+ */
+
+struct PullDetectorParams {
+  float rising_edge;
+  float falling_edge;
+  //  Position units per second; 0 to disable.
+  float min_pull_velocity;
+  double min_hold_s;
+  //  Consecutive samples further apart than this are treated as a gap; 0 to disable.
+  double max_sample_interval_s;
+};
+
+enum class PullDetectorState {
+  Low = 0,
+  PendingHigh,
+  High,
+  RejectedHigh,
+};
+
+struct PullDetector {
+  PullDetectorParams params;
+  PullDetectorState state;
+  TimePoint crossing_time;
+  float crossing_velocity;
+  bool crossing_after_gap;
+  //  False until the first sample, and after a gap.
+  bool has_previous;
+  float previous_position;
+  TimePoint previous_time;
+};
+
+struct PullEvent {
+  bool pulled;
+  bool released;
+  TimePoint time;
+  float velocity;
+  //  Of the sample, in the batch passed to `detect_pulls`, on which the event was detected: the
+  //  first below the falling edge for a release, or the one on which the hold elapsed for a pull.
+  int sample_index;
+  //  The crossing was not interpolated, because the sample before it was lost or too old.
+  bool after_gap;
+};
+
+struct PullSamples {
+  int count;
+  const float* position;
+  const float* velocity;
+  const TimePoint* time;
+};
+
+//  Returns the number of events written to `events`, at most `max_num_events`.
+int detect_pulls(PullDetector* detector, const PullSamples& samples,
+                 PullEvent* events, int max_num_events);
+//  Samples were lost between the last batch and the next one.
+void mark_sample_gap(PullDetector* detector);
+//  Back to the initial state, e.g. for samples from a different lever; keeps `params`.
+void reset_pull_detector(PullDetector* detector);
+
 }
\ No newline at end of file
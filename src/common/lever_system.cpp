@@ -1,8 +1,18 @@
 #include "lever_system.hpp"
+#include "channel.hpp"
+#include "clock_sync.hpp"
+#include "port_registry.hpp"
 #include "ringbuffer.hpp"
-#include "handshake.hpp"
+#include "signal_pipeline.hpp"
+#include "slot_map.hpp"
+#include "trace.hpp"
+#include <algorithm>
 #include <cassert>
+#include <cstdio>
+#include <mutex>
 #include <thread>
+#include <type_traits>
+#include <utility>
 
 namespace ws {
 
@@ -14,8 +24,7 @@ enum class SerialLeverError {
 };
 
 enum class LeverMessageType {
-  SetForce = 0,
-  ShareState,
+  ShareState = 0,
   OpenPort,
   ClosePort,
   PortStatus,
@@ -26,43 +35,109 @@ struct LeverMessageData {
   LeverMessageType type;
   std::optional<LeverState> state;
   std::optional<int> force;
-  std::string port;
+  PortID port;
+  //  For OpenPort.
+  double response_byte_time_us;
   bool is_open;
   SerialLeverError error;
 };
 
+static_assert(std::is_trivially_copyable_v<LeverMessageData>,
+              "Expected LeverMessageData to be trivially copyable.");
+
 struct LeverSystem {
+  static constexpr int max_num_levers = 32;
+  static constexpr int num_workers = 4;
+  //  Outbound (worker -> main thread) messages per lever. The worker sends at most 2 messages per
+  //  lever per pass (~10ms), so this absorbs main thread stalls of a few hundred ms.
+  static constexpr int remote_queue_capacity = 64;
+  //  Open / close commands in flight per lever.
+  static constexpr int port_command_capacity = 8;
+  //  Most recent samples kept per lever for `read_samples`; several seconds at the worker's rate.
+  static constexpr int sample_history_size = 256;
+
   struct RemoteInstance {
+    SerialLeverHandle handle;
     SerialContext serial_context;
     std::optional<LeverState> state;
     std::optional<int> force;
     int commanded_force{};
     bool need_send_state{};
     std::optional<SerialLeverError> open_response;
+    //  Of the open connection; see `open_connection`.
+    Duration response_byte_time{};
+    //  Reset whenever the remote instance is.
+    ClockSync clock_sync{};
+    SignalPipeline signal_pipeline{};
   };
 
   struct LocalInstance {
     SerialLeverHandle handle;
-    std::optional<int> pending_canonical_force;
-    std::optional<std::string> pending_open_port;
-    bool pending_close_port{};
+    //  Most recent open / close command that did not yet fit in `port_commands`.
+    std::optional<LeverMessageData> pending_port_command;
     int commanded_force{};
     std::optional<int> canonical_force;
     std::optional<LeverState> state;
-    Handshake<LeverMessageData> message;
 
     bool awaiting_open{};
     bool is_open{};
+    SignalPipelineParams signal_params{};
+    //  Ring of received samples; sample `i` is at `i % sample_history_size`.
+    std::array<LeverState, sample_history_size> sample_history;
+    uint64_t num_samples{};
   };
 
-  std::thread worker_thread;
-  std::atomic<bool> keep_processing{};
+  //  Per-slot state used by both threads. It outlives the lever bound to the slot, so that the
+  //  worker never has to touch `local_instances`; `handle_id` is 0 while the slot is unused.
+  struct SharedInstance {
+    explicit SharedInstance(int slot) : read_remote{make_channel_name(channel_name, slot)} {
+      //
+    }
 
-  std::vector<std::unique_ptr<LocalInstance>> local_instances;
-  std::vector<std::unique_ptr<RemoteInstance>> remote_instances;
-  RingBuffer<LeverMessageData, 8> read_remote;
+    static const char* make_channel_name(char* dst, int slot) {
+      std::snprintf(dst, sizeof(SharedInstance::channel_name), "lever/read_remote%d", slot);
+      return dst;
+    }
 
-  uint32_t instance_id{1};
+    std::atomic<uint32_t> handle_id{};
+    //  Latest value wins: (handle id << 32) | grams, or 0 if no force command is pending. Tagging
+    //  the force with the handle keeps it from reaching a later occupant of the slot.
+    std::atomic<uint64_t> force_command{};
+    //  Open / close commands, applied in order.
+    RingBuffer<LeverMessageData, port_command_capacity> port_commands;
+    //  Of the lever's current (or most recent) serial connection.
+    SerialStats serial_stats;
+    //  Set by the main thread; the worker picks up changes on its next pass.
+    std::mutex signal_params_mutex;
+    SignalPipelineParams signal_params{};
+    std::atomic<bool> signal_params_changed{};
+    char channel_name[32];
+    SPSCChannel<LeverMessageData, remote_queue_capacity> read_remote;
+  };
+
+  template <std::size_t... Is>
+  static std::array<SharedInstance, sizeof...(Is)>
+  make_shared_instances(std::index_sequence<Is...>) {
+    return {{SharedInstance{int(Is)}...}};
+  }
+
+  //  Serial I/O is blocking, so slots are spread over several worker threads; worker `w` services
+  //  slots `i` with `i % num_workers == w`.
+  std::array<std::thread, num_workers> worker_threads;
+  //  Signaled when a command is sent to one of the worker's levers, so it is applied without
+  //  waiting out the rest of the worker's sleep.
+  std::array<Wakeup, num_workers> worker_wakeups;
+  std::atomic<bool> keep_processing{};
+  //  Held by a worker while it pushes to the sink.
+  std::mutex sample_sink_mutex;
+  std::optional<SampleSink> sample_sink;
+
+  //  Keyed by SerialLeverHandle::id. The shared and remote instances for a handle are stored at
+  //  the same slot index as its local instance.
+  SlotMap<LocalInstance, max_num_levers> local_instances;
+  std::array<SharedInstance, max_num_levers> shared_instances{
+    make_shared_instances(std::make_index_sequence<max_num_levers>{})};
+  std::array<RemoteInstance, max_num_levers> remote_instances;
 };
 
 } //  lever
@@ -76,109 +151,217 @@ struct {
 } globals;
 
 LeverSystem::LocalInstance* find_local_instance(LeverSystem* sys, SerialLeverHandle handle) {
-  for (auto& inst : sys->local_instances) {
-    if (inst->handle == handle) {
-      return inst.get();
-    }
-  }
-  return nullptr;
+  return sys->local_instances.find(handle.id);
 }
 
-LeverMessageData make_set_force_message(int force) {
-  LeverMessageData result{};
-  result.type = LeverMessageType::SetForce;
-  result.force = force;
-  return result;
+LeverSystem::SharedInstance& get_shared_instance(LeverSystem* sys, SerialLeverHandle handle) {
+  return sys->shared_instances[sys->local_instances.index_of(handle.id)];
+}
+
+Wakeup* get_worker_wakeup(LeverSystem* sys, SerialLeverHandle handle) {
+  const int slot = sys->local_instances.index_of(handle.id);
+  return &sys->worker_wakeups[slot % LeverSystem::num_workers];
+}
+
+//  Only while the workers are stopped.
+void reset_shared_instance(LeverSystem::SharedInstance& shared) {
+  shared.handle_id.store(0);
+  shared.force_command.store(0);
+  shared.port_commands.clear();
+  reset(&shared.serial_stats);
+  (void) shared.read_remote.read_all([](const LeverMessageData&) {});
+}
+
+uint64_t make_force_command(SerialLeverHandle handle, int grams) {
+  return (uint64_t(handle.id) << 32) | uint32_t(grams);
 }
 
-LeverMessageData make_open_port_message(std::string&& port) {
+SerialLeverHandle force_command_handle(uint64_t command) {
+  return SerialLeverHandle{uint32_t(command >> 32)};
+}
+
+int force_command_grams(uint64_t command) {
+  return int(uint32_t(command & 0xffffffffu));
+}
+
+//  Clears everything but the bound handle and signal parameters, closing the serial context if
+//  it is open.
+void reset_remote_instance(LeverSystem::RemoteInstance& remote) {
+  auto handle = remote.handle;
+  auto signal_params = remote.signal_pipeline.params;
+  remote = {};
+  remote.handle = handle;
+  set_params(&remote.signal_pipeline, signal_params);
+}
+
+void load_signal_params(LeverSystem::RemoteInstance& remote,
+                        LeverSystem::SharedInstance& shared) {
+  std::lock_guard<std::mutex> lock(shared.signal_params_mutex);
+  set_params(&remote.signal_pipeline, shared.signal_params);
+}
+
+//  A pass reads a single state per lever, so this is a batch of 1; delaying samples to gather
+//  larger batches would add their wait to the lever's latency.
+void derive_signals(LeverSystem::RemoteInstance& remote, LeverState& state) {
+  SignalBatch batch{};
+  batch.count = 1;
+  batch.raw_position = &state.potentiometer_reading;
+  batch.raw_strain = &state.strain_gauge;
+  batch.time = &state.sample_time;
+  batch.position = &state.position;
+  batch.velocity = &state.velocity;
+  batch.force = &state.force;
+  process(&remote.signal_pipeline, batch);
+}
+
+LeverMessageData make_open_port_message(SerialLeverHandle handle, PortID port,
+                                        double response_byte_time_us) {
   LeverMessageData result{};
+  result.handle = handle;
   result.type = LeverMessageType::OpenPort;
-  result.port = std::move(port);
+  result.port = port;
+  result.response_byte_time_us = response_byte_time_us;
   return result;
 }
 
-LeverMessageData make_close_port_message() {
+LeverMessageData make_close_port_message(SerialLeverHandle handle) {
   LeverMessageData result{};
+  result.handle = handle;
   result.type = LeverMessageType::ClosePort;
   return result;
 }
 
-LeverMessageData make_port_status_message(SerialLeverHandle handle,
-                                          SerialLeverError error, bool is_open) {
-  LeverMessageData result{};
-  result.type = LeverMessageType::PortStatus;
-  result.handle = handle;
-  result.error = error;
-  result.is_open = is_open;
-  return result;
+//  Outbound messages are filled in place in a `read_remote` slot, which may hold a previously
+//  read message; every field is assigned.
+void write_port_status_message(LeverMessageData* message, SerialLeverHandle handle,
+                               SerialLeverError error, bool is_open) {
+  message->handle = handle;
+  message->type = LeverMessageType::PortStatus;
+  message->state = std::nullopt;
+  message->force = std::nullopt;
+  message->port = {};
+  message->response_byte_time_us = 0.0;
+  message->is_open = is_open;
+  message->error = error;
 }
 
-LeverMessageData make_share_state_message(const LeverSystem::RemoteInstance& remote,
-                                          SerialLeverHandle handle) {
-  LeverMessageData message{};
-  message.type = LeverMessageType::ShareState;
-  message.force = remote.force;
-  message.state = remote.state;
-  message.handle = handle;
-  message.is_open = is_open(remote.serial_context);
-  return message;
+void write_share_state_message(LeverMessageData* message,
+                               const LeverSystem::RemoteInstance& remote,
+                               SerialLeverHandle handle) {
+  message->handle = handle;
+  message->type = LeverMessageType::ShareState;
+  message->state = remote.state;
+  message->force = remote.force;
+  message->port = {};
+  message->response_byte_time_us = 0.0;
+  message->is_open = is_open(remote.serial_context);
+  message->error = SerialLeverError::None;
 }
 
-bool process_remote_message(LeverSystem::RemoteInstance& remote, LeverMessageData&& data) {
+void process_port_command(LeverSystem::RemoteInstance& remote, LeverSystem::SharedInstance& shared,
+                          const LeverMessageData& data) {
   switch (data.type) {
-    case LeverMessageType::SetForce: {
-      remote.commanded_force = data.force.value();
-      return false;
-    }
-
     case LeverMessageType::OpenPort: {
       assert(!remote.open_response);
-      remote = {};
+      reset_remote_instance(remote);
       auto serial_res = ws::make_context(
-        data.port, ws::default_baud_rate(), ws::default_read_write_timeout());
+        port_name(data.port), ws::default_baud_rate(), ws::default_read_write_timeout());
 #if 0
       std::this_thread::sleep_for(std::chrono::seconds(1));
       remote.open_response = SerialLeverError::FailedToOpen;
 #else
       if (serial_res) {
         remote.serial_context = std::move(serial_res.value());
+        reset(&shared.serial_stats);
+        remote.serial_context.stats = &shared.serial_stats;
+        remote.response_byte_time = Duration(data.response_byte_time_us * 1e-6);
         remote.open_response = SerialLeverError::None;
       } else {
         remote.open_response = SerialLeverError::FailedToOpen;
       }
 #endif
-      return true;
+      break;
     }
 
     case LeverMessageType::ClosePort: {
-      remote = {};
-      return true;
+      reset_remote_instance(remote);
+      break;
     }
 
     default: {
       assert(false);
-      return false;
     }
   }
+  remote.need_send_state = true;
 }
 
-void process_remote_instance(LeverSystem* system, LeverSystem::RemoteInstance& remote,
-                             LeverSystem::LocalInstance& local) {
-  if (auto data = read(&local.message)) {
-    if (process_remote_message(remote, std::move(data.value()))) {
-      remote.need_send_state = true;
-    }
+bool send_port_status(LeverSystem::RemoteInstance& remote, LeverSystem::SharedInstance& shared) {
+  if (auto* message = shared.read_remote.prepare_write()) {
+    const bool open = is_open(remote.serial_context);
+    write_port_status_message(message, remote.handle, remote.open_response.value(), open);
+    shared.read_remote.commit_write();
+    remote.open_response = std::nullopt;
+    return true;
+  } else {
+    return false;
   }
+}
 
-  const bool open = is_open(remote.serial_context);
-  if (remote.open_response) {
-    auto message = make_port_status_message(local.handle, remote.open_response.value(), open);
-    if (system->read_remote.maybe_write(message)) {
-      remote.open_response = std::nullopt;
+//  Map the state's device time onto host time. The device samples as soon as the request arrives,
+//  so the time taken to transmit the response, if the connection's is known, is excluded from the
+//  round trip.
+void timestamp_state(LeverSystem::RemoteInstance& remote, const StateRoundTrip& round_trip,
+                     LeverState& state) {
+  const auto transfer = std::chrono::duration_cast<TimePoint::duration>(
+    remote.response_byte_time * double(round_trip.response_size));
+  const auto received = std::max(round_trip.sent, round_trip.received - transfer);
+
+  state.device_time_us = add_round_trip(
+    &remote.clock_sync, round_trip.sent, received, uint32_t(state.device_time_us));
+  if (auto t = to_host_time(remote.clock_sync, state.device_time_us)) {
+    state.sample_time = t.value();
+  }
+}
+
+//  If the main thread falls behind and `read_remote` fills, the pending status / state stays
+//  flagged and is sent on a later pass, so only intermediate states are lost; each failed attempt
+//  is counted as a drop on the lever's channel. Returns true if a new state was read.
+bool process_remote_instance(LeverSystem::RemoteInstance& remote,
+                             LeverSystem::SharedInstance& shared) {
+  //  Apply every pending port command in order. Each open's status is sent before the next
+  //  command is applied; if it does not fit, the remaining commands wait for the next pass.
+  while (!remote.open_response || send_port_status(remote, shared)) {
+    auto* command = shared.port_commands.peek_read();
+    if (!command) {
+      break;
+    }
+    if (command->handle != remote.handle &&
+        command->handle.id == shared.handle_id.load(std::memory_order_acquire)) {
+      //  For a lever bound to the slot since this pass began; applied once the next pass binds it.
+      break;
     }
+    //  Ignore commands sent to a lever that previously occupied this slot.
+    if (command->handle == remote.handle) {
+      process_port_command(remote, shared, *command);
+    }
+    shared.port_commands.release_read();
+  }
+
+  if (shared.signal_params_changed.exchange(false)) {
+    load_signal_params(remote, shared);
+  }
+
+  //  Only take a command tagged for this remote's lever. One for a lever bound to the slot since
+  //  this pass began is left for the next pass; a stale one is harmless and is overwritten by the
+  //  next `set_force`. If the exchange fails, a newer command arrived and is read next pass.
+  uint64_t force_command = shared.force_command.load(std::memory_order_acquire);
+  if (force_command != 0 && force_command_handle(force_command) == remote.handle &&
+      shared.force_command.compare_exchange_strong(force_command, 0, std::memory_order_acq_rel)) {
+    remote.commanded_force = force_command_grams(force_command);
   }
 
+  bool read_new_state{};
+  const bool open = is_open(remote.serial_context);
   if (open) {
     remote.need_send_state = true;
 
@@ -188,114 +371,215 @@ void process_remote_instance(LeverSystem* system, LeverSystem::RemoteInstance& r
       remote.force = std::nullopt;
     }
 
-    if (auto state = ws::read_state(remote.serial_context)) {
+    StateRoundTrip round_trip{};
+    if (auto state = ws::read_state(remote.serial_context, &round_trip)) {
       remote.state = state.value();
+      if (remote.state.value().has_device_time) {
+        timestamp_state(remote, round_trip, remote.state.value());
+      }
+      derive_signals(remote, remote.state.value());
+      read_new_state = true;
     } else {
       remote.state = std::nullopt;
     }
   }
 
   if (remote.need_send_state) {
-    auto message = make_share_state_message(remote, local.handle);
-    if (system->read_remote.maybe_write(message)) {
+    if (auto* message = shared.read_remote.prepare_write()) {
+      write_share_state_message(message, remote, remote.handle);
+      shared.read_remote.commit_write();
       remote.need_send_state = false;
     }
   }
+  return read_new_state;
+}
+
+void push_to_sample_sink(LeverSystem* system, SerialLeverHandle handle, const LeverState& state) {
+  std::lock_guard<std::mutex> lock(system->sample_sink_mutex);
+  if (auto& sink = system->sample_sink) {
+    sink.value().push(sink.value().context, handle, state);
+  }
+}
+
+void worker_pass(LeverSystem* system, int worker_index) {
+  WS_TRACE_ZONE("lever/worker_pass");
+  for (int i = worker_index; i < LeverSystem::max_num_levers; i += LeverSystem::num_workers) {
+    auto& shared = system->shared_instances[i];
+    auto& remote = system->remote_instances[i];
+
+    const SerialLeverHandle handle{shared.handle_id.load(std::memory_order_acquire)};
+    if (handle != remote.handle) {
+      //  Lever added to, removed from or replaced in this slot since the last pass.
+      remote = {};
+      remote.handle = handle;
+      reset(&shared.serial_stats);
+      load_signal_params(remote, shared);
+    }
+
+    if (handle.id != 0) {
+      WS_TRACE_ZONE("lever/process_instance");
+      if (process_remote_instance(remote, shared)) {
+        push_to_sample_sink(system, remote.handle, remote.state.value());
+      }
+    }
+  }
 }
 
-void worker(LeverSystem* system) {
+void worker(LeverSystem* system, int worker_index) {
+  char thread_name[32];
+  std::snprintf(thread_name, sizeof(thread_name), "lever worker %d", worker_index);
+  trace::set_thread_name(thread_name);
+
   while (system->keep_processing.load()) {
-    for (int i = 0; i < int(system->remote_instances.size()); i++) {
-      process_remote_instance(
-        system, *system->remote_instances[i], *system->local_instances[i]);
+    worker_pass(system, worker_index);
+    (void) wait_for(&system->worker_wakeups[worker_index], std::chrono::milliseconds(10));
+  }
+}
+
+//  The state is re-sent after port commands, so skip repeats of the latest sample.
+void push_sample(LeverSystem::LocalInstance* inst, const LeverState& state) {
+  constexpr auto history_size = uint64_t(LeverSystem::sample_history_size);
+  if (inst->num_samples > 0) {
+    auto& latest = inst->sample_history[(inst->num_samples - 1) % history_size];
+    if (latest.sample_time == state.sample_time) {
+      return;
     }
+  }
+  inst->sample_history[inst->num_samples % history_size] = state;
+  inst->num_samples++;
+}
+
+void read_remote_messages(LeverSystem* system, LeverSystem::SharedInstance& shared) {
+  while (auto* message = shared.read_remote.peek_read()) {
+    const auto& response = *message;
+    if (response.type == LeverMessageType::ShareState) {
+      if (auto* inst = find_local_instance(system, response.handle)) {
+        inst->canonical_force = response.force;
+        inst->state = response.state;
+        inst->is_open = response.is_open;
+        if (response.state) {
+          push_sample(inst, response.state.value());
+        }
+      }
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    } else if (response.type == LeverMessageType::PortStatus) {
+      if (auto* inst = find_local_instance(system, response.handle)) {
+        assert(inst->awaiting_open);
+        inst->awaiting_open = false;
+        inst->is_open = response.is_open;
+      }
+    }
+    shared.read_remote.release_read();
   }
 }
 
-std::unique_ptr<LeverSystem::LocalInstance> make_local_instance(SerialLeverHandle handle) {
-  auto result = std::make_unique<LeverSystem::LocalInstance>();
-  result->handle = handle;
-  return result;
+void flush_port_command(LeverSystem* system, LeverSystem::LocalInstance* inst) {
+  auto& shared = get_shared_instance(system, inst->handle);
+  if (inst->pending_port_command &&
+      shared.port_commands.maybe_write(inst->pending_port_command.value())) {
+    inst->pending_port_command = std::nullopt;
+    notify(get_worker_wakeup(system, inst->handle));
+  }
 }
 
-std::unique_ptr<LeverSystem::RemoteInstance> make_remote_instance() {
-  return std::make_unique<LeverSystem::RemoteInstance>();
+//  If the queue is full, the command is kept and retried from `update`. A later command replaces
+//  it, since only the last of a run of opens / closes matters.
+void send_port_command(LeverSystem* system, LeverSystem::LocalInstance* inst,
+                       const LeverMessageData& command) {
+  if (inst->pending_port_command &&
+      inst->pending_port_command.value().type == LeverMessageType::OpenPort) {
+    //  The replaced open will not be answered.
+    inst->awaiting_open = false;
+  }
+  inst->pending_port_command = command;
+  flush_port_command(system, inst);
 }
 
 } //  anon
 
 void lever::initialize(LeverSystem* sys, int max_num_levers, SerialLeverHandle* levers) {
+  assert(max_num_levers <= LeverSystem::max_num_levers);
   for (int i = 0; i < max_num_levers; i++) {
-    SerialLeverHandle handle{sys->instance_id++};
-    sys->local_instances.emplace_back() = make_local_instance(handle);
-    sys->remote_instances.emplace_back() = make_remote_instance();
-    levers[i] = handle;
+    auto handle = add_lever(sys);
+    assert(handle);
+    levers[i] = handle.value();
   }
 
   sys->keep_processing.store(true);
-  sys->worker_thread = std::thread{[sys]() {
-    worker(sys);
-  }};
+  for (int i = 0; i < LeverSystem::num_workers; i++) {
+    sys->worker_threads[i] = std::thread{[sys, i]() {
+      worker(sys, i);
+    }};
+  }
 }
 
 void lever::terminate(LeverSystem* sys) {
   sys->keep_processing.store(false);
-  if (sys->worker_thread.joinable()) {
-    sys->worker_thread.join();
+  for (auto& wakeup : sys->worker_wakeups) {
+    notify(&wakeup);
+  }
+  for (auto& thread : sys->worker_threads) {
+    if (thread.joinable()) {
+      thread.join();
+    }
   }
   sys->local_instances.clear();
-  sys->remote_instances.clear();
+  for (auto& shared : sys->shared_instances) {
+    reset_shared_instance(shared);
+  }
+  for (auto& remote : sys->remote_instances) {
+    remote = {};
+  }
 }
 
-void lever::update(LeverSystem* system) {
-  for (auto& inst : system->local_instances) {
-    if (inst->message.awaiting_read) {
-      (void) acknowledged(&inst->message);
-    }
+std::optional<SerialLeverHandle> lever::add_lever(LeverSystem* sys) {
+  auto key = sys->local_instances.insert();
+  if (!key) {
+    return std::nullopt;
+  }
 
-    if (inst->pending_open_port && !inst->message.awaiting_read) {
-      auto data = make_open_port_message(std::move(inst->pending_open_port.value()));
-      publish(&inst->message, std::move(data));
-      inst->pending_open_port = std::nullopt;
-    }
+  SerialLeverHandle handle{key.value()};
+  auto* inst = find_local_instance(sys, handle);
+  inst->handle = handle;
+  inst->signal_params = make_default_signal_pipeline_params();
 
-    if (inst->pending_close_port && !inst->message.awaiting_read) {
-      publish(&inst->message, make_close_port_message());
-      inst->pending_close_port = false;
-    }
+  auto& shared = get_shared_instance(sys, handle);
+  {
+    std::lock_guard<std::mutex> lock(shared.signal_params_mutex);
+    shared.signal_params = inst->signal_params;
+  }
+  shared.handle_id.store(handle.id, std::memory_order_release);
+  return handle;
+}
 
-    if (inst->pending_canonical_force && !inst->message.awaiting_read) {
-      auto data = make_set_force_message(inst->pending_canonical_force.value());
-      publish(&inst->message, std::move(data));
-      inst->pending_canonical_force = std::nullopt;
-    }
+void lever::remove_lever(LeverSystem* sys, SerialLeverHandle handle) {
+  if (find_local_instance(sys, handle)) {
+    //  The worker closes the lever's port once it sees the slot released.
+    get_shared_instance(sys, handle).handle_id.store(0, std::memory_order_release);
+    sys->local_instances.erase(handle.id);
+  } else {
+    assert(false);
   }
+}
 
-  const int num_read = system->read_remote.size();
-  for (int i = 0; i < num_read; i++) {
-    auto response = system->read_remote.read();
-    if (response.type == LeverMessageType::ShareState) {
-      if (auto* inst = find_local_instance(system, response.handle)) {
-        inst->canonical_force = response.force;
-        inst->state = response.state;
-        inst->is_open = response.is_open;
-      }
+int lever::num_levers(LeverSystem* sys) {
+  return sys->local_instances.size();
+}
 
-    } else if (response.type == LeverMessageType::PortStatus) {
-      if (auto* inst = find_local_instance(system, response.handle)) {
-        assert(inst->awaiting_open);
-        inst->awaiting_open = false;
-        inst->is_open = response.is_open;
-      }
-    }
+void lever::update(LeverSystem* system) {
+  for (int i = 0; i < system->local_instances.size(); i++) {
+    auto* inst = &system->local_instances.at(i);
+    auto& shared = get_shared_instance(system, inst->handle);
+    flush_port_command(system, inst);
+    read_remote_messages(system, shared);
   }
 }
 
 void lever::set_force(LeverSystem* system, SerialLeverHandle instance, int grams) {
   if (auto* inst = find_local_instance(system, instance)) {
-    inst->pending_canonical_force = grams;
+    auto& shared = get_shared_instance(system, instance);
+    shared.force_command.store(make_force_command(instance, grams), std::memory_order_release);
+    notify(get_worker_wakeup(system, instance));
     inst->commanded_force = grams;
   } else {
     assert(false);
@@ -303,9 +587,10 @@ void lever::set_force(LeverSystem* system, SerialLeverHandle instance, int grams
 }
 
 void lever::open_connection(LeverSystem* system, SerialLeverHandle handle,
-                            const std::string& port) {
+                            const std::string& port, double response_byte_time_us) {
   if (auto* inst = find_local_instance(system, handle)) {
-    inst->pending_open_port = port;
+    const auto command = make_open_port_message(handle, intern_port(port), response_byte_time_us);
+    send_port_command(system, inst, command);
     inst->awaiting_open = true;
   } else {
     assert(false);
@@ -332,7 +617,7 @@ bool lever::is_open(LeverSystem* system, SerialLeverHandle handle) {
 
 void lever::close_connection(LeverSystem* system, SerialLeverHandle handle) {
   if (auto* inst = find_local_instance(system, handle)) {
-    inst->pending_close_port = true;
+    send_port_command(system, inst, make_close_port_message(handle));
   } else {
     assert(false);
   }
@@ -366,7 +651,86 @@ std::optional<LeverState> lever::get_state(LeverSystem* system, SerialLeverHandl
 }
 
 int lever::num_remote_commands(LeverSystem* sys) {
-  return sys->read_remote.size();
+  int result{};
+  for (auto& shared : sys->shared_instances) {
+    result += shared.read_remote.size();
+  }
+  return result;
+}
+
+ChannelStats lever::get_channel_stats(LeverSystem* system, SerialLeverHandle handle) {
+  if (find_local_instance(system, handle)) {
+    return get_shared_instance(system, handle).read_remote.stats();
+  } else {
+    assert(false);
+    return {};
+  }
+}
+
+int lever::read_samples(LeverSystem* system, SerialLeverHandle handle, uint64_t* cursor,
+                         LeverState* dst, int max_num_samples) {
+  auto* inst = find_local_instance(system, handle);
+  if (!inst) {
+    assert(false);
+    return 0;
+  }
+
+  constexpr auto history_size = uint64_t(LeverSystem::sample_history_size);
+  const uint64_t oldest = inst->num_samples > history_size ? inst->num_samples - history_size : 0;
+  uint64_t begin = std::max(*cursor, oldest);
+  int count{};
+  while (begin < inst->num_samples && count < max_num_samples) {
+    dst[count++] = inst->sample_history[begin++ % history_size];
+  }
+  *cursor = begin;
+  return count;
+}
+
+void lever::set_signal_params(LeverSystem* system, SerialLeverHandle handle,
+                              const SignalPipelineParams& params) {
+  if (auto* inst = find_local_instance(system, handle)) {
+    inst->signal_params = params;
+    auto& shared = get_shared_instance(system, handle);
+    {
+      std::lock_guard<std::mutex> lock(shared.signal_params_mutex);
+      shared.signal_params = params;
+    }
+    shared.signal_params_changed.store(true);
+  } else {
+    assert(false);
+  }
+}
+
+SignalPipelineParams lever::get_signal_params(LeverSystem* system, SerialLeverHandle handle) {
+  if (auto* inst = find_local_instance(system, handle)) {
+    return inst->signal_params;
+  } else {
+    assert(false);
+    return make_default_signal_pipeline_params();
+  }
+}
+
+SerialStatsSnapshot lever::read_serial_stats(LeverSystem* system, SerialLeverHandle handle) {
+  if (find_local_instance(system, handle)) {
+    return ws::read_serial_stats(get_shared_instance(system, handle).serial_stats);
+  } else {
+    assert(false);
+    return {};
+  }
+}
+
+void lever::set_sample_sink(LeverSystem* system, std::optional<SampleSink> sink) {
+  std::lock_guard<std::mutex> lock(system->sample_sink_mutex);
+  system->sample_sink = sink;
+}
+
+LeverSystem* lever::create_lever_system() {
+  return new LeverSystem();
+}
+
+void lever::destroy_lever_system(LeverSystem* sys) {
+  terminate(sys);
+  delete sys;
 }
 
 LeverSystem* lever::get_global_lever_system() {
@@ -2,6 +2,8 @@
 
 #include "serial_lever.hpp"
 #include "identifier.hpp"
+#include "channel.hpp"
+#include "signal_pipeline.hpp"
 #include <vector>
 
 namespace ws::lever {
@@ -17,11 +19,28 @@ void initialize(LeverSystem* sys, int max_num_levers, SerialLeverHandle* levers)
 void update(LeverSystem* system);
 void terminate(LeverSystem* sys);
 
+//  Levers can be added and removed at any time after `initialize`. Returns nullopt if the system
+//  is at capacity. Removing a lever closes its port.
+std::optional<SerialLeverHandle> add_lever(LeverSystem* sys);
+void remove_lever(LeverSystem* sys, SerialLeverHandle handle);
+int num_levers(LeverSystem* sys);
+
 int num_remote_commands(LeverSystem* sys);
+
+//  Systems are independent of each other, each with its own worker threads; a rig's task uses its
+//  own. The global system is the one driven by the app's GUI.
+LeverSystem* create_lever_system();
+//  Terminates the system first.
+void destroy_lever_system(LeverSystem* sys);
 LeverSystem* get_global_lever_system();
 
 void set_force(LeverSystem* system, SerialLeverHandle instance, int grams);
-void open_connection(LeverSystem* system, SerialLeverHandle handle, const std::string& port);
+//  `response_byte_time_us` is the time taken to transmit one byte of the lever's responses, which
+//  is excluded from state round trips when syncing with the lever's clock. It is 0 for USB serial
+//  (CDC) connections such as the Teensy's, where the baud rate does not limit the transfer; a
+//  9600-baud UART would take ~1042.
+void open_connection(LeverSystem* system, SerialLeverHandle handle, const std::string& port,
+                     double response_byte_time_us = 0.0);
 bool is_pending_open(LeverSystem* system, SerialLeverHandle handle);
 bool is_open(LeverSystem* system, SerialLeverHandle handle);
 void close_connection(LeverSystem* system, SerialLeverHandle handle);
@@ -29,5 +48,31 @@ void close_connection(LeverSystem* system, SerialLeverHandle handle);
 std::optional<int> get_canonical_force(LeverSystem* system, SerialLeverHandle instance);
 int get_commanded_force(LeverSystem* system, SerialLeverHandle instance);
 std::optional<LeverState> get_state(LeverSystem* system, SerialLeverHandle instance);
+//  Copy samples received since `*cursor` (start at 0) into `dst`, oldest first, and advance
+//  `*cursor` past them. Samples older than the retained history are skipped. Each reader keeps its
+//  own cursor.
+int read_samples(LeverSystem* system, SerialLeverHandle handle, uint64_t* cursor,
+                 LeverState* dst, int max_num_samples);
+//  Depth and drop counts of the lever's outbound (worker -> main thread) message queue.
+ChannelStats get_channel_stats(LeverSystem* system, SerialLeverHandle handle);
+
+//  Receives each sample on the worker thread that read it, before it is queued for `update`, so
+//  that it sees every sample even while the thread calling `update` is blocked. `push` must not
+//  block.
+struct SampleSink {
+  void (*push)(void* context, SerialLeverHandle handle, const LeverState& state);
+  void* context;
+};
+
+//  Replaces the system's sink; nullopt removes it. Once this returns, no worker is still using
+//  the previous sink.
+void set_sample_sink(LeverSystem* system, std::optional<SampleSink> sink);
+SerialStatsSnapshot read_serial_stats(LeverSystem* system, SerialLeverHandle handle);
+
+//  Filtering and calibration applied to the lever's samples on the I/O thread; takes effect within
+//  one worker pass, and resets the filters.
+void set_signal_params(LeverSystem* system, SerialLeverHandle handle,
+                       const SignalPipelineParams& params);
+SignalPipelineParams get_signal_params(LeverSystem* system, SerialLeverHandle handle);
 
 }
\ No newline at end of file
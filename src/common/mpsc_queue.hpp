@@ -0,0 +1,123 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace ws {
+
+/*
+ * MPSCQueue - A bounded, non-locking queue that is thread-safe for any number of writers and 1
+ * reader, with space for N elements. N must be a power of two. Each slot carries a sequence
+ * number, so writers claim slots with a single fetch on the write index and never wait on each
+ * other; if the queue is full, `maybe_write` fails without blocking.
+ */
+
+template <typename T, int N>
+class MPSCQueue {
+  static_assert(N > 1 && (N & (N - 1)) == 0, "Expected N to be a power of two.");
+
+  static constexpr uint32_t mask = uint32_t(N - 1);
+
+  struct Slot {
+    std::atomic<uint32_t> sequence;
+    T data;
+  };
+
+public:
+  MPSCQueue();
+
+  //  by writers
+  template <typename U = T>
+  bool maybe_write(U&& element) noexcept;
+
+  //  by reader
+  bool maybe_read(T* element) noexcept;
+  void clear() noexcept;
+
+  //  Approximate number of elements written and pending read; exact when called by the reader
+  //  while no writes are in progress.
+  int size() const noexcept;
+  bool full() const noexcept;
+
+  int write_capacity() const noexcept {
+    return N;
+  }
+
+private:
+  std::array<Slot, N> slots;
+
+  std::atomic<uint32_t> wp{0};
+  std::atomic<uint32_t> rp{0};
+};
+
+/*
+ * Impl
+ */
+
+template <typename T, int N>
+MPSCQueue<T, N>::MPSCQueue() {
+  for (uint32_t i = 0; i < uint32_t(N); i++) {
+    slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+template <typename T, int N>
+template <typename U>
+bool MPSCQueue<T, N>::maybe_write(U&& element) noexcept {
+  auto w = wp.load(std::memory_order_relaxed);
+  while (true) {
+    auto& slot = slots[w & mask];
+    const auto seq = slot.sequence.load(std::memory_order_acquire);
+    const auto diff = int32_t(seq - w);
+    if (diff == 0) {
+      if (wp.compare_exchange_weak(w, w + 1, std::memory_order_relaxed)) {
+        slot.data = std::forward<U>(element);
+        slot.sequence.store(w + 1, std::memory_order_release);
+        return true;
+      }
+    } else if (diff < 0) {
+      //  The reader has not yet released this slot; the queue is full.
+      return false;
+    } else {
+      w = wp.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+template <typename T, int N>
+bool MPSCQueue<T, N>::maybe_read(T* element) noexcept {
+  const auto r = rp.load(std::memory_order_relaxed);
+  auto& slot = slots[r & mask];
+  if (slot.sequence.load(std::memory_order_acquire) != r + 1) {
+    return false;
+  }
+
+  *element = std::move(slot.data);
+  slot.sequence.store(r + uint32_t(N), std::memory_order_release);
+  rp.store(r + 1, std::memory_order_release);
+  return true;
+}
+
+template <typename T, int N>
+void MPSCQueue<T, N>::clear() noexcept {
+  T ignore;
+  while (maybe_read(&ignore)) {
+    //
+  }
+}
+
+template <typename T, int N>
+int MPSCQueue<T, N>::size() const noexcept {
+  const auto r = rp.load(std::memory_order_acquire);
+  const auto w = wp.load(std::memory_order_acquire);
+  const auto diff = int32_t(w - r);
+  return diff < 0 ? 0 : diff > N ? N : int(diff);
+}
+
+template <typename T, int N>
+bool MPSCQueue<T, N>::full() const noexcept {
+  return size() == N;
+}
+
+}
@@ -0,0 +1,80 @@
+#include "port_discovery.hpp"
+#include "channel.hpp"
+#include <atomic>
+#include <cassert>
+#include <mutex>
+#include <thread>
+
+namespace ws {
+
+namespace {
+
+struct {
+  std::thread thread;
+  std::atomic<bool> keep_processing{};
+  Wakeup wakeup;
+
+  std::mutex mutex;
+  std::vector<PortDescriptor> ports;
+  uint64_t version{};
+} globals;
+
+bool same_ports(const std::vector<PortDescriptor>& a, const std::vector<PortDescriptor>& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].port != b[i].port || a[i].description != b[i].description) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void worker(double rescan_interval_s) {
+  const auto interval = std::chrono::duration<double>(rescan_interval_s);
+  while (globals.keep_processing.load()) {
+    auto ports = enumerate_ports();
+    {
+      std::lock_guard<std::mutex> lock(globals.mutex);
+      if (globals.version == 0 || !same_ports(ports, globals.ports)) {
+        globals.ports = std::move(ports);
+        globals.version++;
+      }
+    }
+    (void) wait_for(&globals.wakeup, interval);
+  }
+}
+
+} //  anon
+
+void start_port_discovery(double rescan_interval_s) {
+  assert(!globals.thread.joinable());
+  globals.keep_processing.store(true);
+  globals.thread = std::thread{[rescan_interval_s]() {
+    worker(rescan_interval_s);
+  }};
+}
+
+void stop_port_discovery() {
+  globals.keep_processing.store(false);
+  notify(&globals.wakeup);
+  if (globals.thread.joinable()) {
+    globals.thread.join();
+  }
+}
+
+void request_port_rescan() {
+  notify(&globals.wakeup);
+}
+
+std::optional<std::vector<PortDescriptor>> read_discovered_ports(uint64_t* version) {
+  std::lock_guard<std::mutex> lock(globals.mutex);
+  if (globals.version == *version) {
+    return std::nullopt;
+  }
+  *version = globals.version;
+  return globals.ports;
+}
+
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "serial.hpp"
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace ws {
+
+/*
+ * Port discovery - Rescans the available serial ports on a background thread, so that neither
+ * startup nor the frame loop blocks on `enumerate_ports`.
+ */
+
+void start_port_discovery(double rescan_interval_s);
+void stop_port_discovery();
+//  Rescan as soon as possible rather than waiting for the next interval.
+void request_port_rescan();
+
+//  The most recently discovered ports, if they changed since the version in `*version` was
+//  observed; `*version` is then updated. Start with `*version` = 0.
+std::optional<std::vector<PortDescriptor>> read_discovered_ports(uint64_t* version);
+
+}
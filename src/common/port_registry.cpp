@@ -0,0 +1,43 @@
+#include "port_registry.hpp"
+#include <cassert>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+namespace ws {
+
+namespace {
+
+struct {
+  std::mutex mutex;
+  //  Indexed by id - 1; a deque keeps references to existing names valid as new ones are added.
+  std::deque<std::string> names;
+  std::unordered_map<std::string, uint32_t> ids;
+} globals;
+
+const std::string empty_port_name;
+
+} //  anon
+
+PortID intern_port(const std::string& port) {
+  std::lock_guard<std::mutex> lock(globals.mutex);
+  if (auto it = globals.ids.find(port); it != globals.ids.end()) {
+    return PortID{it->second};
+  }
+
+  globals.names.push_back(port);
+  auto id = uint32_t(globals.names.size());
+  globals.ids[port] = id;
+  return PortID{id};
+}
+
+const std::string& port_name(PortID port) {
+  std::lock_guard<std::mutex> lock(globals.mutex);
+  if (port.id == 0 || port.id > uint32_t(globals.names.size())) {
+    assert(port.id == 0);
+    return empty_port_name;
+  }
+  return globals.names[port.id - 1];
+}
+
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "identifier.hpp"
+#include <cstdint>
+#include <string>
+
+namespace ws {
+
+/*
+ * Port registry - Interns serial port names as small integer ids, so that messages referring to
+ * a port can stay trivially copyable. Ids are never released; id 0 refers to no port.
+ */
+
+struct PortID {
+  WS_INTEGER_IDENTIFIER_EQUALITY(PortID, id)
+  uint32_t id;
+};
+
+//  Thread-safe. Returns the existing id if `port` has been interned before.
+PortID intern_port(const std::string& port);
+//  Thread-safe. The returned reference remains valid for the lifetime of the program.
+const std::string& port_name(PortID port);
+
+}
@@ -3,40 +3,50 @@
 
 namespace ws {
 
-class Random {
-public:
-  Random();
-  double operator()();
-  void set_seed(uint32_t seed);
+namespace {
 
-private:
+RandomStream make_global_random_stream() {
   std::random_device device;
-  std::mt19937 generator;
-  std::uniform_real_distribution<> distribution;
-};
+  const uint64_t seed = (uint64_t(device()) << 32) | device();
+  return make_random_stream(seed, 0);
+}
+
+thread_local RandomStream global_random_stream = make_global_random_stream();
 
-thread_local Random global_random_stream;
+} //  anon
 
-Random::Random() :
-  generator(device()),
-  distribution(0.0, 1.0) {
-  //
+double urand() {
+  return random_double(&global_random_stream);
 }
 
-double Random::operator()() {
-  return distribution(generator);
+void seed_urand(unsigned int seed) {
+  global_random_stream = make_random_stream(seed, 0);
 }
 
-void Random::set_seed(uint32_t seed) {
-  generator.seed(seed);
+//  Each element depends only on the stream key and its index, so these loops have no carried
+//  dependency and vectorize.
+void fill_random_u64(RandomStream* stream, uint64_t* dst, int count) {
+  const RandomStream s = *stream;
+  for (int i = 0; i < count; i++) {
+    dst[i] = random_u64_at(s, s.counter + uint64_t(i));
+  }
+  stream->counter += uint64_t(count);
 }
 
-double urand() {
-  return global_random_stream();
+void fill_random_double(RandomStream* stream, double* dst, int count) {
+  const RandomStream s = *stream;
+  for (int i = 0; i < count; i++) {
+    dst[i] = to_unit_double(random_u64_at(s, s.counter + uint64_t(i)));
+  }
+  stream->counter += uint64_t(count);
 }
 
-void seed_urand(unsigned int seed) {
-  global_random_stream.set_seed(seed);
+void fill_random_int(RandomStream* stream, int n, int* dst, int count) {
+  const RandomStream s = *stream;
+  for (int i = 0; i < count; i++) {
+    dst[i] = int(((random_u64_at(s, s.counter + uint64_t(i)) >> 32) * uint64_t(n)) >> 32);
+  }
+  stream->counter += uint64_t(count);
 }
 
-}
\ No newline at end of file
+}
@@ -1,8 +1,74 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
+
 namespace ws {
 
 double urand();
 void seed_urand(unsigned int seed);
 
-}
\ No newline at end of file
+/*
+ * RandomStream - A counter-based generator: the i-th value of a stream is a pure function of the
+ * stream's key and i (the SplitMix64 finalizer applied to key + i * golden ratio), so a stream
+ * carries no generator state beyond its counter. Streams are keyed by (seed, stream id), e.g. a
+ * session seed and a trial number, so that any trial's values can be reproduced on their own, on
+ * any thread, without replaying the draws that came before. Bulk fills have no dependency between
+ * elements and vectorize.
+ *
+ * Not cryptographically secure.
+ */
+
+struct RandomStream {
+  uint64_t key;
+  uint64_t counter;
+};
+
+inline uint64_t splitmix64_mix(uint64_t x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+namespace detail {
+  constexpr uint64_t splitmix64_gamma = 0x9e3779b97f4a7c15ull;
+}
+
+inline RandomStream make_random_stream(uint64_t seed, uint64_t stream_id) {
+  RandomStream result{};
+  result.key = splitmix64_mix(seed ^ splitmix64_mix(stream_id + detail::splitmix64_gamma));
+  return result;
+}
+
+//  The `i`-th value of the stream, independent of its counter.
+inline uint64_t random_u64_at(const RandomStream& stream, uint64_t i) {
+  return splitmix64_mix(stream.key + (i + 1) * detail::splitmix64_gamma);
+}
+
+inline uint64_t random_u64(RandomStream* stream) {
+  return random_u64_at(*stream, stream->counter++);
+}
+
+//  Uniform in [0, 1), with 52 bits of precision: the top bits of `bits` become the mantissa of a
+//  double in [1, 2). Unlike an integer to double conversion, this vectorizes without AVX-512.
+inline double to_unit_double(uint64_t bits) {
+  const uint64_t one_to_two = (bits >> 12) | 0x3ff0000000000000ull;
+  double result;
+  std::memcpy(&result, &one_to_two, sizeof(result));
+  return result - 1.0;
+}
+
+inline double random_double(RandomStream* stream) {
+  return to_unit_double(random_u64(stream));
+}
+
+//  Uniform in [0, n), for n > 0. Multiply-shift rather than modulo: the bias is at most n / 2^32.
+inline int random_int(RandomStream* stream, int n) {
+  return int(((random_u64(stream) >> 32) * uint64_t(n)) >> 32);
+}
+
+void fill_random_u64(RandomStream* stream, uint64_t* dst, int count);
+void fill_random_double(RandomStream* stream, double* dst, int count);
+void fill_random_int(RandomStream* stream, int n, int* dst, int count);
+
+}
@@ -69,15 +69,19 @@ struct {
   ProgramHandle image_program{};
   ProgramHandle colored_quad_program{};
 
-  std::vector<ImageDrawable> image_drawables;
-  std::vector<QuadDrawable> quad_drawables;
-
   int framebuffer_width{};
   int framebuffer_height{};
 
   bool rendering_initialized{};
 } globals;
 
+//  Draw calls are queued per thread, so that tasks running without a window on other threads (the
+//  rigs of a RigHost) can draw and discard their frames independently.
+thread_local struct {
+  std::vector<ImageDrawable> image_drawables;
+  std::vector<QuadDrawable> quad_drawables;
+} frame;
+
 unsigned int create_shader(GLenum type, const char* source) {
   auto shader = glCreateShader(type);
 
@@ -285,20 +289,20 @@ void new_frame(int fb_width, int fb_height) {
   glClearDepth(0.0f);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-  globals.image_drawables.clear();
-  globals.quad_drawables.clear();
+  frame.image_drawables.clear();
+  frame.quad_drawables.clear();
 }
 
 void submit_frame() {
   const float ar = float(globals.framebuffer_width) / float(globals.framebuffer_height);
 
-  if (!globals.quad_drawables.empty()) {
+  if (!frame.quad_drawables.empty()) {
     auto* prog = get_program(globals.colored_quad_program);
     glUseProgram(prog->handle);
     glBindVertexArray(get_vao(globals.quad_vao)->handle);
     glUniform1f(glGetUniformLocation(prog->handle, "u_aspect"), ar);
 
-    for (auto& drawable : globals.quad_drawables) {
+    for (auto& drawable : frame.quad_drawables) {
       set_scale_offset_uniforms(prog->handle, drawable);
 
       auto color_loc = glGetUniformLocation(prog->handle, "u_color");
@@ -308,14 +312,14 @@ void submit_frame() {
     }
   }
 
-  if (!globals.image_drawables.empty()) {
+  if (!frame.image_drawables.empty()) {
     auto* prog = get_program(globals.image_program);
     glUseProgram(prog->handle);
     glBindVertexArray(get_vao(globals.quad_vao)->handle);
     glUniform1f(glGetUniformLocation(prog->handle, "u_aspect"), ar);
     glUniform1i(glGetUniformLocation(prog->handle, "u_flip"), 1);
 
-    for (auto& drawable : globals.image_drawables) {
+    for (auto& drawable : frame.image_drawables) {
       set_scale_offset_uniforms(prog->handle, drawable);
 
       auto* tex = get_texture(drawable.texture);
@@ -329,6 +333,11 @@ void submit_frame() {
   assert(glGetError() == GL_NO_ERROR);
 }
 
+void discard_frame() {
+  frame.image_drawables.clear();
+  frame.quad_drawables.clear();
+}
+
 void terminate_rendering() {
   for (auto& [_, vao] : globals.vaos) {
     glDeleteVertexArrays(1, &vao.handle);
@@ -383,7 +392,7 @@ void draw_2d_image(TextureHandle tex, const Vec2f& scale, const Vec2f& offset) {
   drawable.texture = tex;
   drawable.offset = offset;
   drawable.scale = scale;
-  globals.image_drawables.push_back(drawable);
+  frame.image_drawables.push_back(drawable);
 }
 
 void draw_quad(const Vec3f& color, const Vec2f& scale, const Vec2f& offset) {
@@ -391,7 +400,7 @@ void draw_quad(const Vec3f& color, const Vec2f& scale, const Vec2f& offset) {
   drawable.color = color;
   drawable.offset = offset;
   drawable.scale = scale;
-  globals.quad_drawables.push_back(drawable);
+  frame.quad_drawables.push_back(drawable);
 }
 
 std::optional<TextureHandle> read_2d_image(const char* filepath) {
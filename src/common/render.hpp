@@ -17,6 +17,8 @@ void init_rendering();
 void terminate_rendering();
 void new_frame(int fb_width, int fb_height);
 void submit_frame();
+//  Drop the frame's draw calls without rendering them, for running the task without a window.
+void discard_frame();
 
 TextureHandle create_2d_image(const void* data, int w, int h, int nc);
 void draw_2d_image(TextureHandle tex, const Vec2f& scale, const Vec2f& offset);
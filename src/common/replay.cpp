@@ -0,0 +1,499 @@
+#include "replay.hpp"
+#include "random.hpp"
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace ws::replay {
+
+namespace {
+
+constexpr char file_magic[4]{'W', 'S', 'R', 'P'};
+constexpr uint64_t file_version = 1;
+//  Recorded bytes are written to the file once this many are pending, at a frame boundary.
+constexpr size_t flush_size = 64 * 1024;
+
+enum class RecordType : uint8_t {
+  Frame = 1,
+  Clock,
+  Urand,
+  Rand,
+  LeverState,
+  LeverSamples,
+  Parameter,
+  RandomSeed,
+};
+
+struct {
+  Mode mode{Mode::Off};
+  std::ofstream file;
+  //  Recording: bytes not yet written to `file`. Replaying: the whole log.
+  std::vector<uint8_t> data;
+  size_t read_pos{};
+  bool diverged{};
+  bool finished{};
+
+  int64_t last_clock_ns{};
+  int64_t last_sample_ns{};
+  std::unordered_map<uint32_t, double> recorded_parameters;
+} globals;
+
+int64_t to_ns(const TimePoint& t) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+TimePoint from_ns(int64_t ns) {
+  return TimePoint{std::chrono::duration_cast<TimePoint::duration>(std::chrono::nanoseconds{ns})};
+}
+
+/*
+ * Encoding
+ */
+
+void put_byte(uint8_t v) {
+  globals.data.push_back(v);
+}
+
+void put_varint(uint64_t v) {
+  while (v >= 0x80) {
+    put_byte(uint8_t(v | 0x80));
+    v >>= 7;
+  }
+  put_byte(uint8_t(v));
+}
+
+void put_signed(int64_t v) {
+  put_varint((uint64_t(v) << 1) ^ uint64_t(v >> 63));
+}
+
+void put_fixed(uint64_t v, int num_bytes) {
+  for (int i = 0; i < num_bytes; i++) {
+    put_byte(uint8_t(v >> (8 * i)));
+  }
+}
+
+void put_float(float v) {
+  uint32_t bits;
+  std::memcpy(&bits, &v, sizeof(bits));
+  put_fixed(bits, 4);
+}
+
+void put_double(double v) {
+  uint64_t bits;
+  std::memcpy(&bits, &v, sizeof(bits));
+  put_fixed(bits, 8);
+}
+
+void put_type(RecordType type) {
+  put_byte(uint8_t(type));
+}
+
+void put_lever_state(const LeverState& state) {
+  put_varint(state.has_device_time ? 1 : 0);
+  put_float(state.strain_gauge);
+  put_float(state.calculated_pwm);
+  put_float(state.actual_pwm);
+  put_float(state.potentiometer_reading);
+  put_float(state.position);
+  put_float(state.velocity);
+  put_float(state.force);
+  put_varint(state.device_time_us);
+  const int64_t sample_ns = to_ns(state.sample_time);
+  put_signed(sample_ns - globals.last_sample_ns);
+  globals.last_sample_ns = sample_ns;
+}
+
+void flush_recording() {
+  if (!globals.data.empty()) {
+    globals.file.write(reinterpret_cast<const char*>(globals.data.data()),
+                       std::streamsize(globals.data.size()));
+    globals.data.clear();
+  }
+}
+
+/*
+ * Decoding
+ */
+
+bool fail() {
+  globals.diverged = true;
+  globals.finished = true;
+  return false;
+}
+
+bool get_byte(uint8_t* v) {
+  if (globals.read_pos >= globals.data.size()) {
+    return fail();
+  }
+  *v = globals.data[globals.read_pos++];
+  return true;
+}
+
+bool get_varint(uint64_t* v) {
+  uint64_t result{};
+  for (int shift = 0; shift < 64; shift += 7) {
+    uint8_t byte;
+    if (!get_byte(&byte)) {
+      return false;
+    }
+    result |= uint64_t(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      *v = result;
+      return true;
+    }
+  }
+  return fail();
+}
+
+bool get_signed(int64_t* v) {
+  uint64_t zz;
+  if (!get_varint(&zz)) {
+    return false;
+  }
+  *v = int64_t(zz >> 1) ^ -int64_t(zz & 1);
+  return true;
+}
+
+bool get_fixed(uint64_t* v, int num_bytes) {
+  uint64_t result{};
+  for (int i = 0; i < num_bytes; i++) {
+    uint8_t byte;
+    if (!get_byte(&byte)) {
+      return false;
+    }
+    result |= uint64_t(byte) << (8 * i);
+  }
+  *v = result;
+  return true;
+}
+
+bool get_float(float* v) {
+  uint64_t bits;
+  if (!get_fixed(&bits, 4)) {
+    return false;
+  }
+  const auto bits32 = uint32_t(bits);
+  std::memcpy(v, &bits32, sizeof(*v));
+  return true;
+}
+
+bool get_double(double* v) {
+  uint64_t bits;
+  if (!get_fixed(&bits, 8)) {
+    return false;
+  }
+  std::memcpy(v, &bits, sizeof(*v));
+  return true;
+}
+
+//  Consume the next record's type if it is `type`. The end of the log is not a divergence, but
+//  ends the replay all the same.
+bool expect(RecordType type) {
+  if (globals.finished) {
+    return false;
+  }
+  if (globals.read_pos == globals.data.size()) {
+    globals.finished = true;
+    return false;
+  }
+  if (globals.data[globals.read_pos] != uint8_t(type)) {
+    return fail();
+  }
+  globals.read_pos++;
+  return true;
+}
+
+bool get_lever_state(LeverState* state) {
+  uint64_t flags;
+  int64_t sample_dt;
+  bool ok = get_varint(&flags) &&
+    get_float(&state->strain_gauge) &&
+    get_float(&state->calculated_pwm) &&
+    get_float(&state->actual_pwm) &&
+    get_float(&state->potentiometer_reading) &&
+    get_float(&state->position) &&
+    get_float(&state->velocity) &&
+    get_float(&state->force) &&
+    get_varint(&state->device_time_us) &&
+    get_signed(&sample_dt);
+  if (ok) {
+    state->has_device_time = flags & 1;
+    globals.last_sample_ns += sample_dt;
+    state->sample_time = from_ns(globals.last_sample_ns);
+  }
+  return ok;
+}
+
+void reset_globals(Mode mode) {
+  globals.mode = mode;
+  globals.data.clear();
+  globals.read_pos = 0;
+  globals.diverged = false;
+  globals.finished = false;
+  globals.last_clock_ns = 0;
+  globals.last_sample_ns = 0;
+  globals.recorded_parameters.clear();
+}
+
+void record_parameter(uint32_t id, double value) {
+  auto it = globals.recorded_parameters.find(id);
+  if (it == globals.recorded_parameters.end() || it->second != value) {
+    put_type(RecordType::Parameter);
+    put_varint(id);
+    put_double(value);
+    globals.recorded_parameters[id] = value;
+  }
+}
+
+//  The logged edit to parameter `id` at this point, if any.
+std::optional<double> replay_parameter(uint32_t id) {
+  if (globals.finished || globals.read_pos == globals.data.size() ||
+      globals.data[globals.read_pos] != uint8_t(RecordType::Parameter)) {
+    return std::nullopt;
+  }
+  const size_t record_pos = globals.read_pos++;
+  uint64_t logged_id;
+  double value;
+  if (!get_varint(&logged_id) || logged_id != id) {
+    //  Another parameter's edit; leave it for that parameter.
+    globals.read_pos = record_pos;
+    return std::nullopt;
+  }
+  if (!get_double(&value)) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+} //  anon
+
+bool start_recording(const std::string& file_path) {
+  stop();
+  globals.file.open(file_path, std::ios::binary | std::ios::trunc);
+  if (!globals.file) {
+    return false;
+  }
+  reset_globals(Mode::Record);
+  globals.data.insert(globals.data.end(), std::begin(file_magic), std::end(file_magic));
+  put_varint(file_version);
+  return true;
+}
+
+bool start_replay(const std::string& file_path) {
+  stop();
+  std::ifstream file(file_path, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  reset_globals(Mode::Replay);
+  globals.data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+  const bool has_magic = globals.data.size() >= sizeof(file_magic) &&
+    std::memcmp(globals.data.data(), file_magic, sizeof(file_magic)) == 0;
+  globals.read_pos = has_magic ? sizeof(file_magic) : 0;
+  uint64_t version{};
+  if (!has_magic || !get_varint(&version) || version != file_version) {
+    reset_globals(Mode::Off);
+    return false;
+  }
+  return true;
+}
+
+void stop() {
+  if (globals.mode == Mode::Record) {
+    flush_recording();
+    globals.file.close();
+  }
+  reset_globals(Mode::Off);
+}
+
+Mode get_mode() {
+  return globals.mode;
+}
+
+bool replay_finished() {
+  return globals.mode == Mode::Replay && globals.finished;
+}
+
+bool replay_diverged() {
+  return globals.mode == Mode::Replay && globals.diverged;
+}
+
+bool begin_frame() {
+  switch (globals.mode) {
+    case Mode::Off:
+      return true;
+    case Mode::Record:
+      if (globals.data.size() >= flush_size) {
+        flush_recording();
+      }
+      put_type(RecordType::Frame);
+      return true;
+    case Mode::Replay:
+      return expect(RecordType::Frame);
+  }
+  assert(false);
+  return false;
+}
+
+TimePoint now() {
+  if (globals.mode == Mode::Replay) {
+    int64_t dt;
+    if (expect(RecordType::Clock) && get_signed(&dt)) {
+      globals.last_clock_ns += dt;
+    }
+    return from_ns(globals.last_clock_ns);
+  }
+
+  auto t = ws::now();
+  if (globals.mode == Mode::Record) {
+    const int64_t ns = to_ns(t);
+    put_type(RecordType::Clock);
+    put_signed(ns - globals.last_clock_ns);
+    globals.last_clock_ns = ns;
+  }
+  return t;
+}
+
+double urand() {
+  if (globals.mode == Mode::Replay) {
+    double v{};
+    (void) (expect(RecordType::Urand) && get_double(&v));
+    return v;
+  }
+
+  const double v = ws::urand();
+  if (globals.mode == Mode::Record) {
+    put_type(RecordType::Urand);
+    put_double(v);
+  }
+  return v;
+}
+
+int rand() {
+  if (globals.mode == Mode::Replay) {
+    uint64_t v{};
+    (void) (expect(RecordType::Rand) && get_varint(&v));
+    return int(v);
+  }
+
+  const int v = std::rand();
+  if (globals.mode == Mode::Record) {
+    put_type(RecordType::Rand);
+    put_varint(uint64_t(v));
+  }
+  return v;
+}
+
+uint64_t random_seed() {
+  if (globals.mode == Mode::Replay) {
+    uint64_t v{};
+    (void) (expect(RecordType::RandomSeed) && get_varint(&v));
+    return v;
+  }
+
+  std::random_device device;
+  const uint64_t v = (uint64_t(device()) << 32) | device();
+  if (globals.mode == Mode::Record) {
+    put_type(RecordType::RandomSeed);
+    put_varint(v);
+  }
+  return v;
+}
+
+void sleep_for(std::chrono::milliseconds duration) {
+  if (globals.mode != Mode::Replay) {
+    std::this_thread::sleep_for(duration);
+  }
+}
+
+std::optional<LeverState> get_state(lever::LeverSystem* system, lever::SerialLeverHandle handle) {
+  if (globals.mode == Mode::Replay) {
+    uint64_t has_state;
+    LeverState state{};
+    if (expect(RecordType::LeverState) && get_varint(&has_state) && has_state &&
+        get_lever_state(&state)) {
+      return state;
+    }
+    return std::nullopt;
+  }
+
+  auto state = lever::get_state(system, handle);
+  if (globals.mode == Mode::Record) {
+    put_type(RecordType::LeverState);
+    put_varint(state ? 1 : 0);
+    if (state) {
+      put_lever_state(state.value());
+    }
+  }
+  return state;
+}
+
+int read_samples(lever::LeverSystem* system, lever::SerialLeverHandle handle, uint64_t* cursor,
+                 LeverState* dst, int max_num_samples) {
+  if (globals.mode == Mode::Replay) {
+    uint64_t count;
+    uint64_t next_cursor;
+    if (!expect(RecordType::LeverSamples) || !get_varint(&count) || !get_varint(&next_cursor)) {
+      return 0;
+    }
+    if (count > uint64_t(max_num_samples)) {
+      (void) fail();
+      return 0;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+      if (!get_lever_state(dst + i)) {
+        return 0;
+      }
+    }
+    *cursor = next_cursor;
+    return int(count);
+  }
+
+  const int count = lever::read_samples(system, handle, cursor, dst, max_num_samples);
+  if (globals.mode == Mode::Record) {
+    put_type(RecordType::LeverSamples);
+    put_varint(uint64_t(count));
+    put_varint(*cursor);
+    for (int i = 0; i < count; i++) {
+      put_lever_state(dst[i]);
+    }
+  }
+  return count;
+}
+
+void parameter(uint32_t id, double* value) {
+  if (globals.mode == Mode::Record) {
+    record_parameter(id, *value);
+  } else if (globals.mode == Mode::Replay) {
+    if (auto v = replay_parameter(id)) {
+      *value = v.value();
+    }
+  }
+}
+
+void parameter(uint32_t id, float* value) {
+  double v = *value;
+  parameter(id, &v);
+  *value = float(v);
+}
+
+void parameter(uint32_t id, int* value) {
+  double v = *value;
+  parameter(id, &v);
+  *value = int(v);
+}
+
+void parameter(uint32_t id, bool* value) {
+  double v = *value ? 1.0 : 0.0;
+  parameter(id, &v);
+  *value = v != 0.0;
+}
+
+}
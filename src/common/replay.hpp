@@ -0,0 +1,69 @@
+#pragma once
+
+#include "lever_system.hpp"
+#include "time.hpp"
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+namespace ws::replay {
+
+/*
+ * Replay - Records every input the task consumes (clock reads, random draws, lever state and
+ * samples, and edits to task parameters) into a compact log, and feeds a log back in place of
+ * the live inputs so that a session can be re-run exactly, and without waiting for real time.
+ *
+ * The task calls the functions below instead of `ws::now`, `rand`, `ws::urand`,
+ * `lever::get_state`, etc. With no log open they forward to the live inputs. While recording, each
+ * result is appended to the log. While replaying, each call returns the next logged result
+ * instead; because the task is otherwise deterministic, it makes the same calls in the same order
+ * as it did when recording. A call that does not match the next logged record marks the replay as
+ * diverged, after which the logged results are no longer used.
+ *
+ * Records are tagged and variable-length: integers are LEB128 varints (zigzag-encoded if signed),
+ * and times are stored as the difference from the previous time of the same kind. Not thread-safe;
+ * call from the task thread only.
+ */
+
+enum class Mode {
+  Off = 0,
+  Record,
+  Replay,
+};
+
+bool start_recording(const std::string& file_path);
+bool start_replay(const std::string& file_path);
+//  Flush and close a recording, or close a replay.
+void stop();
+Mode get_mode();
+
+//  True once a replay has consumed its whole log, or diverged from it.
+bool replay_finished();
+bool replay_diverged();
+
+//  Marks the start of a task update. Returns false if a replay has no more updates.
+bool begin_frame();
+
+TimePoint now();
+double urand();
+int rand();
+//  A fresh 64-bit seed, e.g. for keying a session's `RandomStream`s. Values drawn from streams
+//  keyed by a logged seed need not be logged themselves.
+uint64_t random_seed();
+//  Sleeps while live or recording; returns immediately while replaying.
+void sleep_for(std::chrono::milliseconds duration);
+
+std::optional<LeverState> get_state(lever::LeverSystem* system, lever::SerialLeverHandle handle);
+int read_samples(lever::LeverSystem* system, lever::SerialLeverHandle handle, uint64_t* cursor,
+                 LeverState* dst, int max_num_samples);
+
+//  A task parameter that can be edited while the task runs, identified by `id`. While recording,
+//  the value is logged whenever it differs from the last logged value for `id`; while replaying,
+//  `*value` is overwritten with a logged edit, if there is one at this point.
+void parameter(uint32_t id, double* value);
+void parameter(uint32_t id, float* value);
+void parameter(uint32_t id, int* value);
+void parameter(uint32_t id, bool* value);
+
+}
@@ -0,0 +1,140 @@
+#include "rig_host.hpp"
+#include "app.hpp"
+#include "channel.hpp"
+#include "juice_pump.hpp"
+#include "lever_system.hpp"
+#include "render.hpp"
+#include "trace.hpp"
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+namespace ws {
+
+struct Rig {
+  RigConfig config;
+  App* app;
+  std::thread thread;
+  Wakeup wakeup;
+  std::atomic<bool> keep_running{};
+  std::atomic<uint64_t> num_updates{};
+};
+
+struct RigHost {
+  RigHostParams params;
+  std::vector<std::unique_ptr<Rig>> rigs;
+};
+
+namespace {
+
+void run_rig(Rig* rig, std::chrono::milliseconds update_interval) {
+  auto* app = rig->app;
+  const auto thread_name = "rig " + rig->config.name;
+  trace::set_thread_name(thread_name.c_str());
+
+  while (rig->keep_running.load()) {
+    {
+      WS_TRACE_ZONE("task");
+      lever::update(app->lever_system);
+      app->task_update();
+      gfx::discard_frame();
+    }
+    rig->num_updates.fetch_add(1, std::memory_order_relaxed);
+    (void) wait_for(&rig->wakeup, update_interval);
+  }
+  app->shutdown();
+}
+
+void open_devices(Rig* rig) {
+  auto& config = rig->config;
+  auto* app = rig->app;
+
+  app->lever_system = lever::create_lever_system();
+  app->levers.resize(config.lever_ports.size());
+  lever::initialize(app->lever_system, int(app->levers.size()), app->levers.data());
+  for (size_t i = 0; i < config.lever_ports.size(); i++) {
+    //  Opened once the rig's thread updates the system.
+    lever::open_connection(app->lever_system, app->levers[i], config.lever_ports[i]);
+  }
+
+  app->pump_system = pump::create_pump_system();
+  if (!config.pump_port.empty()) {
+    pump::initialize_pump_system(app->pump_system, config.pump_port, config.num_pumps);
+  }
+
+  app->audio_route = config.audio_route;
+  for (int channel : config.audio_route.channels) {
+    if (channel >= audio::num_output_channels()) {
+      std::cerr << "Rig " << config.name << ": audio output channel " << channel
+                << " is out of range; it will be silent." << std::endl;
+    }
+  }
+}
+
+void close_devices(Rig* rig) {
+  auto* app = rig->app;
+  lever::destroy_lever_system(app->lever_system);
+  pump::destroy_pump_system(app->pump_system);
+  app->lever_system = nullptr;
+  app->pump_system = nullptr;
+  app->levers.clear();
+}
+
+} //  anon
+
+RigHostParams make_default_rig_host_params() {
+  RigHostParams result{};
+  result.num_audio_output_channels = 2;
+  result.update_interval = std::chrono::milliseconds(5);
+  return result;
+}
+
+RigHost* start_rigs(const RigHostParams& params, const std::vector<RigConfig>& configs,
+                    const std::vector<App*>& apps) {
+  assert(configs.size() == apps.size());
+  audio::init_audio(params.num_audio_output_channels);
+
+  auto* host = new RigHost();
+  host->params = params;
+  for (size_t i = 0; i < configs.size(); i++) {
+    auto& rig = host->rigs.emplace_back(std::make_unique<Rig>());
+    rig->config = configs[i];
+    rig->app = apps[i];
+    open_devices(rig.get());
+    rig->app->setup();
+  }
+
+  for (auto& rig : host->rigs) {
+    rig->keep_running.store(true);
+    rig->thread = std::thread(run_rig, rig.get(), params.update_interval);
+  }
+  return host;
+}
+
+void stop_rigs(RigHost* host) {
+  for (auto& rig : host->rigs) {
+    rig->keep_running.store(false);
+    notify(&rig->wakeup);
+  }
+  for (auto& rig : host->rigs) {
+    if (rig->thread.joinable()) {
+      rig->thread.join();
+    }
+    close_devices(rig.get());
+  }
+  audio::terminate_audio();
+  delete host;
+}
+
+int num_rigs(const RigHost* host) {
+  return int(host->rigs.size());
+}
+
+uint64_t num_rig_updates(const RigHost* host, int i) {
+  assert(i >= 0 && i < num_rigs(host));
+  return host->rigs[i]->num_updates.load(std::memory_order_relaxed);
+}
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "audio.hpp"
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace ws {
+
+struct App;
+
+/*
+ * RigHost - Runs several independent rigs in one process, so that one workstation can run several
+ * boxes. Each rig has its own lever and pump systems (and their worker threads), its own route to
+ * the shared audio device, and its own task thread; rigs share no state that one rig's task can
+ * block another's on. There are no windows: the GUI, render window and port discovery belong to
+ * the single-rig `App::run`.
+ *
+ * Each rig's App is set up on the calling thread, one rig after another, then updated and finally
+ * shut down on the rig's thread. The replay log is process-wide, so rigs are not recorded.
+ */
+
+struct RigConfig {
+  std::string name;
+  //  One lever per port.
+  std::vector<std::string> lever_ports;
+  //  No pumps if empty.
+  std::string pump_port;
+  int num_pumps;
+  audio::OutputRoute audio_route;
+};
+
+struct RigHostParams {
+  //  Of the shared audio device; enough for every rig's route.
+  int num_audio_output_channels;
+  //  Between a rig's task updates.
+  std::chrono::milliseconds update_interval;
+};
+
+struct RigHost;
+
+RigHostParams make_default_rig_host_params();
+
+//  Create the rigs' device systems, open their ports, set up `apps[i]` as the task of the rig
+//  described by `configs[i]`, and start the rigs' threads. The apps must outlive the host.
+RigHost* start_rigs(const RigHostParams& params, const std::vector<RigConfig>& configs,
+                    const std::vector<App*>& apps);
+//  Stop the rigs' threads, after each has shut down its app, and destroy their device systems.
+void stop_rigs(RigHost* host);
+int num_rigs(const RigHost* host);
+//  Task updates run so far by rig `i`.
+uint64_t num_rig_updates(const RigHost* host, int i);
+
+}
@@ -1,12 +1,17 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <atomic>
+#include <cstdint>
 #include <memory>
 
 namespace ws {
 
 namespace detail {
+  //  Assumed size of a cache line; the reader and writer indices are kept on separate lines.
+  constexpr int ring_buffer_cache_line_size = 64;
+
   struct CopyRange {
     template <typename T>
     static inline void apply(const T* begin, const T* end, T* dest) noexcept {
@@ -16,7 +21,7 @@ namespace detail {
 
   struct MoveRange {
     template <typename T>
-    static inline void apply(const T* begin, const T* end, T* dest) noexcept {
+    static inline void apply(T* begin, T* end, T* dest) noexcept {
       std::move(begin, end, dest);
     }
   };
@@ -24,8 +29,12 @@ namespace detail {
 
 /*
  * RingBuffer - A non-locking ring buffer that is thread-safe for 1 reader and 1 writer, with space
- * for N elements. This space is finite; if the buffer becomes full, no further writes are
- * possible.
+ * for N elements. N must be a power of two. This space is finite; if the buffer becomes full, no
+ * further writes are possible.
+ *
+ * The read and write indices increase monotonically and are masked on access. Each side keeps a
+ * cached copy of the other side's index, and only reloads it (with acquire semantics) when the
+ * cached value says the buffer is full (writer) or holds fewer elements than requested (reader).
  */
 
 template <typename T, int N>
@@ -45,23 +54,44 @@ struct RingBufferHeapStorage {
 template <typename T, int N, typename Storage = RingBufferStackStorage<T, N>>
 class RingBuffer {
 private:
-  static constexpr int capacity = N;
+  static_assert(N > 1 && (N & (N - 1)) == 0, "Expected N to be a power of two.");
+
+  static constexpr uint32_t capacity = uint32_t(N);
+  static constexpr uint32_t mask = capacity - 1;
 
 public:
-  RingBuffer();
+  RingBuffer() = default;
 
+  //  Caller must ensure !full().
   template <typename U = T>
   void write(U&& element) noexcept;
 
   template <typename U = T>
   bool maybe_write(U&& element) noexcept;
 
+  //  Pointer to the next free slot, or nullptr if the buffer is full. The caller fills the slot in
+  //  place; it becomes visible to the reader on `commit_write`.
+  T* prepare_write() noexcept;
+  void commit_write() noexcept;
+
   //  Copy elements in range [begin, end). Caller must ensure num_free() >= end - begin.
   void write_range_copy(const T* begin, const T* end) noexcept;
   //  Move elements in range [begin, end). Caller must ensure num_free() >= end - begin.
   void write_range_move(T* begin, T* end) noexcept;
 
+  //  Caller must ensure size() > 0.
   T read() noexcept;
+  //  Move up to `max_count` elements into `dst`; returns the number read.
+  int read_range(T* dst, int max_count) noexcept;
+  //  Point `data` at the oldest pending elements that are contiguous in memory, and return their
+  //  number, at most `max_count`. The elements remain pending until `skip` is called.
+  int peek(T** data, int max_count) noexcept;
+  //  Release `count` elements previously returned by `peek`.
+  void skip(int count) noexcept;
+  //  Pointer to the oldest pending element, or nullptr if the buffer is empty. The element is
+  //  processed in place and its slot handed back to the writer on `release_read`.
+  T* peek_read() noexcept;
+  void release_read() noexcept;
   void clear() noexcept;
 
   //  Number of elements written and pending read.
@@ -71,7 +101,7 @@ public:
   bool full() const noexcept;
 
   int write_capacity() const noexcept {
-    return N - 1;
+    return N;
   }
 
   T* begin();
@@ -83,45 +113,53 @@ private:
   template <typename CopyOrMove, typename U>
   void write_range_impl(U* begin, U* end) noexcept;
 
+  uint32_t reader_num_pending(uint32_t num_wanted) noexcept;
+
 private:
+  struct alignas(detail::ring_buffer_cache_line_size) ReaderIndices {
+    std::atomic<uint32_t> rp{0};
+    uint32_t cached_wp{0};
+  };
+
+  struct alignas(detail::ring_buffer_cache_line_size) WriterIndices {
+    std::atomic<uint32_t> wp{0};
+    uint32_t cached_rp{0};
+  };
+
   Storage storage;
 
-  std::atomic<int> rp{0};
-  std::atomic<int> wp{0};
+  ReaderIndices reader;
+  WriterIndices writer;
 };
 
 /*
  * Impl
  */
 
-template <typename T, int N, typename Storage>
-RingBuffer<T, N, Storage>::RingBuffer() {
-  static_assert(N > 1, "Expected N > 1.");
-}
-
 template <typename T, int N, typename Storage>
 template <typename U>
 void RingBuffer<T, N, Storage>::write(U&& element) noexcept {
-  auto w = wp.load();
-  storage.buffer[w] = std::forward<U>(element);
-  wp.store((w + 1) % capacity);
+  auto w = writer.wp.load(std::memory_order_relaxed);
+  storage.buffer[w & mask] = std::forward<U>(element);
+  writer.wp.store(w + 1, std::memory_order_release);
 }
 
 template <typename T, int N, typename Storage>
 template <typename CopyOrMove, typename U>
 void RingBuffer<T, N, Storage>::write_range_impl(U* begin, U* end) noexcept {
-  auto size = end - begin;
-  auto w = wp.load();
-  auto free_space_ahead = capacity - w;
+  auto size = uint32_t(end - begin);
+  auto w = writer.wp.load(std::memory_order_relaxed);
+  auto wi = w & mask;
+  auto free_space_ahead = capacity - wi;
   auto forwards_size = size < free_space_ahead ? size : free_space_ahead;
 
-  CopyOrMove::apply(begin, begin + forwards_size, this->begin() + w);
+  CopyOrMove::apply(begin, begin + forwards_size, this->begin() + wi);
 
   if (forwards_size < size) {
     CopyOrMove::apply(begin + forwards_size, end, this->begin());
   }
 
-  wp.store((w + size) % capacity);
+  writer.wp.store(w + size, std::memory_order_release);
 }
 
 template <typename T, int N, typename Storage>
@@ -134,25 +172,101 @@ void RingBuffer<T, N, Storage>::write_range_move(T* begin, T* end) noexcept {
   write_range_impl<detail::MoveRange, T>(begin, end);
 }
 
+template <typename T, int N, typename Storage>
+T* RingBuffer<T, N, Storage>::prepare_write() noexcept {
+  auto w = writer.wp.load(std::memory_order_relaxed);
+  if (w - writer.cached_rp == capacity) {
+    writer.cached_rp = reader.rp.load(std::memory_order_acquire);
+    if (w - writer.cached_rp == capacity) {
+      return nullptr;
+    }
+  }
+  return &storage.buffer[w & mask];
+}
+
+template <typename T, int N, typename Storage>
+void RingBuffer<T, N, Storage>::commit_write() noexcept {
+  auto w = writer.wp.load(std::memory_order_relaxed);
+  writer.wp.store(w + 1, std::memory_order_release);
+}
+
 template <typename T, int N, typename Storage>
 template <typename U>
 bool RingBuffer<T, N, Storage>::maybe_write(U&& element) noexcept {
-  if (!full()) {
-    write(std::forward<U>(element));
+  if (T* slot = prepare_write()) {
+    *slot = std::forward<U>(element);
+    commit_write();
     return true;
   } else {
     return false;
   }
 }
 
+template <typename T, int N, typename Storage>
+uint32_t RingBuffer<T, N, Storage>::reader_num_pending(uint32_t num_wanted) noexcept {
+  auto r = reader.rp.load(std::memory_order_relaxed);
+  if (reader.cached_wp - r < num_wanted) {
+    reader.cached_wp = writer.wp.load(std::memory_order_acquire);
+  }
+  return reader.cached_wp - r;
+}
+
 template <typename T, int N, typename Storage>
 T RingBuffer<T, N, Storage>::read() noexcept {
-  auto r = rp.load();
-  T element = std::move(storage.buffer[r]);
-  rp = (r + 1) % capacity;
+  auto r = reader.rp.load(std::memory_order_relaxed);
+  T element = std::move(storage.buffer[r & mask]);
+  reader.rp.store(r + 1, std::memory_order_release);
   return element;
 }
 
+template <typename T, int N, typename Storage>
+int RingBuffer<T, N, Storage>::read_range(T* dst, int max_count) noexcept {
+  auto r = reader.rp.load(std::memory_order_relaxed);
+  auto num_pending = reader_num_pending(uint32_t(max_count));
+  auto count = num_pending < uint32_t(max_count) ? num_pending : uint32_t(max_count);
+
+  auto ri = r & mask;
+  auto available_ahead = capacity - ri;
+  auto forwards_size = count < available_ahead ? count : available_ahead;
+
+  detail::MoveRange::apply(begin() + ri, begin() + ri + forwards_size, dst);
+  if (forwards_size < count) {
+    detail::MoveRange::apply(begin(), begin() + (count - forwards_size), dst + forwards_size);
+  }
+
+  reader.rp.store(r + count, std::memory_order_release);
+  return int(count);
+}
+
+template <typename T, int N, typename Storage>
+int RingBuffer<T, N, Storage>::peek(T** data, int max_count) noexcept {
+  auto r = reader.rp.load(std::memory_order_relaxed);
+  auto num_pending = reader_num_pending(uint32_t(max_count));
+  auto ri = r & mask;
+  auto available_ahead = capacity - ri;
+  auto count = num_pending < available_ahead ? num_pending : available_ahead;
+  count = count < uint32_t(max_count) ? count : uint32_t(max_count);
+  *data = begin() + ri;
+  return int(count);
+}
+
+template <typename T, int N, typename Storage>
+void RingBuffer<T, N, Storage>::skip(int count) noexcept {
+  auto r = reader.rp.load(std::memory_order_relaxed);
+  reader.rp.store(r + uint32_t(count), std::memory_order_release);
+}
+
+template <typename T, int N, typename Storage>
+T* RingBuffer<T, N, Storage>::peek_read() noexcept {
+  auto r = reader.rp.load(std::memory_order_relaxed);
+  return reader_num_pending(1) > 0 ? &storage.buffer[r & mask] : nullptr;
+}
+
+template <typename T, int N, typename Storage>
+void RingBuffer<T, N, Storage>::release_read() noexcept {
+  skip(1);
+}
+
 template <typename T, int N, typename Storage>
 void RingBuffer<T, N, Storage>::clear() noexcept {
   int num_read = size();
@@ -163,26 +277,15 @@ void RingBuffer<T, N, Storage>::clear() noexcept {
 
 template <typename T, int N, typename Storage>
 int RingBuffer<T, N, Storage>::size() const noexcept {
-  int rp_value = rp % capacity;
-  int wp_value = wp % capacity;
-
-  if (rp_value <= wp_value) {
-    return wp_value - rp_value;
-  } else {
-    return wp_value + (capacity - rp_value);
-  }
+  //  Load rp first: wp only increases, so the result is never negative.
+  auto r = reader.rp.load(std::memory_order_acquire);
+  auto w = writer.wp.load(std::memory_order_acquire);
+  return int(w - r);
 }
 
 template <typename T, int N, typename Storage>
 int RingBuffer<T, N, Storage>::num_free() const noexcept {
-  int rp_value = rp % capacity;
-  int wp_value = wp % capacity;
-
-  if (rp_value <= wp_value) {
-    return capacity - (wp_value - rp_value) - 1;
-  } else {
-    return rp_value - wp_value - 1;
-  }
+  return N - size();
 }
 
 template <typename T, int N, typename Storage>
@@ -210,4 +313,4 @@ const T* RingBuffer<T, N, Storage>::end() const {
   return &storage.buffer[0] + N;
 }
 
-}
\ No newline at end of file
+}
@@ -1,8 +1,60 @@
 #include "serial.hpp"
-#include <cstdio>
+#include "time.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
 
 namespace ws {
 
+namespace {
+
+void set_error(SerialError* dst, SerialError error) {
+  if (dst) {
+    *dst = error;
+  }
+}
+
+//  Move pending bytes to the front of the read buffer, to make room at the back.
+void compact_read_buffer(SerialBuffers& buffers) {
+  const int num_pending = buffers.read_end - buffers.read_begin;
+  if (buffers.read_begin > 0 && num_pending > 0) {
+    std::memmove(buffers.read, buffers.read + buffers.read_begin, size_t(num_pending));
+  }
+  buffers.read_begin = 0;
+  buffers.read_end = num_pending;
+}
+
+//  Append bytes from the port to the read buffer. If `block`, wait (up to the port's read
+//  timeout) for at least one byte; otherwise only take bytes that have already arrived.
+SerialError fill_read_buffer(SerialContext& context, bool block, int* num_read) {
+  *num_read = 0;
+  auto& buffers = *context.buffers;
+  const auto space = size_t(SerialBuffers::read_capacity - buffers.read_end);
+  assert(space > 0);
+
+  //  The serial library reports errors by throwing; they stop here.
+  try {
+    size_t num_want = std::min(context.instance->available(), space);
+    if (num_want == 0) {
+      if (!block) {
+        return SerialError::None;
+      }
+      num_want = 1;
+    }
+    auto* dst = reinterpret_cast<uint8_t*>(buffers.read + buffers.read_end);
+    const auto num_got = context.instance->read(dst, num_want);
+    buffers.read_end += int(num_got);
+    *num_read = int(num_got);
+    record_bytes_in(context.stats, int(num_got));
+    return SerialError::None;
+  } catch (...) {
+    record_io_error(context.stats);
+    return SerialError::IOError;
+  }
+}
+
+} //  anon
+
 std::vector<PortDescriptor> enumerate_ports() {
   std::vector<PortDescriptor> result;
   for (auto& port : serial::list_ports()) {
@@ -14,34 +66,152 @@ std::vector<PortDescriptor> enumerate_ports() {
   return result;
 }
 
-std::optional<SerialContext> make_context(const std::string& port, uint32_t baud, uint32_t timeout) {
+std::optional<SerialContext> make_context(const std::string& port, uint32_t baud, uint32_t timeout,
+                                          SerialError* error) {
   SerialContext result;
+  result.timeout = timeout;
+  result.buffers = std::make_unique<SerialBuffers>();
+  result.buffers->read_begin = 0;
+  result.buffers->read_end = 0;
 
   try {
     result.instance = std::make_unique<serial::Serial>(
       port, baud, serial::Timeout::simpleTimeout(timeout));
-
+    if (!result.instance->isOpen()) {
+      set_error(error, SerialError::NotOpen);
+      return std::nullopt;
+    }
+    result.instance->setTimeout(serial::Timeout::max(), timeout, 0, timeout, 0);
   } catch (...) {
-    printf("Failed to create instance.\n");
+    set_error(error, SerialError::IOError);
     return std::nullopt;
   }
 
-  if (!result.instance->isOpen()) {
-    printf("Failed to open port.\n");
-    return std::nullopt;
-  } else {
-    result.instance->setTimeout(serial::Timeout::max(), timeout, 0, timeout, 0);
+  set_error(error, SerialError::None);
+  return result;
+}
+
+SerialError read_available(SerialContext& context, char* dst, int max_size, int* num_read) {
+  *num_read = 0;
+  if (!is_open(context)) {
+    return SerialError::NotOpen;
   }
 
-  return result;
+  auto& buffers = *context.buffers;
+  if (buffers.read_end == buffers.read_begin) {
+    buffers.read_begin = 0;
+    buffers.read_end = 0;
+    int ignore;
+    if (auto err = fill_read_buffer(context, false, &ignore); err != SerialError::None) {
+      return err;
+    }
+  }
+
+  const int count = std::min(max_size, buffers.read_end - buffers.read_begin);
+  std::memcpy(dst, buffers.read + buffers.read_begin, size_t(count));
+  buffers.read_begin += count;
+  *num_read = count;
+  return SerialError::None;
 }
 
-std::optional<std::string> readline(const SerialContext& context) {
+SerialError read_frame(SerialContext& context, char terminator, const char** frame, int* size) {
+  *frame = nullptr;
+  *size = 0;
+  if (!is_open(context)) {
+    return SerialError::NotOpen;
+  }
+
+  auto& buffers = *context.buffers;
+  int scan_begin = buffers.read_begin;
+  const auto t0 = now();
+
+  while (true) {
+    const int num_scan = buffers.read_end - scan_begin;
+    if (auto* term = static_cast<char*>(
+          std::memchr(buffers.read + scan_begin, terminator, size_t(num_scan)))) {
+      *term = '\0';
+      *frame = buffers.read + buffers.read_begin;
+      *size = int(term - *frame);
+      buffers.read_begin = int(term - buffers.read) + 1;
+      record_frame_in(context.stats);
+      return SerialError::None;
+    }
+
+    const int num_scanned = buffers.read_end - buffers.read_begin;
+    compact_read_buffer(buffers);
+    scan_begin = num_scanned;
+    if (buffers.read_end == SerialBuffers::read_capacity) {
+      //  Discard the partial frame.
+      buffers.read_begin = 0;
+      buffers.read_end = 0;
+      record_parse_failure(context.stats);
+      return SerialError::FrameTooLong;
+    }
+
+    int num_read;
+    if (auto err = fill_read_buffer(context, true, &num_read); err != SerialError::None) {
+      return err;
+    }
+    if (num_read == 0 || elapsed_time(t0, now()) * 1e3 > double(context.timeout)) {
+      record_timeout(context.stats);
+      return SerialError::Timeout;
+    }
+  }
+}
+
+SerialError write(SerialContext& context, const char* data, int size) {
+  if (!is_open(context)) {
+    return SerialError::NotOpen;
+  }
+
   try {
-    return context.instance->readline();
+    const auto num_written = context.instance->write(
+      reinterpret_cast<const uint8_t*>(data), size_t(size));
+    record_bytes_out(context.stats, int(num_written));
+    if (num_written == size_t(size)) {
+      return SerialError::None;
+    } else {
+      record_timeout(context.stats);
+      return SerialError::Timeout;
+    }
   } catch (...) {
-    printf("Failed to read line.\n");
-    return std::nullopt;
+    record_io_error(context.stats);
+    return SerialError::IOError;
+  }
+}
+
+SerialError write_gather(SerialContext& context, const SerialWriteSpan* spans, int num_spans) {
+  if (!is_open(context)) {
+    return SerialError::NotOpen;
+  }
+
+  auto& buffers = *context.buffers;
+  int size{};
+  for (int i = 0; i < num_spans; i++) {
+    if (size + spans[i].size > SerialBuffers::write_capacity) {
+      return SerialError::FrameTooLong;
+    }
+    std::memcpy(buffers.write + size, spans[i].data, size_t(spans[i].size));
+    size += spans[i].size;
+  }
+  return write(context, buffers.write, size);
+}
+
+const char* to_string(SerialError error) {
+  switch (error) {
+    case SerialError::None:
+      return "None";
+    case SerialError::NotOpen:
+      return "NotOpen";
+    case SerialError::Timeout:
+      return "Timeout";
+    case SerialError::IOError:
+      return "IOError";
+    case SerialError::FrameTooLong:
+      return "FrameTooLong";
+    default:
+      assert(false);
+      return "";
   }
 }
 
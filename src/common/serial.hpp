@@ -1,13 +1,42 @@
 #pragma once
 
+#include "serial_stats.hpp"
 #include <serial/serial.h>
 #include <memory>
 #include <optional>
 
 namespace ws {
 
+enum class SerialError {
+  None = 0,
+  NotOpen,
+  Timeout,
+  IOError,
+  FrameTooLong,
+};
+
+/*
+ * SerialContext - An open port, plus read and write buffers that are allocated once, when the
+ * context is created. Bytes are read from the port in blocks into the read buffer, and lines /
+ * frames are extracted from it in place, so reading and writing do not allocate.
+ */
+
+struct SerialBuffers {
+  static constexpr int read_capacity = 512;
+  static constexpr int write_capacity = 256;
+
+  char read[read_capacity];
+  int read_begin;
+  int read_end;
+  char write[write_capacity];
+};
+
 struct SerialContext {
   std::unique_ptr<serial::Serial> instance{};
+  std::unique_ptr<SerialBuffers> buffers{};
+  uint32_t timeout{};
+  //  Not owned; outlives the context, if set.
+  SerialStats* stats{};
 };
 
 struct PortDescriptor {
@@ -15,12 +44,34 @@ struct PortDescriptor {
   std::string description;
 };
 
-std::optional<SerialContext> make_context(const std::string& port, uint32_t baud, uint32_t timeout);
-std::optional<std::string> readline(const SerialContext& context);
+//  A piece of a gathered write.
+struct SerialWriteSpan {
+  const char* data;
+  int size;
+};
+
+std::optional<SerialContext> make_context(const std::string& port, uint32_t baud, uint32_t timeout,
+                                          SerialError* error = nullptr);
 std::vector<PortDescriptor> enumerate_ports();
 
+//  Copy up to `max_size` bytes that have already arrived into `dst`, without blocking.
+SerialError read_available(SerialContext& context, char* dst, int max_size, int* num_read);
+//  Block until a frame ending in `terminator` has been read, or the context's timeout elapses.
+//  On success, `*frame` points at the frame within the context's read buffer, with the terminator
+//  replaced by '\0'; it is valid until the next read from the context.
+SerialError read_frame(SerialContext& context, char terminator, const char** frame, int* size);
+inline SerialError read_line(SerialContext& context, const char** line, int* size) {
+  return read_frame(context, '\n', line, size);
+}
+
+SerialError write(SerialContext& context, const char* data, int size);
+//  Concatenate `spans` in the context's write buffer and send them with one write.
+SerialError write_gather(SerialContext& context, const SerialWriteSpan* spans, int num_spans);
+
+const char* to_string(SerialError error);
+
 inline bool is_open(const SerialContext& context) {
   return context.instance && context.instance->isOpen();
 }
 
-}
\ No newline at end of file
+}
@@ -1,19 +1,21 @@
 #include "serial_lever.hpp"
 #include <string>
+#include <cstdio>
 #include <cstring>
 
 namespace ws {
 
 namespace {
 
-std::optional<int> parse_force(const std::string& s) {
+//  `s` is a null-terminated line in the serial context's read buffer.
+std::optional<int> parse_force(const char* s) {
   constexpr const char* tg = "target grams: ";
-  auto tg_it = s.find(tg);
-  if (tg_it == std::string::npos) {
+  auto* tg_it = std::strstr(s, tg);
+  if (!tg_it) {
     return std::nullopt;
   } else {
     char* ignore;
-    return std::strtol(s.data() + tg_it + std::strlen(tg), &ignore, 10);
+    return std::strtol(tg_it + std::strlen(tg), &ignore, 10);
   }
 }
 
@@ -22,32 +24,36 @@ std::optional<int> parse_force(const std::string& s) {
   return std::strtof(base + off + std::strlen(prefix), &ignore);
 }
 
-std::optional<LeverState> parse_state(const std::string& s) {
+std::optional<LeverState> parse_state(const char* s) {
 #if 0
-    printf("Source: %s\n", s.c_str());
+    printf("Source: %s\n", s);
 #endif
 
-    const auto not_found = std::string::npos;
     constexpr const char* sg = "strain gauge reading: ";
     constexpr const char* cpwm = "calculated PWM: ";
     constexpr const char* real_pwm = "acutal PWM: ";
     constexpr const char* pot_str = "P: ";
+    constexpr const char* time_str = "T: ";
 
-    auto sg_it = s.find(sg);
-    auto cpwm_it = s.find(cpwm);
-    auto real_pwm_it = s.find(real_pwm);  //  @NOTE: typo
-    auto pot_it = s.find(pot_str);  //  @NOTE: typo
+    auto* sg_it = std::strstr(s, sg);
+    auto* cpwm_it = std::strstr(s, cpwm);
+    auto* real_pwm_it = std::strstr(s, real_pwm);  //  @NOTE: typo
+    auto* pot_it = std::strstr(s, pot_str);  //  @NOTE: typo
 
-    if (sg_it == not_found || cpwm_it == not_found || real_pwm_it == not_found || pot_it == not_found) {
+    if (!sg_it || !cpwm_it || !real_pwm_it || !pot_it) {
         return std::nullopt;
     }
 
     char* ignore;
     LeverState result{};
-    result.strain_gauge = std::strtof(s.data() + sg_it + std::strlen(sg), &ignore);
-    result.calculated_pwm = std::strtof(s.data() + cpwm_it + std::strlen(cpwm), &ignore);
-    result.actual_pwm = std::strtof(s.data() + real_pwm_it + std::strlen(real_pwm), &ignore);
-    result.potentiometer_reading = std::strtof(s.data() + pot_it + std::strlen(pot_str), &ignore);
+    result.strain_gauge = std::strtof(sg_it + std::strlen(sg), &ignore);
+    result.calculated_pwm = std::strtof(cpwm_it + std::strlen(cpwm), &ignore);
+    result.actual_pwm = std::strtof(real_pwm_it + std::strlen(real_pwm), &ignore);
+    result.potentiometer_reading = std::strtof(pot_it + std::strlen(pot_str), &ignore);
+    if (auto* time_it = std::strstr(s, time_str)) {
+      result.has_device_time = true;
+      result.device_time_us = std::strtoull(time_it + std::strlen(time_str), &ignore, 10);
+    }
     return result;
 }
 
@@ -59,25 +65,58 @@ std::string to_string(const LeverState& state, const std::string& delim) {
   result += delim + "calculated_pwm: " + std::to_string(state.calculated_pwm);
   result += delim + "actual_pwm: " + std::to_string(state.actual_pwm);
   result += delim + "potent_reading: " + std::to_string(state.potentiometer_reading);
+  if (state.has_device_time) {
+    result += delim + "device_time_us: " + std::to_string(state.device_time_us);
+  }
+  result += delim + "position: " + std::to_string(state.position);
+  result += delim + "velocity: " + std::to_string(state.velocity);
+  result += delim + "force: " + std::to_string(state.force);
   return result;
 }
 
-std::optional<LeverState> read_state(const SerialContext& context) {
-  context.instance->write("s");
-  if (auto str = readline(context)) {
-    return parse_state(str.value());
+std::optional<LeverState> read_state(SerialContext& context, StateRoundTrip* round_trip) {
+  const char* line;
+  int size;
+  const auto t0 = now();
+  if (write(context, "s", 1) == SerialError::None &&
+      read_line(context, &line, &size) == SerialError::None) {
+    const auto t1 = now();
+    record_request_latency(context.stats, t0, t1);
+    if (round_trip) {
+      round_trip->sent = t0;
+      round_trip->received = t1;
+      round_trip->response_size = size + 1;
+    }
+    auto result = parse_state(line);
+    if (result) {
+      result.value().sample_time = t1;
+    } else {
+      record_parse_failure(context.stats);
+    }
+    return result;
   } else {
     return std::nullopt;
   }
 }
 
-std::optional<int> set_force_grams(const SerialContext& context, int force) {
-  std::string command{"g"};
-  command += std::to_string(force);
-  command += "\n";
-  context.instance->write(command);
-  if (auto res = readline(context)) {
-    return parse_force(res.value());
+std::optional<int> set_force_grams(SerialContext& context, int force) {
+  char command[32];
+  const int command_size = std::snprintf(command, sizeof(command), "g%d\n", force);
+  if (command_size <= 0 || command_size >= int(sizeof(command))) {
+    return std::nullopt;
+  }
+
+  const char* line;
+  int size;
+  const auto t0 = now();
+  if (write(context, command, command_size) == SerialError::None &&
+      read_line(context, &line, &size) == SerialError::None) {
+    record_request_latency(context.stats, t0, now());
+    auto result = parse_force(line);
+    if (!result) {
+      record_parse_failure(context.stats);
+    }
+    return result;
   } else {
     return std::nullopt;
   }
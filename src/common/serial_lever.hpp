@@ -1,6 +1,7 @@
 #pragma once
 
 #include "serial.hpp"
+#include "time.hpp"
 
 namespace ws {
 
@@ -9,6 +10,25 @@ struct LeverState {
   float calculated_pwm;
   float actual_pwm;
   float potentiometer_reading;
+  //  Firmware `micros()` when the sample was taken, if reported. As read from the device, this is
+  //  the raw 32-bit counter; the lever system unwraps it to 64 bits.
+  bool has_device_time;
+  uint64_t device_time_us;
+  //  Host time at which the sample was taken. Estimated from the device time once the lever's
+  //  clock is synchronized, otherwise the time at which the response arrived.
+  TimePoint sample_time;
+  //  Derived by the lever system's signal pipeline: filtered potentiometer reading, its rate of
+  //  change per second, and calibrated, filtered force.
+  float position;
+  float velocity;
+  float force;
+};
+
+//  Host-side timing of a `read_state` request.
+struct StateRoundTrip {
+  TimePoint sent;
+  TimePoint received;
+  int response_size;
 };
 
 constexpr uint32_t default_baud_rate() {
@@ -21,7 +41,7 @@ constexpr uint32_t default_read_write_timeout() {
 
 std::string to_string(const LeverState& state, const std::string& delim = "\n");
 
-std::optional<LeverState> read_state(const SerialContext& context);
-std::optional<int> set_force_grams(const SerialContext& context, int force);
+std::optional<LeverState> read_state(SerialContext& context, StateRoundTrip* round_trip = nullptr);
+std::optional<int> set_force_grams(SerialContext& context, int force);
 
 }
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include "serial_stats.hpp"
+#include <algorithm>
+
+namespace ws {
+
+namespace {
+
+using Hist = LatencyHistogram;
+
+//  Only the owning thread modifies the stats, so counters avoid locked read-modify-writes.
+template <typename T>
+void increment(std::atomic<T>& counter, T n = 1) {
+  counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+int highest_bit(uint32_t v) {
+  int result{};
+  while (v >>= 1) {
+    result++;
+  }
+  return result;
+}
+
+int bucket_index(uint32_t value) {
+  if (value < uint32_t(Hist::num_sub_buckets)) {
+    return int(value);
+  }
+  const int msb = std::min(highest_bit(value), Hist::max_value_bits);
+  const int shift = msb - Hist::sub_bucket_bits;
+  const int sub_bucket = int((value >> shift) & (Hist::num_sub_buckets - 1));
+  return (shift + 1) * Hist::num_sub_buckets + sub_bucket;
+}
+
+//  Midpoint of the range of values that fall in bucket `index`.
+double bucket_value(int index) {
+  if (index < Hist::num_sub_buckets) {
+    return double(index);
+  }
+  const int shift = index / Hist::num_sub_buckets - 1;
+  const int sub_bucket = index % Hist::num_sub_buckets;
+  const double lo = double(uint64_t(Hist::num_sub_buckets + sub_bucket) << shift);
+  return lo + double(uint64_t(1) << shift) * 0.5;
+}
+
+} //  anon
+
+void record_latency(LatencyHistogram& hist, double seconds) {
+  const double us = std::max(0.0, seconds * 1e6);
+  const auto max_us = double((uint64_t(1) << Hist::max_value_bits) - 1);
+  const auto value = uint32_t(std::min(us, max_us));
+  increment(hist.counts[bucket_index(value)], 1u);
+  increment(hist.num_values, uint64_t(1));
+  if (value > hist.max_value.load(std::memory_order_relaxed)) {
+    hist.max_value.store(value, std::memory_order_relaxed);
+  }
+}
+
+void record_bytes_in(SerialStats* stats, int count) {
+  if (stats) {
+    increment(stats->bytes_in, uint64_t(count));
+  }
+}
+
+void record_bytes_out(SerialStats* stats, int count) {
+  if (stats) {
+    increment(stats->bytes_out, uint64_t(count));
+    increment(stats->frames_out, uint64_t(1));
+  }
+}
+
+void record_frame_in(SerialStats* stats) {
+  if (!stats) {
+    return;
+  }
+
+  increment(stats->frames_in, uint64_t(1));
+  stats->rate_window_frames++;
+  const auto t = now();
+  const double dt = elapsed_time(stats->rate_window_begin, t);
+  if (dt >= 1.0) {
+    stats->frames_per_second.store(
+      dt < 2.0 ? float(double(stats->rate_window_frames) / dt) : 0.0f, std::memory_order_relaxed);
+    stats->rate_window_begin = t;
+    stats->rate_window_frames = 0;
+  }
+}
+
+void record_timeout(SerialStats* stats) {
+  if (stats) {
+    increment(stats->timeouts, uint64_t(1));
+  }
+}
+
+void record_io_error(SerialStats* stats) {
+  if (stats) {
+    increment(stats->io_errors, uint64_t(1));
+  }
+}
+
+void record_parse_failure(SerialStats* stats) {
+  if (stats) {
+    increment(stats->parse_failures, uint64_t(1));
+  }
+}
+
+void record_request_latency(SerialStats* stats, const TimePoint& t0, const TimePoint& t1) {
+  if (stats) {
+    record_latency(stats->latency_us, elapsed_time(t0, t1));
+  }
+}
+
+void reset(SerialStats* stats) {
+  stats->bytes_in.store(0);
+  stats->bytes_out.store(0);
+  stats->frames_in.store(0);
+  stats->frames_out.store(0);
+  stats->timeouts.store(0);
+  stats->io_errors.store(0);
+  stats->parse_failures.store(0);
+  for (auto& count : stats->latency_us.counts) {
+    count.store(0);
+  }
+  stats->latency_us.num_values.store(0);
+  stats->latency_us.max_value.store(0);
+  stats->frames_per_second.store(0.0f);
+  stats->rate_window_begin = now();
+  stats->rate_window_frames = 0;
+}
+
+double quantile_us(const LatencyHistogram& hist, double q) {
+  //  Bucket counts are read independently, so sum them rather than trusting `num_values`.
+  std::array<uint32_t, Hist::num_buckets> counts;
+  uint64_t total{};
+  for (int i = 0; i < Hist::num_buckets; i++) {
+    counts[i] = hist.counts[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+  if (total == 0) {
+    return 0.0;
+  }
+
+  const auto target = uint64_t(std::max(1.0, q * double(total)));
+  uint64_t sum{};
+  for (int i = 0; i < Hist::num_buckets; i++) {
+    sum += counts[i];
+    if (sum >= target) {
+      return std::min(bucket_value(i), double(hist.max_value.load(std::memory_order_relaxed)));
+    }
+  }
+  return double(hist.max_value.load(std::memory_order_relaxed));
+}
+
+SerialStatsSnapshot read_serial_stats(const SerialStats& stats) {
+  SerialStatsSnapshot result{};
+  result.bytes_in = stats.bytes_in.load(std::memory_order_relaxed);
+  result.bytes_out = stats.bytes_out.load(std::memory_order_relaxed);
+  result.frames_in = stats.frames_in.load(std::memory_order_relaxed);
+  result.frames_out = stats.frames_out.load(std::memory_order_relaxed);
+  result.timeouts = stats.timeouts.load(std::memory_order_relaxed);
+  result.io_errors = stats.io_errors.load(std::memory_order_relaxed);
+  result.parse_failures = stats.parse_failures.load(std::memory_order_relaxed);
+  result.frames_per_second = stats.frames_per_second.load(std::memory_order_relaxed);
+
+  auto& hist = stats.latency_us;
+  result.num_requests = hist.num_values.load(std::memory_order_relaxed);
+  result.latency_p50_ms = quantile_us(hist, 0.5) * 1e-3;
+  result.latency_p90_ms = quantile_us(hist, 0.9) * 1e-3;
+  result.latency_p99_ms = quantile_us(hist, 0.99) * 1e-3;
+  result.latency_max_ms = double(hist.max_value.load(std::memory_order_relaxed)) * 1e-3;
+  return result;
+}
+
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "time.hpp"
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace ws {
+
+/*
+ * SerialStats - I/O counters for one serial connection. Written by the thread that owns the
+ * connection and readable from any thread. A SerialContext records bytes, frames, timeouts and
+ * I/O errors into the stats it is attached to. Callers record request latency (the round trip,
+ * for devices that reply, otherwise the time taken by the write) and parse failures.
+ */
+
+/*
+ * LatencyHistogram - Log-linear buckets, in the style of HDR histograms: values below 16us each
+ * have a bucket, and every power of two above that is split into 16 buckets, so any recorded
+ * value is known to within ~6%. Values of 2^26us (~67s) or more are clamped to just below that.
+ */
+
+struct LatencyHistogram {
+  static constexpr int sub_bucket_bits = 4;
+  static constexpr int num_sub_buckets = 1 << sub_bucket_bits;
+  static constexpr int max_value_bits = 26;
+  static constexpr int num_buckets = (max_value_bits - sub_bucket_bits + 1) * num_sub_buckets;
+
+  std::array<std::atomic<uint32_t>, num_buckets> counts{};
+  std::atomic<uint64_t> num_values{};
+  std::atomic<uint32_t> max_value{};
+};
+
+struct SerialStats {
+  std::atomic<uint64_t> bytes_in{};
+  std::atomic<uint64_t> bytes_out{};
+  std::atomic<uint64_t> frames_in{};
+  std::atomic<uint64_t> frames_out{};
+  std::atomic<uint64_t> timeouts{};
+  std::atomic<uint64_t> io_errors{};
+  std::atomic<uint64_t> parse_failures{};
+  LatencyHistogram latency_us;
+
+  //  Incoming frames per second, over the most recent whole second.
+  std::atomic<float> frames_per_second{};
+  TimePoint rate_window_begin{};
+  uint64_t rate_window_frames{};
+};
+
+struct SerialStatsSnapshot {
+  uint64_t bytes_in;
+  uint64_t bytes_out;
+  uint64_t frames_in;
+  uint64_t frames_out;
+  uint64_t timeouts;
+  uint64_t io_errors;
+  uint64_t parse_failures;
+  float frames_per_second;
+  uint64_t num_requests;
+  double latency_p50_ms;
+  double latency_p90_ms;
+  double latency_p99_ms;
+  double latency_max_ms;
+};
+
+//  by owner
+void record_latency(LatencyHistogram& hist, double seconds);
+void record_bytes_in(SerialStats* stats, int count);
+void record_bytes_out(SerialStats* stats, int count);
+void record_frame_in(SerialStats* stats);
+void record_timeout(SerialStats* stats);
+void record_io_error(SerialStats* stats);
+void record_parse_failure(SerialStats* stats);
+void record_request_latency(SerialStats* stats, const TimePoint& t0, const TimePoint& t1);
+void reset(SerialStats* stats);
+
+//  by any thread
+//  Value in microseconds below which fraction `q` of the recorded values fall.
+double quantile_us(const LatencyHistogram& hist, double q);
+SerialStatsSnapshot read_serial_stats(const SerialStats& stats);
+
+}
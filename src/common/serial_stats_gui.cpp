@@ -0,0 +1,21 @@
+#include "serial_stats_gui.hpp"
+#include "serial_stats.hpp"
+#include <imgui.h>
+
+namespace ws {
+
+void gui::render_serial_stats(const SerialStatsSnapshot& stats) {
+  ImGui::Text("Bytes in: %llu", (unsigned long long) stats.bytes_in);
+  ImGui::Text("Bytes out: %llu", (unsigned long long) stats.bytes_out);
+  ImGui::Text("Frames in: %llu (%0.1f / s)",
+              (unsigned long long) stats.frames_in, stats.frames_per_second);
+  ImGui::Text("Frames out: %llu", (unsigned long long) stats.frames_out);
+  ImGui::Text("Latency (ms): p50 %0.2f, p90 %0.2f, p99 %0.2f, max %0.2f (n = %llu)",
+              stats.latency_p50_ms, stats.latency_p90_ms, stats.latency_p99_ms,
+              stats.latency_max_ms, (unsigned long long) stats.num_requests);
+  ImGui::Text("Timeouts: %llu", (unsigned long long) stats.timeouts);
+  ImGui::Text("I/O errors: %llu", (unsigned long long) stats.io_errors);
+  ImGui::Text("Parse failures: %llu", (unsigned long long) stats.parse_failures);
+}
+
+}
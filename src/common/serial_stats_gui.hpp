@@ -0,0 +1,11 @@
+#pragma once
+
+namespace ws {
+struct SerialStatsSnapshot;
+}
+
+namespace ws::gui {
+
+void render_serial_stats(const SerialStatsSnapshot& stats);
+
+}
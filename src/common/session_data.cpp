@@ -0,0 +1,278 @@
+#include "session_data.hpp"
+#include "write_ahead_log.hpp"
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+namespace ws {
+
+namespace {
+
+/*
+ * WAL encoding. Fixed-size records are stored as their bytes; the log is only read back by tools
+ * built from the same tree, on the same platform. Session info is variable-size: strings and
+ * arrays are stored as a uint32 count followed by their elements.
+ */
+
+template <typename T>
+bool append_bytes(WriteAheadLog* log, SessionRecordType type, const T& record) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  return append_record(log, uint32_t(type), &record, uint32_t(sizeof(T)));
+}
+
+template <typename T>
+bool read_bytes(const WalRecord& record, T* dst) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  if (record.data.size() != sizeof(T)) {
+    return false;
+  }
+  std::memcpy(dst, record.data.data(), sizeof(T));
+  return true;
+}
+
+template <typename T>
+void put(std::vector<uint8_t>* out, const T& v) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  auto* bytes = reinterpret_cast<const uint8_t*>(&v);
+  out->insert(out->end(), bytes, bytes + sizeof(T));
+}
+
+void put(std::vector<uint8_t>* out, const std::string& v) {
+  put(out, uint32_t(v.size()));
+  out->insert(out->end(), v.begin(), v.end());
+}
+
+template <typename T>
+void put(std::vector<uint8_t>* out, const std::vector<T>& v) {
+  put(out, uint32_t(v.size()));
+  for (auto& element : v) {
+    put(out, element);
+  }
+}
+
+struct Reader {
+  const std::vector<uint8_t>& data;
+  size_t pos;
+};
+
+template <typename T>
+bool get(Reader* reader, T* v) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  if (reader->data.size() - reader->pos < sizeof(T)) {
+    return false;
+  }
+  std::memcpy(v, reader->data.data() + reader->pos, sizeof(T));
+  reader->pos += sizeof(T);
+  return true;
+}
+
+bool get(Reader* reader, std::string* v) {
+  uint32_t size;
+  if (!get(reader, &size) || reader->data.size() - reader->pos < size) {
+    return false;
+  }
+  auto* begin = reinterpret_cast<const char*>(reader->data.data() + reader->pos);
+  v->assign(begin, begin + size);
+  reader->pos += size;
+  return true;
+}
+
+template <typename T>
+bool get(Reader* reader, std::vector<T>* v) {
+  uint32_t size;
+  if (!get(reader, &size) || (reader->data.size() - reader->pos) / sizeof(T) < size) {
+    return false;
+  }
+  v->resize(size);
+  for (auto& element : *v) {
+    (void) get(reader, &element);
+  }
+  return true;
+}
+
+bool read_session_info(const WalRecord& record, SessionInfo* info) {
+  Reader reader{record.data, 0};
+  return get(&reader, &info->animal1_name) &&
+    get(&reader, &info->animal2_name) &&
+    get(&reader, &info->experiment_date) &&
+    get(&reader, &info->task_type) &&
+    get(&reader, &info->task_type_block) &&
+    get(&reader, &info->task_type_random) &&
+    get(&reader, &info->task_type_blocklength) &&
+    get(&reader, &info->large_juice_volume) &&
+    get(&reader, &info->small_juice_volume) &&
+    get(&reader, &info->session_seed) &&
+    get(&reader, &info->scheduled_task_types) &&
+    get(&reader, &info->scheduled_large_juice_volumes) &&
+    get(&reader, &info->scheduled_small_juice_volumes);
+}
+
+} //  anon
+
+/*
+ * JSON. Keys are written in alphabetical order, as the files have always had them.
+ */
+
+void write_json(JsonWriter& writer, const TrialRecord& trial) {
+  writer.begin_object();
+  writer.field("first_pull_id", trial.first_pull_id);
+  writer.field("rewarded", trial.rewarded);
+  writer.field("task_type", trial.task_type);
+  writer.field("trial_number", trial.trial_number);
+  writer.field("trial_starttime", trial.trial_start_time_stamp);
+  writer.end_object();
+}
+
+void write_json(JsonWriter& writer, const BehaviorData& bhv_data) {
+  writer.begin_object();
+  writer.field("behavior_events", bhv_data.behavior_events);
+  writer.field("time_points", bhv_data.time_points);
+  writer.field("trial_number", bhv_data.trial_number);
+  writer.end_object();
+}
+
+void write_json(JsonWriter& writer, const SessionInfo& session_info) {
+  writer.begin_object();
+  writer.field("animal1_name", session_info.animal1_name);
+  writer.field("animal2_name", session_info.animal2_name);
+  writer.field("experiment_date", session_info.experiment_date);
+  writer.field("large_reward_volume", session_info.large_juice_volume);
+  writer.field("scheduled_large_reward_volumes", session_info.scheduled_large_juice_volumes);
+  writer.field("scheduled_small_reward_volumes", session_info.scheduled_small_juice_volumes);
+  writer.field("scheduled_task_types", session_info.scheduled_task_types);
+  writer.field("session_seed", session_info.session_seed);
+  writer.field("small_reward_volume", session_info.small_juice_volume);
+  writer.field("task_type", session_info.task_type);
+  writer.field("tasktype_block", session_info.task_type_block);
+  writer.field("tasktype_blocklength", session_info.task_type_blocklength);
+  writer.field("tasktype_random", session_info.task_type_random);
+  writer.end_object();
+}
+
+void write_json(JsonWriter& writer, const LeverReadout& lever_reading) {
+  writer.begin_object();
+  writer.field("potentiometer_lever1", lever_reading.strain_gauge_lever);
+  writer.field("potentiometer_lever2", lever_reading.potentiometer_lever);
+  writer.field("pull_or_release", lever_reading.pull_or_release);
+  writer.field("readout_timepoint", lever_reading.readout_timepoint);
+  writer.field("trial_number", lever_reading.trial_number);
+  writer.end_object();
+}
+
+/*
+ * Session record files
+ */
+
+namespace {
+
+std::string part_file_path(const std::string& file_path) {
+  return file_path + ".part";
+}
+
+} //  anon
+
+bool open_session_record_file(SessionRecordFile* file, const std::string& file_path) {
+  file->file_path = file_path;
+  if (!file->writer.open(part_file_path(file_path))) {
+    return false;
+  }
+  file->writer.begin_array();
+  return true;
+}
+
+bool detail::move_session_record_file(SessionRecordFile* file, bool written) {
+  if (!written) {
+    return false;
+  }
+  //  Renaming over an existing file fails on Windows.
+  (void) std::remove(file->file_path.c_str());
+  return std::rename(part_file_path(file->file_path).c_str(), file->file_path.c_str()) == 0;
+}
+
+void discard_session_record_file(SessionRecordFile* file) {
+  if (file->writer.is_open()) {
+    //  Closing asserts balanced nesting; the array is left open.
+    file->writer.end_array();
+    (void) file->writer.close();
+    (void) std::remove(part_file_path(file->file_path).c_str());
+  }
+}
+
+/*
+ * Write-ahead log
+ */
+
+bool append_session_record(WriteAheadLog* log, const TrialRecord& record) {
+  return append_bytes(log, SessionRecordType::TrialRecord, record);
+}
+
+bool append_session_record(WriteAheadLog* log, const BehaviorData& record) {
+  return append_bytes(log, SessionRecordType::BehaviorData, record);
+}
+
+bool append_session_record(WriteAheadLog* log, const LeverReadout& record) {
+  return append_bytes(log, SessionRecordType::LeverReadout, record);
+}
+
+bool append_session_record(WriteAheadLog* log, const SessionInfo& record) {
+  std::vector<uint8_t> data;
+  put(&data, record.animal1_name);
+  put(&data, record.animal2_name);
+  put(&data, record.experiment_date);
+  put(&data, record.task_type);
+  put(&data, record.task_type_block);
+  put(&data, record.task_type_random);
+  put(&data, record.task_type_blocklength);
+  put(&data, record.large_juice_volume);
+  put(&data, record.small_juice_volume);
+  put(&data, record.session_seed);
+  put(&data, record.scheduled_task_types);
+  put(&data, record.scheduled_large_juice_volumes);
+  put(&data, record.scheduled_small_juice_volumes);
+  return append_record(log, uint32_t(SessionRecordType::SessionInfo), data.data(), uint32_t(data.size()));
+}
+
+bool append_session_end(WriteAheadLog* log) {
+  return append_record(log, uint32_t(SessionRecordType::SessionEnd), nullptr, 0);
+}
+
+bool recover_session(const std::string& wal_file_path, RecoveredSession* session) {
+  std::vector<WalRecord> records;
+  if (!read_write_ahead_log(wal_file_path, &records)) {
+    return false;
+  }
+
+  *session = {};
+  session->num_records = records.size();
+  for (auto& record : records) {
+    bool ok{true};
+    switch (SessionRecordType(record.type)) {
+      case SessionRecordType::SessionInfo: {
+        SessionInfo info;
+        if ((ok = read_session_info(record, &info))) {
+          session->session_info = {std::move(info)};
+        }
+        break;
+      }
+      case SessionRecordType::TrialRecord:
+        ok = read_bytes(record, &session->trial_records.emplace_back());
+        break;
+      case SessionRecordType::BehaviorData:
+        ok = read_bytes(record, &session->behavior_data.emplace_back());
+        break;
+      case SessionRecordType::LeverReadout:
+        ok = read_bytes(record, &session->lever_readout.emplace_back());
+        break;
+      case SessionRecordType::SessionEnd:
+        session->ended = true;
+        break;
+    }
+    if (!ok) {
+      //  Intact but malformed; written by a different build.
+      return false;
+    }
+  }
+  return true;
+}
+
+}
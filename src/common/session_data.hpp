@@ -0,0 +1,194 @@
+#pragma once
+
+#include "chunked_log.hpp"
+#include "json_writer.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ws {
+
+struct WriteAheadLog;
+
+/*
+ * Session data - The records the task logs during a session, their form in the session's JSON
+ * output files, and their encoding in the session's write-ahead log.
+ */
+
+struct TrialRecord {
+  double trial_start_time_stamp;  //  time since the session starts
+  int trial_number;
+  int first_pull_id;
+  int rewarded;
+  int task_type;  //  indicate the task type
+};
+
+struct BehaviorData {
+  int trial_number;
+  double time_points;
+  int behavior_events;
+};
+
+struct SessionInfo {
+  std::string animal1_name;
+  std::string animal2_name;
+  std::string experiment_date;
+  int task_type;
+  int task_type_block;
+  int task_type_random;
+  int task_type_blocklength;
+  float large_juice_volume;
+  float small_juice_volume;
+  uint64_t session_seed;
+  std::vector<int> scheduled_task_types;
+  std::vector<float> scheduled_large_juice_volumes;
+  std::vector<float> scheduled_small_juice_volumes;
+};
+
+struct LeverReadout {
+  int trial_number;
+  double readout_timepoint;
+  float strain_gauge_lever;
+  float potentiometer_lever;
+  int pull_or_release;
+  int lever_id;
+};
+
+/*
+ * JSON
+ */
+
+void write_json(JsonWriter& writer, const TrialRecord& trial);
+void write_json(JsonWriter& writer, const BehaviorData& bhv_data);
+void write_json(JsonWriter& writer, const SessionInfo& session_info);
+void write_json(JsonWriter& writer, const LeverReadout& lever_reading);
+
+template <typename T>
+void write_json(JsonWriter& writer, const std::vector<T>& records);
+template <typename T, int N>
+void write_json(JsonWriter& writer, const ChunkedLog<T, N>& records);
+
+//  Stream `data` to a new file at `file_path`. Returns false if the file cannot be written.
+template <typename T>
+bool save_json(const std::string& file_path, const T& data);
+
+/*
+ * SessionRecordFile - The JSON array file of one of the session's record logs, written as the
+ * session runs: `write_full_chunks` writes out and releases the log's full chunks, so only the
+ * latest chunk of records stays in memory however long the session. Records go to a `.part` file
+ * next to `file_path`, which is moved into place once the file is finished.
+ */
+
+struct SessionRecordFile {
+  std::string file_path;
+  JsonWriter writer;
+};
+
+//  Returns false if the file cannot be created.
+bool open_session_record_file(SessionRecordFile* file, const std::string& file_path);
+//  Does nothing unless the file is open.
+template <typename T, int N>
+void write_full_chunks(SessionRecordFile* file, ChunkedLog<T, N>& records);
+//  Write the remaining records, close the file and move it to its path. Returns false if any
+//  write failed, in which case the `.part` file is kept.
+template <typename T, int N>
+bool finish_session_record_file(SessionRecordFile* file, ChunkedLog<T, N>& records);
+//  Close the file, if open, and delete it.
+void discard_session_record_file(SessionRecordFile* file);
+
+/*
+ * Write-ahead log
+ */
+
+enum class SessionRecordType : uint32_t {
+  SessionInfo = 1,
+  TrialRecord,
+  BehaviorData,
+  LeverReadout,
+  //  Appended once the session's output files are saved.
+  SessionEnd,
+};
+
+bool append_session_record(WriteAheadLog* log, const TrialRecord& record);
+bool append_session_record(WriteAheadLog* log, const BehaviorData& record);
+bool append_session_record(WriteAheadLog* log, const SessionInfo& record);
+bool append_session_record(WriteAheadLog* log, const LeverReadout& record);
+bool append_session_end(WriteAheadLog* log);
+
+struct RecoveredSession {
+  //  The latest session info logged, if any.
+  std::vector<SessionInfo> session_info;
+  std::vector<TrialRecord> trial_records;
+  std::vector<BehaviorData> behavior_data;
+  std::vector<LeverReadout> lever_readout;
+  uint64_t num_records;
+  bool ended;
+};
+
+//  Rebuild a session's records from its write-ahead log, up to the last intact record. Returns
+//  false if the log cannot be read.
+bool recover_session(const std::string& wal_file_path, RecoveredSession* session);
+
+/*
+ * Impl
+ */
+
+template <typename T>
+void write_json(JsonWriter& writer, const std::vector<T>& records) {
+  writer.begin_array();
+  for (auto& record : records) {
+    write_json(writer, record);
+  }
+  writer.end_array();
+}
+
+template <typename T, int N>
+void write_json(JsonWriter& writer, const ChunkedLog<T, N>& records) {
+  writer.begin_array();
+  records.for_each([&writer](const T& record) {
+    write_json(writer, record);
+  });
+  writer.end_array();
+}
+
+template <typename T>
+bool save_json(const std::string& file_path, const T& data) {
+  JsonWriter writer;
+  if (!writer.open(file_path)) {
+    return false;
+  }
+  write_json(writer, data);
+  return writer.close();
+}
+
+namespace detail {
+
+bool move_session_record_file(SessionRecordFile* file, bool written);
+
+}
+
+template <typename T, int N>
+void write_full_chunks(SessionRecordFile* file, ChunkedLog<T, N>& records) {
+  if (!file->writer.is_open()) {
+    return;
+  }
+  records.flush_full_chunks([file](const T* elements, int count) {
+    for (int i = 0; i < count; i++) {
+      write_json(file->writer, elements[i]);
+    }
+  });
+}
+
+template <typename T, int N>
+bool finish_session_record_file(SessionRecordFile* file, ChunkedLog<T, N>& records) {
+  if (!file->writer.is_open()) {
+    return false;
+  }
+  records.for_each([file](const T& record) {
+    write_json(file->writer, record);
+  });
+  file->writer.end_array();
+  return detail::move_session_record_file(file, file->writer.close());
+}
+
+}
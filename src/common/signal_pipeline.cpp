@@ -0,0 +1,173 @@
+#include "signal_pipeline.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+namespace ws {
+
+namespace {
+
+void apply_fir(const SignalFilterParams& params, SignalFilterState* state,
+               const float* x, float* y, int count) {
+  const int num_taps = params.num_taps;
+  auto& history = state->history;
+  for (int i = 0; i < count; i++) {
+    history[state->history_index] = x[i];
+    state->history_size = std::min(state->history_size + 1, num_taps);
+
+    //  Until the history fills, normalize by the taps that have inputs, so that the output does not
+    //  ramp up from 0.
+    float sum{};
+    float tap_sum{};
+    int hi = state->history_index;
+    for (int k = 0; k < state->history_size; k++) {
+      sum += params.taps[k] * history[hi];
+      tap_sum += params.taps[k];
+      hi = hi == 0 ? num_taps - 1 : hi - 1;
+    }
+    y[i] = state->history_size < num_taps && tap_sum != 0.0f ? sum / tap_sum : sum;
+    state->history_index = (state->history_index + 1) % num_taps;
+  }
+}
+
+//  Transposed direct form II.
+void apply_biquad(const SignalFilterParams& params, SignalFilterState* state,
+                  const float* x, float* y, int count) {
+  float z1 = state->z1;
+  float z2 = state->z2;
+  for (int i = 0; i < count; i++) {
+    const float in = x[i];
+    const float out = params.b0 * in + z1;
+    z1 = params.b1 * in - params.a1 * out + z2;
+    z2 = params.b2 * in - params.a2 * out;
+    y[i] = out;
+  }
+  state->z1 = z1;
+  state->z2 = z2;
+}
+
+} //  anon
+
+SignalFilterParams make_pass_through_filter() {
+  SignalFilterParams result{};
+  result.type = SignalFilterType::None;
+  return result;
+}
+
+SignalFilterParams make_moving_average_filter(int num_taps) {
+  assert(num_taps > 0 && num_taps <= SignalFilterParams::max_num_taps);
+  SignalFilterParams result{};
+  result.type = SignalFilterType::FIR;
+  result.num_taps = num_taps;
+  for (int i = 0; i < num_taps; i++) {
+    result.taps[i] = 1.0f / float(num_taps);
+  }
+  return result;
+}
+
+SignalFilterParams make_low_pass_filter(float cutoff_hz, float sample_rate_hz, float q) {
+  assert(cutoff_hz > 0.0f && cutoff_hz < 0.5f * sample_rate_hz && q > 0.0f);
+  const double w0 = 2.0 * 3.14159265358979323846 * double(cutoff_hz) / double(sample_rate_hz);
+  const double alpha = std::sin(w0) / (2.0 * double(q));
+  const double cw = std::cos(w0);
+  const double a0 = 1.0 + alpha;
+
+  SignalFilterParams result{};
+  result.type = SignalFilterType::Biquad;
+  result.b0 = float((1.0 - cw) * 0.5 / a0);
+  result.b1 = float((1.0 - cw) / a0);
+  result.b2 = result.b0;
+  result.a1 = float(-2.0 * cw / a0);
+  result.a2 = float((1.0 - alpha) / a0);
+  return result;
+}
+
+SignalPipelineParams make_default_signal_pipeline_params() {
+  SignalPipelineParams result{};
+  result.position_filter = make_pass_through_filter();
+  result.force_filter = make_pass_through_filter();
+  result.num_force_coefficients = 2;
+  result.force_coefficients[0] = 1.0f;
+  result.force_coefficients[1] = 0.0f;
+  return result;
+}
+
+void set_params(SignalPipeline* pipeline, const SignalPipelineParams& params) {
+  *pipeline = {};
+  pipeline->params = params;
+}
+
+void evaluate_polynomial(const float* coeffs, int num_coeffs, const float* x, float* y, int count) {
+  if (num_coeffs == 0) {
+    std::fill(y, y + count, 0.0f);
+    return;
+  }
+  //  One pass over the batch per coefficient: the inner loop has no dependencies between samples.
+  std::fill(y, y + count, coeffs[0]);
+  for (int c = 1; c < num_coeffs; c++) {
+    const float coeff = coeffs[c];
+    for (int i = 0; i < count; i++) {
+      y[i] = y[i] * x[i] + coeff;
+    }
+  }
+}
+
+void apply_filter(const SignalFilterParams& params, SignalFilterState* state,
+                  const float* x, float* y, int count) {
+  switch (params.type) {
+    case SignalFilterType::None: {
+      if (x != y) {
+        std::memmove(y, x, sizeof(float) * size_t(count));
+      }
+      break;
+    }
+    case SignalFilterType::FIR: {
+      apply_fir(params, state, x, y, count);
+      break;
+    }
+    case SignalFilterType::Biquad: {
+      if (state->history_size == 0 && count > 0) {
+        //  Start from steady state at the first input, rather than from 0.
+        const float in = x[0];
+        const float out = in;
+        state->z1 = out - params.b0 * in;
+        state->z2 = params.b2 * in - params.a2 * out;
+        state->history_size = 1;
+      }
+      apply_biquad(params, state, x, y, count);
+      break;
+    }
+    default: {
+      assert(false);
+    }
+  }
+}
+
+void process(SignalPipeline* pipeline, const SignalBatch& batch) {
+  auto& params = pipeline->params;
+  apply_filter(
+    params.position_filter, &pipeline->position_state, batch.raw_position, batch.position,
+    batch.count);
+
+  evaluate_polynomial(
+    params.force_coefficients.data(), params.num_force_coefficients, batch.raw_strain,
+    batch.force, batch.count);
+  apply_filter(params.force_filter, &pipeline->force_state, batch.force, batch.force, batch.count);
+
+  for (int i = 0; i < batch.count; i++) {
+    float velocity{};
+    if (pipeline->has_previous) {
+      const double dt = elapsed_time(pipeline->previous_time, batch.time[i]);
+      if (dt > 0.0) {
+        velocity = float(double(batch.position[i] - pipeline->previous_position) / dt);
+      }
+    }
+    batch.velocity[i] = velocity;
+    pipeline->has_previous = true;
+    pipeline->previous_position = batch.position[i];
+    pipeline->previous_time = batch.time[i];
+  }
+}
+
+}
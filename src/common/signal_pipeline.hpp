@@ -0,0 +1,96 @@
+#pragma once
+
+#include "time.hpp"
+#include <array>
+
+namespace ws {
+
+/*
+ * Signal pipeline - Filtering and calibration of raw lever samples, run on the lever I/O thread.
+ * Samples are processed in batches, as separate arrays per signal, so that the per-sample loops
+ * (polynomial evaluation in particular) can be vectorized by the compiler. The lever worker itself
+ * only ever has one new sample per lever per pass, since the device answers one state per request,
+ * so it runs batches of 1; longer batches only arise when processing recorded samples.
+ *
+ * position: raw potentiometer reading -> position filter -> velocity (per second)
+ * force:    raw strain gauge reading -> calibration polynomial -> force filter
+ */
+
+enum class SignalFilterType {
+  None = 0,
+  FIR,
+  Biquad,
+};
+
+struct SignalFilterParams {
+  static constexpr int max_num_taps = 32;
+
+  SignalFilterType type;
+  //  FIR
+  int num_taps;
+  std::array<float, max_num_taps> taps;
+  //  Biquad, normalized so that a0 = 1.
+  float b0;
+  float b1;
+  float b2;
+  float a1;
+  float a2;
+};
+
+struct SignalPipelineParams {
+  static constexpr int max_num_force_coefficients = 8;
+
+  SignalFilterParams position_filter;
+  SignalFilterParams force_filter;
+  //  Strain gauge reading -> grams, highest order first.
+  int num_force_coefficients;
+  std::array<float, max_num_force_coefficients> force_coefficients;
+};
+
+struct SignalFilterState {
+  std::array<float, SignalFilterParams::max_num_taps> history;
+  int history_index;
+  int history_size;
+  float z1;
+  float z2;
+};
+
+struct SignalPipeline {
+  SignalPipelineParams params;
+  SignalFilterState position_state;
+  SignalFilterState force_state;
+  bool has_previous;
+  float previous_position;
+  TimePoint previous_time;
+};
+
+struct SignalBatch {
+  int count;
+  //  in
+  const float* raw_position;
+  const float* raw_strain;
+  const TimePoint* time;
+  //  out
+  float* position;
+  float* velocity;
+  float* force;
+};
+
+SignalFilterParams make_pass_through_filter();
+//  Equal taps, like the firmware's running average.
+SignalFilterParams make_moving_average_filter(int num_taps);
+//  2nd order Butterworth-style low pass (RBJ cookbook), for a nominal sample rate.
+SignalFilterParams make_low_pass_filter(float cutoff_hz, float sample_rate_hz, float q = 0.7071f);
+//  No filtering, and force = strain gauge reading.
+SignalPipelineParams make_default_signal_pipeline_params();
+
+//  Replaces the parameters and clears filter state.
+void set_params(SignalPipeline* pipeline, const SignalPipelineParams& params);
+void process(SignalPipeline* pipeline, const SignalBatch& batch);
+
+//  y[i] = coeffs[0] * x[i]^(n-1) + ... + coeffs[n-1], by Horner's method.
+void evaluate_polynomial(const float* coeffs, int num_coeffs, const float* x, float* y, int count);
+void apply_filter(const SignalFilterParams& params, SignalFilterState* state,
+                  const float* x, float* y, int count);
+
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstdint>
+#include <optional>
+
+namespace ws {
+
+/*
+ * SlotMap - Fixed-capacity storage for up to N elements, addressed by generational keys. Elements
+ * are constructed in place in one contiguous array and never move, so they need not be movable,
+ * and pointers to them stay valid until they are erased. Lookup by key is O(1); a key whose
+ * element has been erased no longer resolves, even after its slot is reused.
+ *
+ * A key packs the slot index into the low 16 bits and the slot's generation into the high 16
+ * bits. Generations start at 1, so 0 is never a valid key.
+ */
+
+template <typename T, int N>
+class SlotMap {
+  static_assert(N > 0 && N <= 0xffff, "Expected 0 < N <= 0xffff.");
+
+  static constexpr uint32_t index_bits = 16;
+  static constexpr uint32_t index_mask = (1u << index_bits) - 1;
+
+  struct Slot {
+    std::optional<T> value;
+    uint16_t generation{1};
+    uint16_t live_index{};
+  };
+
+public:
+  SlotMap();
+
+  //  Default-constructs a new element and returns its key, or nullopt if the map is full.
+  std::optional<uint32_t> insert();
+  bool erase(uint32_t key);
+  void clear();
+
+  T* find(uint32_t key);
+  const T* find(uint32_t key) const;
+
+  //  Live elements in insertion order, modulo erasures (erase swaps the last element into the
+  //  erased position).
+  int size() const {
+    return num_live;
+  }
+  uint32_t key_at(int i) const;
+  T& at(int i);
+  const T& at(int i) const;
+
+  static constexpr int capacity() {
+    return N;
+  }
+  static constexpr int index_of(uint32_t key) {
+    return int(key & index_mask);
+  }
+
+private:
+  uint32_t make_key(uint32_t index) const {
+    return (uint32_t(slots[index].generation) << index_bits) | index;
+  }
+
+private:
+  std::array<Slot, N> slots;
+  std::array<uint16_t, N> live;
+  std::array<uint16_t, N> free;
+  int num_live{};
+  int num_free{};
+};
+
+/*
+ * Impl
+ */
+
+template <typename T, int N>
+SlotMap<T, N>::SlotMap() {
+  //  Hand out low indices first.
+  for (int i = 0; i < N; i++) {
+    free[i] = uint16_t(N - 1 - i);
+  }
+  num_free = N;
+}
+
+template <typename T, int N>
+std::optional<uint32_t> SlotMap<T, N>::insert() {
+  if (num_free == 0) {
+    return std::nullopt;
+  }
+
+  const uint16_t index = free[--num_free];
+  auto& slot = slots[index];
+  assert(!slot.value);
+  slot.value.emplace();
+  slot.live_index = uint16_t(num_live);
+  live[num_live++] = index;
+  return make_key(index);
+}
+
+template <typename T, int N>
+bool SlotMap<T, N>::erase(uint32_t key) {
+  if (!find(key)) {
+    return false;
+  }
+
+  const auto index = uint16_t(index_of(key));
+  auto& slot = slots[index];
+  slot.value.reset();
+  slot.generation = uint16_t(slot.generation == 0xffff ? 1 : slot.generation + 1);
+
+  const uint16_t last = live[--num_live];
+  live[slot.live_index] = last;
+  slots[last].live_index = slot.live_index;
+  free[num_free++] = index;
+  return true;
+}
+
+template <typename T, int N>
+void SlotMap<T, N>::clear() {
+  while (num_live > 0) {
+    erase(key_at(num_live - 1));
+  }
+}
+
+template <typename T, int N>
+T* SlotMap<T, N>::find(uint32_t key) {
+  const uint32_t index = key & index_mask;
+  if (index >= uint32_t(N)) {
+    return nullptr;
+  }
+  auto& slot = slots[index];
+  return slot.value && make_key(index) == key ? &slot.value.value() : nullptr;
+}
+
+template <typename T, int N>
+const T* SlotMap<T, N>::find(uint32_t key) const {
+  return const_cast<SlotMap*>(this)->find(key);
+}
+
+template <typename T, int N>
+uint32_t SlotMap<T, N>::key_at(int i) const {
+  assert(i >= 0 && i < num_live);
+  return make_key(live[i]);
+}
+
+template <typename T, int N>
+T& SlotMap<T, N>::at(int i) {
+  assert(i >= 0 && i < num_live);
+  return slots[live[i]].value.value();
+}
+
+template <typename T, int N>
+const T& SlotMap<T, N>::at(int i) const {
+  assert(i >= 0 && i < num_live);
+  return slots[live[i]].value.value();
+}
+
+}
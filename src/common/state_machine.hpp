@@ -0,0 +1,148 @@
+#pragma once
+
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace ws::fsm {
+
+/*
+ * StateMachine - A finite state machine whose states are types. The current state is held in a
+ * std::variant, and transitions are declared as a table of (From, Event, To) triples that is
+ * resolved when the machine is instantiated: ticking a state is a single visit, and the state an
+ * event leads to is known at compile time.
+ *
+ * A state is default-constructed each time it is entered, so its data is reset on entry rather
+ * than kept in statics. A state provides
+ *
+ *   Emits<Events...> tick(Context& context);  //  Return NoEvent (i.e., {}) to stay in the state.
+ *   void enter(Context& context);             //  Optional; called when the state is entered.
+ *
+ * Every event a state can emit from `tick` must have a transition in the table. Events raised
+ * from outside the machine with `dispatch` are ignored by states that have no transition for
+ * them.
+ */
+
+struct NoEvent {};
+
+template <typename... Events>
+using Emits = std::variant<NoEvent, Events...>;
+
+template <typename From, typename Event, typename To>
+struct Transition {
+  using from = From;
+  using event = Event;
+  using to = To;
+};
+
+template <typename... Transitions>
+struct TransitionTable {};
+
+namespace detail {
+
+template <typename From, typename Event, typename Table>
+struct FindTransition {
+  using type = void;
+};
+
+template <typename From, typename Event, typename T, typename... Rest>
+struct FindTransition<From, Event, TransitionTable<T, Rest...>> {
+  using type = std::conditional_t<
+    std::is_same_v<typename T::from, From> && std::is_same_v<typename T::event, Event>,
+    typename T::to,
+    typename FindTransition<From, Event, TransitionTable<Rest...>>::type>;
+};
+
+template <typename State, typename Context, typename = void>
+struct HasEnter : std::false_type {};
+
+template <typename State, typename Context>
+struct HasEnter<State, Context, std::void_t<
+  decltype(std::declval<State&>().enter(std::declval<Context&>()))>> : std::true_type {};
+
+}
+
+//  The state reached from `From` on `Event`, or void if the table has no such transition.
+template <typename From, typename Event, typename Table>
+using next_state_t = typename detail::FindTransition<From, Event, Table>::type;
+
+template <typename Table, typename... States>
+class StateMachine {
+public:
+  //  Enter the initial state (the first of `States`).
+  template <typename Context>
+  void start(Context& context);
+
+  template <typename Context>
+  void tick(Context& context);
+
+  //  Returns true if the current state had a transition on `Event`.
+  template <typename Event, typename Context>
+  bool dispatch(Context& context);
+
+  template <typename State>
+  bool is_in() const {
+    return std::holds_alternative<State>(state);
+  }
+
+private:
+  template <typename To, typename Context>
+  void transition(Context& context);
+
+private:
+  std::variant<States...> state;
+};
+
+/*
+ * Impl
+ */
+
+template <typename Table, typename... States>
+template <typename To, typename Context>
+void StateMachine<Table, States...>::transition(Context& context) {
+  auto& to = state.template emplace<To>();
+  if constexpr (detail::HasEnter<To, Context>::value) {
+    to.enter(context);
+  }
+}
+
+template <typename Table, typename... States>
+template <typename Context>
+void StateMachine<Table, States...>::start(Context& context) {
+  using Initial = std::variant_alternative_t<0, std::variant<States...>>;
+  transition<Initial>(context);
+}
+
+template <typename Table, typename... States>
+template <typename Context>
+void StateMachine<Table, States...>::tick(Context& context) {
+  std::visit([this, &context](auto& current) {
+    using From = std::decay_t<decltype(current)>;
+    //  `current` is destroyed by a transition, so don't touch it after this.
+    auto emitted = current.tick(context);
+    std::visit([this, &context](auto event) {
+      using Event = decltype(event);
+      if constexpr (!std::is_same_v<Event, NoEvent>) {
+        using To = next_state_t<From, Event, Table>;
+        static_assert(!std::is_void_v<To>, "No transition for an event emitted by `tick`.");
+        transition<To>(context);
+      }
+    }, emitted);
+  }, state);
+}
+
+template <typename Table, typename... States>
+template <typename Event, typename Context>
+bool StateMachine<Table, States...>::dispatch(Context& context) {
+  return std::visit([this, &context](auto& current) {
+    using To = next_state_t<std::decay_t<decltype(current)>, Event, Table>;
+    if constexpr (std::is_void_v<To>) {
+      return false;
+    } else {
+      transition<To>(context);
+      return true;
+    }
+  }, state);
+}
+
+}
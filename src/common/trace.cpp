@@ -0,0 +1,327 @@
+#include "trace.hpp"
+#include "json_writer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define WS_TRACE_USE_TSC (1)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#else
+#define WS_TRACE_USE_TSC (0)
+#endif
+
+namespace ws {
+
+namespace {
+
+enum class EventType : uint32_t {
+  Begin,
+  End,
+  Counter,
+};
+
+struct Event {
+  int64_t ticks;
+  const char* name;
+  double value;
+  EventType type;
+};
+
+//  Events kept per thread; a power of 2.
+constexpr uint64_t buffer_capacity = uint64_t(1) << 15;
+
+} //  anon
+
+struct trace::ThreadBuffer {
+  std::unique_ptr<Event[]> events{std::make_unique<Event[]>(buffer_capacity)};
+  //  Number of events written; event i is at i % buffer_capacity. Written by the owning thread.
+  std::atomic<uint64_t> head{};
+  //  Whether a live thread owns the buffer. The buffer of a thread that has exited keeps its
+  //  events until another thread takes it over.
+  std::atomic<bool> in_use{};
+  uint32_t thread_id{};
+  //  Guarded by `globals.mutex`.
+  char name[32]{};
+};
+
+namespace {
+
+using trace::ThreadBuffer;
+
+//  Releases the thread's buffer when the thread exits.
+struct ThreadBufferHolder {
+  ~ThreadBufferHolder() {
+    if (buffer) {
+      buffer->in_use.store(false);
+    }
+  }
+
+  ThreadBuffer* buffer{};
+};
+
+int64_t steady_now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//  Event times are read from the CPU's timestamp counter where there is one, which costs less than
+//  the OS clock, and converted to nanoseconds when the trace is written, against two readings of
+//  the clock: one at startup and one at the time of writing.
+int64_t read_ticks() {
+#if WS_TRACE_USE_TSC
+  return int64_t(__rdtsc());
+#else
+  return steady_now_ns();
+#endif
+}
+
+struct ClockReading {
+  int64_t ticks;
+  int64_t ns;
+};
+
+ClockReading read_clock() {
+  return ClockReading{read_ticks(), steady_now_ns()};
+}
+
+struct {
+  std::atomic<bool> enabled{};
+  //  Guards the list of buffers, and buffers changing owner.
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+  uint32_t next_thread_id{1};
+  ClockReading startup_clock{read_clock()};
+} globals;
+
+//  Kept separate from the holder, which has a destructor, so that reading it is a plain load.
+thread_local ThreadBuffer* thread_buffer{};
+thread_local ThreadBufferHolder thread_buffer_holder;
+//  Until the thread has a buffer.
+thread_local char thread_name[32];
+
+//  Named `name`, if not empty, or after its thread id.
+ThreadBuffer* acquire_thread_buffer(const char* name) {
+  std::lock_guard<std::mutex> lock(globals.mutex);
+  ThreadBuffer* result{};
+  for (auto& buff : globals.buffers) {
+    if (!buff->in_use.load()) {
+      result = buff.get();
+      result->head.store(0);
+      break;
+    }
+  }
+  if (!result) {
+    result = globals.buffers.emplace_back(std::make_unique<ThreadBuffer>()).get();
+  }
+  result->in_use.store(true);
+  result->thread_id = globals.next_thread_id++;
+  if (name[0]) {
+    std::snprintf(result->name, sizeof(result->name), "%s", name);
+  } else {
+    std::snprintf(result->name, sizeof(result->name), "thread %u", result->thread_id);
+  }
+  return result;
+}
+
+ThreadBuffer* get_thread_buffer() {
+  if (!thread_buffer) {
+    //  Once per thread.
+    thread_buffer = acquire_thread_buffer(thread_name);
+    thread_buffer_holder.buffer = thread_buffer;
+  }
+  return thread_buffer;
+}
+
+void push_event(EventType type, const char* name, double value) {
+  auto* buff = get_thread_buffer();
+  const uint64_t head = buff->head.load(std::memory_order_relaxed);
+  auto& event = buff->events[head & (buffer_capacity - 1)];
+  event.ticks = read_ticks();
+  event.name = name;
+  event.value = value;
+  event.type = type;
+  buff->head.store(head + 1, std::memory_order_release);
+}
+
+struct ThreadEvents {
+  uint32_t thread_id;
+  std::string name;
+  std::vector<Event> events;
+};
+
+//  Copy the events still in the buffer. The owner keeps writing meanwhile, so events that may have
+//  been overwritten during the copy are dropped afterwards.
+void copy_events(const ThreadBuffer& buff, std::vector<Event>* dst) {
+  const uint64_t head = buff.head.load(std::memory_order_acquire);
+  const uint64_t begin = head > buffer_capacity ? head - buffer_capacity : 0;
+  dst->resize(head - begin);
+  for (uint64_t i = begin; i < head; i++) {
+    (*dst)[i - begin] = buff.events[i & (buffer_capacity - 1)];
+  }
+
+  //  Including the slot of the event being written, if any.
+  const uint64_t head_after = buff.head.load(std::memory_order_acquire) + 1;
+  if (head_after - begin > buffer_capacity) {
+    const auto num_overwritten = std::min(head_after - begin - buffer_capacity, head - begin);
+    dst->erase(dst->begin(), dst->begin() + ptrdiff_t(num_overwritten));
+  }
+}
+
+void write_event(JsonWriter& writer, uint32_t thread_id, const Event& event, int64_t t0_ticks,
+                 double us_per_tick) {
+  //  Chrome trace timestamps are in microseconds.
+  const double ts = double(event.ticks - t0_ticks) * us_per_tick;
+  writer.begin_object();
+  switch (event.type) {
+    case EventType::Begin:
+      writer.field("name", event.name);
+      writer.field("ph", "B");
+      break;
+    case EventType::End:
+      writer.field("ph", "E");
+      break;
+    case EventType::Counter:
+      writer.key("args");
+      writer.begin_object();
+      writer.field("value", event.value);
+      writer.end_object();
+      writer.field("name", event.name);
+      writer.field("ph", "C");
+      break;
+  }
+  writer.field("pid", 1);
+  writer.field("tid", thread_id);
+  writer.field("ts", ts);
+  writer.end_object();
+}
+
+void write_thread_name(JsonWriter& writer, const ThreadEvents& thread) {
+  writer.begin_object();
+  writer.key("args");
+  writer.begin_object();
+  writer.field("name", thread.name);
+  writer.end_object();
+  writer.field("name", "thread_name");
+  writer.field("ph", "M");
+  writer.field("pid", 1);
+  writer.field("tid", thread.thread_id);
+  writer.end_object();
+}
+
+} //  anon
+
+void trace::set_enabled(bool enabled) {
+  globals.enabled.store(enabled);
+}
+
+bool trace::is_enabled() {
+  return globals.enabled.load(std::memory_order_relaxed);
+}
+
+bool trace::begin_zone(const char* name) {
+  if (!is_enabled()) {
+    return false;
+  }
+  push_event(EventType::Begin, name, 0.0);
+  return true;
+}
+
+void trace::end_zone() {
+  push_event(EventType::End, nullptr, 0.0);
+}
+
+void trace::counter(const char* name, double value) {
+  if (is_enabled()) {
+    push_event(EventType::Counter, name, value);
+  }
+}
+
+void trace::set_thread_name(const char* name) {
+  std::snprintf(thread_name, sizeof(thread_name), "%s", name);
+  if (thread_buffer) {
+    std::lock_guard<std::mutex> lock(globals.mutex);
+    std::memcpy(thread_buffer->name, thread_name, sizeof(thread_buffer->name));
+  }
+}
+
+trace::ThreadBuffer* trace::reserve_thread_buffer(const char* name) {
+  return acquire_thread_buffer(name);
+}
+
+void trace::use_thread_buffer(ThreadBuffer* buffer) {
+  thread_buffer = buffer;
+}
+
+void trace::release_thread_buffer(ThreadBuffer* buffer) {
+  buffer->in_use.store(false);
+}
+
+trace::TraceStats trace::read_trace_stats() {
+  std::lock_guard<std::mutex> lock(globals.mutex);
+  TraceStats result{};
+  for (auto& buff : globals.buffers) {
+    const uint64_t head = buff->head.load(std::memory_order_relaxed);
+    result.num_threads += buff->in_use.load() ? 1 : 0;
+    result.num_events += std::min(head, buffer_capacity);
+    result.num_overwritten += head - std::min(head, buffer_capacity);
+  }
+  return result;
+}
+
+bool trace::write_chrome_trace(const std::string& file_path) {
+  std::vector<ThreadEvents> threads;
+  {
+    std::lock_guard<std::mutex> lock(globals.mutex);
+    for (auto& buff : globals.buffers) {
+      auto& thread = threads.emplace_back();
+      thread.thread_id = buff->thread_id;
+      thread.name = buff->name;
+      copy_events(*buff, &thread.events);
+    }
+  }
+
+  int64_t t0_ticks = std::numeric_limits<int64_t>::max();
+  for (auto& thread : threads) {
+    if (!thread.events.empty()) {
+      t0_ticks = std::min(t0_ticks, thread.events[0].ticks);
+    }
+  }
+
+  const auto clock = read_clock();
+  const auto& startup_clock = globals.startup_clock;
+  double us_per_tick = 1e-3;
+  if (clock.ticks > startup_clock.ticks && clock.ns > startup_clock.ns) {
+    us_per_tick = 1e-3 * double(clock.ns - startup_clock.ns) / double(clock.ticks - startup_clock.ticks);
+  }
+
+  JsonWriter writer;
+  if (!writer.open(file_path)) {
+    return false;
+  }
+  writer.begin_object();
+  writer.field("displayTimeUnit", "ms");
+  writer.key("traceEvents");
+  writer.begin_array();
+  for (auto& thread : threads) {
+    write_thread_name(writer, thread);
+    for (auto& event : thread.events) {
+      write_event(writer, thread.thread_id, event, t0_ticks, us_per_tick);
+    }
+  }
+  writer.end_array();
+  writer.end_object();
+  return writer.close();
+}
+
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace ws::trace {
+
+/*
+ * Trace - Timestamped zones and counters from any thread, for seeing what the main loop and the
+ * device threads are doing in time. Written out as Chrome trace JSON, which chrome://tracing and
+ * ui.perfetto.dev open.
+ *
+ * Each thread appends events to its own fixed-size ring of its most recent events, with no locks,
+ * and no allocation after the thread's first event; an event costs a timestamp counter read and a
+ * few stores. While tracing is off, recording an event is one relaxed atomic load. Names are
+ * stored by pointer, so they must outlive the trace, e.g. string literals.
+ */
+
+struct TraceStats {
+  int num_threads;
+  //  Currently buffered, over all threads.
+  uint64_t num_events;
+  //  Overwritten by newer events before being written out.
+  uint64_t num_overwritten;
+};
+
+void set_enabled(bool enabled);
+bool is_enabled();
+
+//  Returns false, recording nothing, if tracing is off. Each recorded begin must be matched by an
+//  `end_zone` on the same thread.
+bool begin_zone(const char* name);
+void end_zone();
+void counter(const char* name, double value);
+//  Shown for the calling thread in the trace; copied. Does not allocate.
+void set_thread_name(const char* name);
+
+//  A thread's first event takes a lock and allocates its buffer. Threads that must do neither, such
+//  as an audio callback's, instead record into a buffer reserved for them beforehand on another
+//  thread: the realtime thread calls `use_thread_buffer` before its events, which only stores a
+//  pointer, and the buffer is released once the thread no longer records.
+struct ThreadBuffer;
+
+ThreadBuffer* reserve_thread_buffer(const char* thread_name);
+//  The calling thread's following events go to `buffer`. Does not block or allocate.
+void use_thread_buffer(ThreadBuffer* buffer);
+//  Its events are kept until another thread takes the buffer over.
+void release_thread_buffer(ThreadBuffer* buffer);
+
+TraceStats read_trace_stats();
+//  Write every buffered event. Returns false if the file cannot be written.
+bool write_chrome_trace(const std::string& file_path);
+
+class Zone {
+public:
+  explicit Zone(const char* name) : active{begin_zone(name)} {}
+  ~Zone() {
+    if (active) {
+      end_zone();
+    }
+  }
+
+  Zone(const Zone&) = delete;
+  Zone& operator=(const Zone&) = delete;
+
+private:
+  bool active;
+};
+
+}
+
+#define WS_TRACE_CONCAT_IMPL(a, b) a##b
+#define WS_TRACE_CONCAT(a, b) WS_TRACE_CONCAT_IMPL(a, b)
+//  Trace the rest of the enclosing scope as a zone.
+#define WS_TRACE_ZONE(name) ws::trace::Zone WS_TRACE_CONCAT(ws_trace_zone_, __LINE__){name}
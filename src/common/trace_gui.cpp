@@ -0,0 +1,26 @@
+#include "trace_gui.hpp"
+#include "trace.hpp"
+#include <imgui.h>
+
+namespace ws {
+
+gui::TraceGUIResult gui::render_trace_gui() {
+  gui::TraceGUIResult result{};
+
+  bool enabled = trace::is_enabled();
+  if (ImGui::Checkbox("Enabled", &enabled)) {
+    trace::set_enabled(enabled);
+  }
+
+  auto stats = trace::read_trace_stats();
+  ImGui::Text("Threads: %d", stats.num_threads);
+  ImGui::Text("Buffered events: %llu", (unsigned long long) stats.num_events);
+  ImGui::Text("Overwritten events: %llu", (unsigned long long) stats.num_overwritten);
+
+  if (ImGui::Button("Save")) {
+    result.save_trace = true;
+  }
+  return result;
+}
+
+}
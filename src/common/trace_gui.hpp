@@ -0,0 +1,11 @@
+#pragma once
+
+namespace ws::gui {
+
+struct TraceGUIResult {
+  bool save_trace;
+};
+
+TraceGUIResult render_trace_gui();
+
+}
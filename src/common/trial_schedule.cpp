@@ -0,0 +1,109 @@
+#include "trial_schedule.hpp"
+#include "random.hpp"
+#include <algorithm>
+#include <cassert>
+
+namespace ws {
+
+namespace {
+
+bool exceeds_run(const TrialScheduleParams& params, int condition, int run_condition,
+                 int run_length) {
+  return params.max_run_length > 0 && condition == run_condition &&
+    run_length >= params.max_run_length;
+}
+
+//  The condition of each unit of the schedule: a trial for TrialOrder::Random, otherwise a block.
+std::vector<int> make_unit_conditions(const TrialScheduleParams& params, int num_units) {
+  const int num_conditions = int(params.conditions.size());
+  std::vector<int> result(num_units);
+
+  if (params.order == TrialOrder::Blocked) {
+    for (int i = 0; i < num_units; i++) {
+      result[i] = (params.first_condition + i) % num_conditions;
+    }
+    return result;
+  }
+
+  std::vector<int> all_conditions(num_conditions);
+  for (int i = 0; i < num_conditions; i++) {
+    all_conditions[i] = i;
+  }
+
+  std::vector<int> remaining;
+  std::vector<int> candidates;
+  int run_condition{-1};
+  int run_length{};
+
+  for (int i = 0; i < num_units; i++) {
+    if (params.balanced && remaining.empty()) {
+      remaining = all_conditions;
+    }
+    const auto& pool = params.balanced ? remaining : all_conditions;
+
+    candidates.clear();
+    for (int condition : pool) {
+      if (!exceeds_run(params, condition, run_condition, run_length)) {
+        candidates.push_back(condition);
+      }
+    }
+    if (candidates.empty()) {
+      //  Balance and run length conflict; keep the balance.
+      candidates = pool;
+    }
+
+    auto stream = make_random_stream(params.seed, uint64_t(i));
+    const int condition = candidates[random_int(&stream, int(candidates.size()))];
+    if (params.balanced) {
+      remaining.erase(std::find(remaining.begin(), remaining.end(), condition));
+    }
+
+    run_length = condition == run_condition ? run_length + 1 : 1;
+    run_condition = condition;
+    result[i] = condition;
+  }
+
+  return result;
+}
+
+} //  anon
+
+TrialSchedule make_trial_schedule(const TrialScheduleParams& params) {
+  assert(!params.conditions.empty() && params.num_trials >= 0);
+  assert(params.order == TrialOrder::Random || params.block_length > 0);
+
+  const int trials_per_unit = params.order == TrialOrder::Random ? 1 : params.block_length;
+  const int num_units = (params.num_trials + trials_per_unit - 1) / trials_per_unit;
+  const auto unit_conditions = make_unit_conditions(params, num_units);
+
+  TrialSchedule result;
+  result.condition.resize(params.num_trials);
+  result.large_juice_volume.resize(params.num_trials);
+  result.small_juice_volume.resize(params.num_trials);
+  result.juice2_delay_ms.resize(params.num_trials);
+
+  for (int i = 0; i < params.num_trials; i++) {
+    const int condition = unit_conditions[i / trials_per_unit];
+    const auto& info = params.conditions[condition];
+    result.condition[i] = condition;
+    result.large_juice_volume[i] = info.large_juice_volume;
+    result.small_juice_volume[i] = info.small_juice_volume;
+    result.juice2_delay_ms[i] = info.juice2_delay_ms;
+  }
+
+  return result;
+}
+
+ScheduledTrial trial_at(const TrialSchedule& schedule, int i) {
+  assert(num_trials(schedule) > 0 && i >= 0);
+  i %= num_trials(schedule);
+
+  ScheduledTrial result{};
+  result.condition = schedule.condition[i];
+  result.large_juice_volume = schedule.large_juice_volume[i];
+  result.small_juice_volume = schedule.small_juice_volume[i];
+  result.juice2_delay_ms = schedule.juice2_delay_ms[i];
+  return result;
+}
+
+}
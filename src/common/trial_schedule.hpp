@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace ws {
+
+/*
+ * TrialSchedule - The sequence of trial conditions for a whole session, generated up front from a
+ * seed so that it can be logged with the session and audited, and so that the task only has to
+ * look trial N up rather than decide it.
+ *
+ * Conditions are indices into `TrialScheduleParams::conditions`, each of which carries the juice
+ * volumes and delays for trials of that condition. Trials are stored as a structure of flat
+ * arrays. Random draws for trial (or, for block orders, block) i come from the stream keyed by
+ * (seed, i).
+ */
+
+enum class TrialOrder {
+  //  Conditions alternate in blocks of `block_length` trials, starting with `first_condition`.
+  Blocked = 0,
+  //  Each trial's condition is drawn at random.
+  Random,
+  //  Each block's condition is drawn at random.
+  RandomBlocks,
+};
+
+struct TrialCondition {
+  float large_juice_volume;
+  float small_juice_volume;
+  int juice2_delay_ms;
+};
+
+struct TrialScheduleParams {
+  int num_trials;
+  uint64_t seed;
+  TrialOrder order;
+  std::vector<TrialCondition> conditions;
+  int first_condition;
+  int block_length;
+  //  Random orders: at most this many consecutive trials (or blocks) of the same condition; 0 for
+  //  no limit.
+  int max_run_length;
+  //  Random orders: draw without replacement, so that each run of `conditions.size()` trials (or
+  //  blocks) has each condition exactly once, subject to `max_run_length`.
+  bool balanced;
+};
+
+struct ScheduledTrial {
+  int condition;
+  float large_juice_volume;
+  float small_juice_volume;
+  int juice2_delay_ms;
+};
+
+struct TrialSchedule {
+  std::vector<int> condition;
+  std::vector<float> large_juice_volume;
+  std::vector<float> small_juice_volume;
+  std::vector<int> juice2_delay_ms;
+};
+
+TrialSchedule make_trial_schedule(const TrialScheduleParams& params);
+
+inline int num_trials(const TrialSchedule& schedule) {
+  return int(schedule.condition.size());
+}
+
+//  Trial `i` of the schedule. Sessions that run past the end of the schedule wrap around to its
+//  start. Requires a non-empty schedule.
+ScheduledTrial trial_at(const TrialSchedule& schedule, int i);
+
+}
@@ -0,0 +1,541 @@
+#include "waveform_store.hpp"
+#include "channel.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <thread>
+
+namespace ws {
+
+namespace {
+
+constexpr char file_magic[4]{'W', 'S', 'W', 'F'};
+constexpr uint64_t file_version = 1;
+constexpr int channel_capacity = 8192;
+//  Quantized values are clamped to +/- 2^53, beyond which doubles no longer hold every integer.
+constexpr double max_quantized = 9007199254740992.0;
+
+struct LeverBlock {
+  uint32_t lever;
+  std::vector<WaveformSample> samples;
+};
+
+struct ChannelCoding {
+  float step;
+  //  1: store differences of successive values. 2: store differences of those differences.
+  uint8_t order;
+};
+
+std::array<ChannelCoding, num_waveform_channels> make_channel_codings(const WaveformWriterParams& params) {
+  std::array<ChannelCoding, num_waveform_channels> result{};
+  result[int(WaveformChannel::Time)] = {1.0f, 2};
+  result[int(WaveformChannel::StrainGauge)] = {params.strain_gauge_step, 1};
+  result[int(WaveformChannel::Potentiometer)] = {params.potentiometer_step, 1};
+  result[int(WaveformChannel::CalculatedPwm)] = {params.pwm_step, 1};
+  result[int(WaveformChannel::ActualPwm)] = {params.pwm_step, 1};
+  result[int(WaveformChannel::Force)] = {params.force_step, 1};
+  return result;
+}
+
+int64_t quantize(float v, float step) {
+  const double q = double(v) / double(step);
+  if (!std::isfinite(q)) {
+    return 0;
+  }
+  return int64_t(std::llround(std::clamp(q, -max_quantized, max_quantized)));
+}
+
+float channel_value(const WaveformSample& sample, WaveformChannel channel) {
+  switch (channel) {
+    case WaveformChannel::StrainGauge:
+      return sample.strain_gauge;
+    case WaveformChannel::Potentiometer:
+      return sample.potentiometer;
+    case WaveformChannel::CalculatedPwm:
+      return sample.calculated_pwm;
+    case WaveformChannel::ActualPwm:
+      return sample.actual_pwm;
+    case WaveformChannel::Force:
+      return sample.force;
+    default:
+      assert(false);
+      return 0.0f;
+  }
+}
+
+std::vector<float>* channel_values(LeverWaveform* waveform, WaveformChannel channel) {
+  switch (channel) {
+    case WaveformChannel::StrainGauge:
+      return &waveform->strain_gauge;
+    case WaveformChannel::Potentiometer:
+      return &waveform->potentiometer;
+    case WaveformChannel::CalculatedPwm:
+      return &waveform->calculated_pwm;
+    case WaveformChannel::ActualPwm:
+      return &waveform->actual_pwm;
+    case WaveformChannel::Force:
+      return &waveform->force;
+    default:
+      assert(false);
+      return nullptr;
+  }
+}
+
+uint64_t zigzag(int64_t v) {
+  return (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+}
+
+int64_t unzigzag(uint64_t v) {
+  return int64_t(v >> 1) ^ -int64_t(v & 1);
+}
+
+int bit_width(uint64_t v) {
+  int result{};
+  while (v) {
+    v >>= 1;
+    result++;
+  }
+  return result;
+}
+
+/*
+ * Encoding
+ */
+
+void put_byte(std::vector<uint8_t>* out, uint8_t v) {
+  out->push_back(v);
+}
+
+void put_varint(std::vector<uint8_t>* out, uint64_t v) {
+  while (v >= 0x80) {
+    put_byte(out, uint8_t(v | 0x80));
+    v >>= 7;
+  }
+  put_byte(out, uint8_t(v));
+}
+
+void put_float(std::vector<uint8_t>* out, float v) {
+  uint32_t bits;
+  std::memcpy(&bits, &v, sizeof(bits));
+  for (int i = 0; i < 4; i++) {
+    put_byte(out, uint8_t(bits >> (8 * i)));
+  }
+}
+
+//  Pack the low `width` bits of each value, least significant bit first.
+void put_bits(std::vector<uint8_t>* out, const uint64_t* values, int count, int width) {
+  const size_t begin = out->size();
+  out->resize(begin + (size_t(count) * size_t(width) + 7) / 8);
+  uint8_t* dst = out->data() + begin;
+  size_t bit{};
+  for (int i = 0; i < count; i++) {
+    for (int b = 0; b < width;) {
+      const int byte_bit = int(bit & 7);
+      const int take = std::min(width - b, 8 - byte_bit);
+      const auto chunk = uint8_t((values[i] >> b) & ((1u << take) - 1));
+      dst[bit >> 3] |= uint8_t(chunk << byte_bit);
+      bit += size_t(take);
+      b += take;
+    }
+  }
+}
+
+//  Residuals of `q` at the channel's order, zigzag encoded, after the `order` leading terms.
+int make_residuals(const int64_t* q, int count, int order, uint64_t* residuals) {
+  int num_residuals{};
+  for (int i = order; i < count; i++) {
+    int64_t d = q[i] - q[i - 1];
+    if (order == 2) {
+      d -= q[i - 1] - q[i - 2];
+    }
+    residuals[num_residuals++] = zigzag(d);
+  }
+  return num_residuals;
+}
+
+void encode_channel(std::vector<uint8_t>* out, const int64_t* q, int count, int order) {
+  uint64_t residuals[waveform_block_size];
+  put_varint(out, zigzag(q[0]));
+  if (order == 2 && count > 1) {
+    put_varint(out, zigzag(q[1] - q[0]));
+  }
+  const int num_residuals = count > order ? make_residuals(q, count, order, residuals) : 0;
+  uint64_t max_residual{};
+  for (int i = 0; i < num_residuals; i++) {
+    max_residual = std::max(max_residual, residuals[i]);
+  }
+  const int width = bit_width(max_residual);
+  put_byte(out, uint8_t(width));
+  put_bits(out, residuals, num_residuals, width);
+}
+
+//  Block: varint byte size of the rest of the block, varint lever, varint sample count, then each
+//  channel in turn.
+void encode_block(std::vector<uint8_t>* out, const LeverBlock& block,
+                  const std::array<ChannelCoding, num_waveform_channels>& codings) {
+  const int count = int(block.samples.size());
+  assert(count > 0 && count <= waveform_block_size);
+
+  std::vector<uint8_t> payload;
+  put_varint(&payload, block.lever);
+  put_varint(&payload, uint64_t(count));
+
+  int64_t q[waveform_block_size];
+  for (int c = 0; c < num_waveform_channels; c++) {
+    const auto channel = WaveformChannel(c);
+    for (int i = 0; i < count; i++) {
+      const auto& sample = block.samples[i];
+      q[i] = channel == WaveformChannel::Time ?
+        sample.time_us : quantize(channel_value(sample, channel), codings[c].step);
+    }
+    encode_channel(&payload, q, count, codings[c].order);
+  }
+
+  put_varint(out, payload.size());
+  out->insert(out->end(), payload.begin(), payload.end());
+}
+
+void encode_file_header(std::vector<uint8_t>* out,
+                        const std::array<ChannelCoding, num_waveform_channels>& codings) {
+  out->insert(out->end(), std::begin(file_magic), std::end(file_magic));
+  put_varint(out, file_version);
+  put_varint(out, num_waveform_channels);
+  for (auto& coding : codings) {
+    put_float(out, coding.step);
+    put_byte(out, coding.order);
+  }
+}
+
+/*
+ * Decoding
+ */
+
+struct Reader {
+  const uint8_t* data;
+  size_t size;
+  size_t pos;
+};
+
+bool get_byte(Reader* reader, uint8_t* v) {
+  if (reader->pos >= reader->size) {
+    return false;
+  }
+  *v = reader->data[reader->pos++];
+  return true;
+}
+
+bool get_varint(Reader* reader, uint64_t* v) {
+  uint64_t result{};
+  for (int shift = 0; shift < 64; shift += 7) {
+    uint8_t byte;
+    if (!get_byte(reader, &byte)) {
+      return false;
+    }
+    result |= uint64_t(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      *v = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool get_signed(Reader* reader, int64_t* v) {
+  uint64_t zz;
+  if (!get_varint(reader, &zz)) {
+    return false;
+  }
+  *v = unzigzag(zz);
+  return true;
+}
+
+bool get_float(Reader* reader, float* v) {
+  uint32_t bits{};
+  for (int i = 0; i < 4; i++) {
+    uint8_t byte;
+    if (!get_byte(reader, &byte)) {
+      return false;
+    }
+    bits |= uint32_t(byte) << (8 * i);
+  }
+  std::memcpy(v, &bits, sizeof(bits));
+  return true;
+}
+
+bool get_bits(Reader* reader, uint64_t* values, int count, int width) {
+  const size_t num_bytes = (size_t(count) * size_t(width) + 7) / 8;
+  if (reader->size - reader->pos < num_bytes) {
+    return false;
+  }
+  const uint8_t* src = reader->data + reader->pos;
+  size_t bit{};
+  for (int i = 0; i < count; i++) {
+    uint64_t v{};
+    for (int b = 0; b < width;) {
+      const int byte_bit = int(bit & 7);
+      const int take = std::min(width - b, 8 - byte_bit);
+      const uint64_t chunk = (src[bit >> 3] >> byte_bit) & ((1u << take) - 1);
+      v |= chunk << b;
+      bit += size_t(take);
+      b += take;
+    }
+    values[i] = v;
+  }
+  reader->pos += num_bytes;
+  return true;
+}
+
+bool decode_channel(Reader* reader, int count, int order, int64_t* q) {
+  if (!get_signed(reader, &q[0])) {
+    return false;
+  }
+  int64_t delta{};
+  if (order == 2 && count > 1) {
+    if (!get_signed(reader, &delta)) {
+      return false;
+    }
+    q[1] = q[0] + delta;
+  }
+
+  uint8_t width;
+  uint64_t residuals[waveform_block_size];
+  const int num_residuals = count > order ? count - order : 0;
+  if (!get_byte(reader, &width) || width > 64 ||
+      !get_bits(reader, residuals, num_residuals, width)) {
+    return false;
+  }
+
+  for (int i = order; i < count; i++) {
+    const int64_t r = unzigzag(residuals[i - order]);
+    if (order == 2) {
+      delta += r;
+      q[i] = q[i - 1] + delta;
+    } else {
+      q[i] = q[i - 1] + r;
+    }
+  }
+  return true;
+}
+
+LeverWaveform* find_or_add_waveform(std::vector<LeverWaveform>* waveforms, uint32_t lever) {
+  for (auto& waveform : *waveforms) {
+    if (waveform.lever == lever) {
+      return &waveform;
+    }
+  }
+  auto& result = waveforms->emplace_back();
+  result.lever = lever;
+  return &result;
+}
+
+bool decode_block(Reader* reader, const std::array<ChannelCoding, num_waveform_channels>& codings,
+                  std::vector<LeverWaveform>* waveforms) {
+  uint64_t lever;
+  uint64_t count;
+  if (!get_varint(reader, &lever) || !get_varint(reader, &count) ||
+      count == 0 || count > waveform_block_size) {
+    return false;
+  }
+
+  int64_t q[num_waveform_channels][waveform_block_size];
+  for (int c = 0; c < num_waveform_channels; c++) {
+    if (!decode_channel(reader, int(count), codings[c].order, q[c])) {
+      return false;
+    }
+  }
+
+  auto* waveform = find_or_add_waveform(waveforms, uint32_t(lever));
+  waveform->time_us.insert(waveform->time_us.end(), q[0], q[0] + count);
+  for (int c = 1; c < num_waveform_channels; c++) {
+    auto* values = channel_values(waveform, WaveformChannel(c));
+    for (uint64_t i = 0; i < count; i++) {
+      values->push_back(float(double(q[c][i]) * double(codings[c].step)));
+    }
+  }
+  return true;
+}
+
+bool decode_file_header(Reader* reader, std::array<ChannelCoding, num_waveform_channels>* codings) {
+  if (reader->size < sizeof(file_magic) ||
+      std::memcmp(reader->data, file_magic, sizeof(file_magic)) != 0) {
+    return false;
+  }
+  reader->pos = sizeof(file_magic);
+
+  uint64_t version;
+  uint64_t num_channels;
+  if (!get_varint(reader, &version) || version != file_version ||
+      !get_varint(reader, &num_channels) || num_channels != num_waveform_channels) {
+    return false;
+  }
+  for (auto& coding : *codings) {
+    if (!get_float(reader, &coding.step) || !get_byte(reader, &coding.order) ||
+        coding.order < 1 || coding.order > 2) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} //  anon
+
+/*
+ * WaveformWriter
+ */
+
+struct WaveformWriter {
+  WaveformWriter() : samples{"waveform/samples"} {
+    //
+  }
+
+  //  Pushed to from any thread, e.g. each lever worker.
+  MPSCChannel<WaveformSample, channel_capacity> samples;
+  std::array<ChannelCoding, num_waveform_channels> codings{};
+  std::ofstream file;
+  std::thread thread;
+  std::atomic<bool> keep_processing{};
+  Wakeup wakeup;
+
+  //  Worker thread only.
+  std::vector<LeverBlock> blocks;
+  std::vector<uint8_t> pending;
+};
+
+namespace {
+
+void add_sample(WaveformWriter* writer, const WaveformSample& sample) {
+  LeverBlock* block{};
+  for (auto& candidate : writer->blocks) {
+    if (candidate.lever == sample.lever) {
+      block = &candidate;
+      break;
+    }
+  }
+  if (!block) {
+    block = &writer->blocks.emplace_back();
+    block->lever = sample.lever;
+    block->samples.reserve(waveform_block_size);
+  }
+
+  block->samples.push_back(sample);
+  if (int(block->samples.size()) == waveform_block_size) {
+    encode_block(&writer->pending, *block, writer->codings);
+    block->samples.clear();
+  }
+}
+
+void write_pending(WaveformWriter* writer) {
+  if (!writer->pending.empty()) {
+    writer->file.write(reinterpret_cast<const char*>(writer->pending.data()),
+                       std::streamsize(writer->pending.size()));
+    writer->file.flush();
+    writer->pending.clear();
+  }
+}
+
+void worker(WaveformWriter* writer) {
+  const auto read_samples = [writer]() {
+    writer->samples.read_all([writer](WaveformSample&& sample) {
+      add_sample(writer, sample);
+    });
+  };
+
+  while (writer->keep_processing.load()) {
+    read_samples();
+    write_pending(writer);
+    (void) wait_for(&writer->wakeup, std::chrono::milliseconds(50));
+  }
+
+  read_samples();
+  for (auto& block : writer->blocks) {
+    if (!block.samples.empty()) {
+      encode_block(&writer->pending, block, writer->codings);
+      block.samples.clear();
+    }
+  }
+  write_pending(writer);
+}
+
+} //  anon
+
+WaveformWriterParams make_default_waveform_writer_params() {
+  WaveformWriterParams result{};
+  result.strain_gauge_step = 0.01f;
+  result.potentiometer_step = 1.0f;
+  result.pwm_step = 1.0f;
+  result.force_step = 0.01f;
+  return result;
+}
+
+WaveformWriter* open_waveform_writer(const std::string& file_path,
+                                     const WaveformWriterParams& params) {
+  assert(params.strain_gauge_step > 0.0f && params.potentiometer_step > 0.0f &&
+         params.pwm_step > 0.0f && params.force_step > 0.0f);
+
+  auto* writer = new WaveformWriter();
+  writer->file.open(file_path, std::ios::binary | std::ios::trunc);
+  if (!writer->file.good()) {
+    delete writer;
+    return nullptr;
+  }
+
+  writer->codings = make_channel_codings(params);
+  encode_file_header(&writer->pending, writer->codings);
+  write_pending(writer);
+
+  writer->keep_processing.store(true);
+  writer->thread = std::thread{[writer]() {
+    worker(writer);
+  }};
+  return writer;
+}
+
+int push_waveform_samples(WaveformWriter* writer, const WaveformSample* samples, int count) {
+  return writer->samples.write_range(samples, samples + count);
+}
+
+void close_waveform_writer(WaveformWriter* writer) {
+  writer->keep_processing.store(false);
+  notify(&writer->wakeup);
+  if (writer->thread.joinable()) {
+    writer->thread.join();
+  }
+  delete writer;
+}
+
+bool read_waveform_file(const std::string& file_path, std::vector<LeverWaveform>* waveforms) {
+  std::ifstream file(file_path, std::ios::binary);
+  if (!file.good()) {
+    return false;
+  }
+  const std::vector<uint8_t> data{std::istreambuf_iterator<char>(file),
+                                  std::istreambuf_iterator<char>()};
+
+  Reader reader{data.data(), data.size(), 0};
+  std::array<ChannelCoding, num_waveform_channels> codings{};
+  if (!decode_file_header(&reader, &codings)) {
+    return false;
+  }
+
+  waveforms->clear();
+  uint64_t block_size;
+  while (get_varint(&reader, &block_size) && block_size <= reader.size - reader.pos) {
+    Reader block_reader{reader.data + reader.pos, size_t(block_size), 0};
+    if (!decode_block(&block_reader, codings, waveforms)) {
+      break;
+    }
+    reader.pos += size_t(block_size);
+  }
+
+  std::sort(waveforms->begin(), waveforms->end(), [](auto& a, auto& b) {
+    return a.lever < b.lever;
+  });
+  return true;
+}
+
+}
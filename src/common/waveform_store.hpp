@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ws {
+
+/*
+ * Waveform store - Continuous capture of every lever sample to a compressed file.
+ *
+ * Each channel is quantized to a fixed step, then stored in blocks of up to
+ * `waveform_block_size` samples per lever: the first value (and, for the time channel, the first
+ * difference) as a varint, followed by the differences between successive values (the second
+ * differences, for the time channel), zigzag-encoded and bit-packed at the width of the largest
+ * one in the block. A lever at rest packs to a few bytes per block, and sample times taken at a
+ * steady rate to about a bit per sample.
+ *
+ * Samples are pushed, from any number of threads, into a channel and compressed and written by a
+ * background thread, so capture costs the pushing thread one copy per sample. If the writer falls
+ * behind, samples are dropped and counted in the channel's stats ("waveform/samples").
+ */
+
+constexpr int waveform_block_size = 256;
+
+enum class WaveformChannel {
+  Time = 0,
+  StrainGauge,
+  Potentiometer,
+  CalculatedPwm,
+  ActualPwm,
+  Force,
+  NumChannels,
+};
+
+constexpr int num_waveform_channels = int(WaveformChannel::NumChannels);
+
+struct WaveformSample {
+  uint32_t lever;
+  //  Microseconds since an origin chosen by the caller, e.g. the start of the session.
+  int64_t time_us;
+  float strain_gauge;
+  float potentiometer;
+  float calculated_pwm;
+  float actual_pwm;
+  float force;
+};
+
+struct WaveformWriterParams {
+  //  Quantization step of each channel but time, which is stored in whole microseconds.
+  float strain_gauge_step;
+  float potentiometer_step;
+  float pwm_step;
+  float force_step;
+};
+
+WaveformWriterParams make_default_waveform_writer_params();
+
+struct WaveformWriter;
+
+//  nullptr if the file cannot be opened.
+WaveformWriter* open_waveform_writer(const std::string& file_path,
+                                     const WaveformWriterParams& params);
+//  Callable from any thread. Returns the number of samples queued; the rest were dropped.
+int push_waveform_samples(WaveformWriter* writer, const WaveformSample* samples, int count);
+//  Writes any queued samples and partial blocks, then closes the file and frees `writer`.
+void close_waveform_writer(WaveformWriter* writer);
+
+/*
+ * Reading
+ */
+
+struct LeverWaveform {
+  uint32_t lever;
+  std::vector<int64_t> time_us;
+  std::vector<float> strain_gauge;
+  std::vector<float> potentiometer;
+  std::vector<float> calculated_pwm;
+  std::vector<float> actual_pwm;
+  std::vector<float> force;
+};
+
+//  Decodes a whole file into one waveform per lever, ordered by lever. Returns false if the file
+//  cannot be read or is not a waveform file; a truncated final block is ignored.
+bool read_waveform_file(const std::string& file_path, std::vector<LeverWaveform>* waveforms);
+
+}
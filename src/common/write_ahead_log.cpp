@@ -0,0 +1,275 @@
+#include "write_ahead_log.hpp"
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace ws {
+
+namespace {
+
+constexpr char file_magic[4]{'W', 'S', 'W', 'L'};
+constexpr uint32_t file_version = 1;
+constexpr size_t file_header_size = 16;
+constexpr size_t initial_capacity = 4 * 1024 * 1024;
+constexpr size_t record_alignment = 8;
+
+//  Followed by `size` bytes of payload, then padding to `record_alignment`. The checksum covers
+//  size, type, sequence and payload.
+struct RecordHeader {
+  uint32_t size;
+  uint32_t type;
+  uint64_t sequence;
+  uint32_t crc;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(RecordHeader) == 24);
+
+constexpr std::array<uint32_t, 256> make_crc_table() {
+  std::array<uint32_t, 256> result{};
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; k++) {
+      c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+    }
+    result[i] = c;
+  }
+  return result;
+}
+
+constexpr auto crc_table = make_crc_table();
+
+uint32_t update_crc32(uint32_t crc, const void* data, size_t size) {
+  auto* bytes = static_cast<const uint8_t*>(data);
+  for (size_t i = 0; i < size; i++) {
+    crc = crc_table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+uint32_t record_crc(const RecordHeader& header, const void* data) {
+  uint32_t crc = 0xffffffffu;
+  crc = update_crc32(crc, &header.size, sizeof(header.size));
+  crc = update_crc32(crc, &header.type, sizeof(header.type));
+  crc = update_crc32(crc, &header.sequence, sizeof(header.sequence));
+  crc = update_crc32(crc, data, header.size);
+  return ~crc;
+}
+
+size_t padded_record_size(uint32_t size) {
+  const size_t n = sizeof(RecordHeader) + size;
+  return (n + record_alignment - 1) & ~(record_alignment - 1);
+}
+
+} //  anon
+
+struct WriteAheadLog {
+#ifdef _WIN32
+  HANDLE file{INVALID_HANDLE_VALUE};
+  HANDLE mapping{};
+#else
+  int fd{-1};
+#endif
+  uint8_t* data{};
+  size_t capacity{};
+  size_t size{};
+  uint64_t next_sequence{1};
+};
+
+namespace {
+
+void unmap(WriteAheadLog* log) {
+  if (!log->data) {
+    return;
+  }
+#ifdef _WIN32
+  UnmapViewOfFile(log->data);
+  CloseHandle(log->mapping);
+  log->mapping = nullptr;
+#else
+  munmap(log->data, log->capacity);
+#endif
+  log->data = nullptr;
+}
+
+//  Resize the file to `capacity` bytes and map all of it.
+bool map(WriteAheadLog* log, size_t capacity) {
+  unmap(log);
+#ifdef _WIN32
+  const auto size = uint64_t(capacity);
+  log->mapping = CreateFileMappingA(
+    log->file, nullptr, PAGE_READWRITE, DWORD(size >> 32), DWORD(size & 0xffffffffu), nullptr);
+  if (!log->mapping) {
+    return false;
+  }
+  void* data = MapViewOfFile(log->mapping, FILE_MAP_WRITE, 0, 0, capacity);
+  if (!data) {
+    CloseHandle(log->mapping);
+    log->mapping = nullptr;
+    return false;
+  }
+#else
+  if (ftruncate(log->fd, off_t(capacity)) != 0) {
+    return false;
+  }
+  void* data = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, log->fd, 0);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+#endif
+  log->data = static_cast<uint8_t*>(data);
+  log->capacity = capacity;
+  return true;
+}
+
+void close_file(WriteAheadLog* log) {
+#ifdef _WIN32
+  if (log->file != INVALID_HANDLE_VALUE) {
+    CloseHandle(log->file);
+    log->file = INVALID_HANDLE_VALUE;
+  }
+#else
+  if (log->fd >= 0) {
+    close(log->fd);
+    log->fd = -1;
+  }
+#endif
+}
+
+} //  anon
+
+WriteAheadLog* open_write_ahead_log(const std::string& file_path) {
+  auto* log = new WriteAheadLog();
+#ifdef _WIN32
+  log->file = CreateFileA(file_path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ,
+                          nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  const bool opened = log->file != INVALID_HANDLE_VALUE;
+#else
+  log->fd = open(file_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  const bool opened = log->fd >= 0;
+#endif
+  if (!opened || !map(log, initial_capacity)) {
+    close_file(log);
+    delete log;
+    return nullptr;
+  }
+
+  std::memcpy(log->data, file_magic, sizeof(file_magic));
+  std::memcpy(log->data + sizeof(file_magic), &file_version, sizeof(file_version));
+  log->size = file_header_size;
+  return log;
+}
+
+bool append_record(WriteAheadLog* log, uint32_t type, const void* data, uint32_t size) {
+  if (!log->data) {
+    //  A previous attempt to grow the file failed.
+    return false;
+  }
+  const size_t record_size = padded_record_size(size);
+  if (log->capacity - log->size < record_size) {
+    size_t capacity = log->capacity * 2;
+    while (capacity - log->size < record_size) {
+      capacity *= 2;
+    }
+    if (!map(log, capacity)) {
+      return false;
+    }
+  }
+
+  RecordHeader header{};
+  header.size = size;
+  header.type = type;
+  header.sequence = log->next_sequence++;
+  header.crc = record_crc(header, data);
+
+  uint8_t* dst = log->data + log->size;
+  if (size > 0) {
+    std::memcpy(dst + sizeof(RecordHeader), data, size);
+  }
+  std::memcpy(dst, &header, sizeof(RecordHeader));
+  log->size += record_size;
+  return true;
+}
+
+void flush_write_ahead_log(WriteAheadLog* log) {
+  if (!log->data) {
+    return;
+  }
+#ifdef _WIN32
+  FlushViewOfFile(log->data, log->size);
+  FlushFileBuffers(log->file);
+#else
+  msync(log->data, log->size, MS_SYNC);
+#endif
+}
+
+void close_write_ahead_log(WriteAheadLog* log) {
+  flush_write_ahead_log(log);
+  unmap(log);
+#ifdef _WIN32
+  LARGE_INTEGER size{};
+  size.QuadPart = LONGLONG(log->size);
+  if (SetFilePointerEx(log->file, size, nullptr, FILE_BEGIN)) {
+    SetEndOfFile(log->file);
+  }
+#else
+  (void) ftruncate(log->fd, off_t(log->size));
+#endif
+  close_file(log);
+  delete log;
+}
+
+bool read_write_ahead_log(const std::string& file_path, std::vector<WalRecord>* records) {
+  std::ifstream file(file_path, std::ios::binary);
+  if (!file.good()) {
+    return false;
+  }
+  const std::vector<uint8_t> data{std::istreambuf_iterator<char>(file),
+                                  std::istreambuf_iterator<char>()};
+
+  uint32_t version{};
+  if (data.size() < file_header_size ||
+      std::memcmp(data.data(), file_magic, sizeof(file_magic)) != 0) {
+    return false;
+  }
+  std::memcpy(&version, data.data() + sizeof(file_magic), sizeof(version));
+  if (version != file_version) {
+    return false;
+  }
+
+  records->clear();
+  size_t pos = file_header_size;
+  uint64_t expect_sequence{1};
+  while (pos <= data.size() && data.size() - pos >= sizeof(RecordHeader)) {
+    RecordHeader header;
+    std::memcpy(&header, data.data() + pos, sizeof(RecordHeader));
+    const uint8_t* payload = data.data() + pos + sizeof(RecordHeader);
+    if (header.sequence != expect_sequence ||
+        header.size > data.size() - pos - sizeof(RecordHeader) ||
+        header.crc != record_crc(header, payload)) {
+      break;
+    }
+
+    auto& record = records->emplace_back();
+    record.sequence = header.sequence;
+    record.type = header.type;
+    record.data.assign(payload, payload + header.size);
+    pos += padded_record_size(header.size);
+    expect_sequence++;
+  }
+  return true;
+}
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ws {
+
+/*
+ * WriteAheadLog - Append-only log of typed records in a memory-mapped file, so that data logged
+ * during a session survives the app crashing or being killed before it saves.
+ *
+ * An append copies the record, behind a header with its sequence number and a CRC32 of header and
+ * payload, into the mapped file; there is no system call unless the file has to grow, which it
+ * does by doubling. Once copied, a record belongs to the OS's page cache and survives the process.
+ * Reading stops at the first record whose sequence number or checksum does not match, which is
+ * where a crash interrupted an append. Durability against power loss is only guaranteed up to the
+ * last `flush_write_ahead_log`.
+ */
+
+struct WriteAheadLog;
+
+//  nullptr if the file cannot be created and mapped.
+WriteAheadLog* open_write_ahead_log(const std::string& file_path);
+//  Returns false if the file could not be grown to fit the record.
+bool append_record(WriteAheadLog* log, uint32_t type, const void* data, uint32_t size);
+//  Write the mapped pages to disk; blocks until they are.
+void flush_write_ahead_log(WriteAheadLog* log);
+//  Flush, trim the file to the records written, and close it.
+void close_write_ahead_log(WriteAheadLog* log);
+
+struct WalRecord {
+  uint64_t sequence;
+  uint32_t type;
+  std::vector<uint8_t> data;
+};
+
+//  Read the intact records of a log, in order. Returns false if the file cannot be read or is not
+//  a write-ahead log.
+bool read_write_ahead_log(const std::string& file_path, std::vector<WalRecord>* records);
+
+}
@@ -0,0 +1,131 @@
+#include "common/ringbuffer.hpp"
+#include "common/time.hpp"
+#include <cstdio>
+#include <thread>
+
+/*
+ * SPSC throughput of ws::RingBuffer, compared against the previous implementation (seq_cst
+ * indices on a shared cache line, modulo arithmetic, single-element reads).
+ */
+
+namespace legacy {
+
+template <typename T, int N>
+class RingBuffer {
+public:
+  template <typename U = T>
+  bool maybe_write(U&& element) noexcept {
+    if (num_free() == 0) {
+      return false;
+    }
+    auto w = wp.load();
+    buffer[w] = std::forward<U>(element);
+    wp.store((w + 1) % N);
+    return true;
+  }
+
+  T read() noexcept {
+    auto r = rp.load();
+    T element = std::move(buffer[r]);
+    rp = (r + 1) % N;
+    return element;
+  }
+
+  int size() const noexcept {
+    int rp_value = rp % N;
+    int wp_value = wp % N;
+    return rp_value <= wp_value ? wp_value - rp_value : wp_value + (N - rp_value);
+  }
+
+  int num_free() const noexcept {
+    int rp_value = rp % N;
+    int wp_value = wp % N;
+    return rp_value <= wp_value ? N - (wp_value - rp_value) - 1 : rp_value - wp_value - 1;
+  }
+
+private:
+  std::array<T, N> buffer{};
+  std::atomic<int> rp{0};
+  std::atomic<int> wp{0};
+};
+
+}
+
+namespace {
+
+constexpr int num_elements = 1 << 22;
+constexpr int capacity = 1024;
+constexpr int batch_size = 64;
+
+struct Message {
+  uint64_t sequence;
+  float payload[14];
+};
+
+template <typename Ring>
+void produce(Ring* ring) {
+  for (int i = 0; i < num_elements; i++) {
+    Message message{};
+    message.sequence = uint64_t(i);
+    while (!ring->maybe_write(message)) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+template <typename Ring>
+double run_single() {
+  static Ring ring;
+  auto t0 = ws::now();
+  std::thread producer{[]() { produce(&ring); }};
+  uint64_t expect{};
+  while (expect < uint64_t(num_elements)) {
+    const int size = ring.size();
+    if (size == 0) {
+      std::this_thread::yield();
+    }
+    for (int i = 0; i < size; i++) {
+      auto message = ring.read();
+      if (message.sequence != expect++) {
+        std::printf("Out of order element.\n");
+      }
+    }
+  }
+  producer.join();
+  return ws::elapsed_time(t0, ws::now());
+}
+
+template <typename Ring>
+double run_range() {
+  static Ring ring;
+  auto t0 = ws::now();
+  std::thread producer{[]() { produce(&ring); }};
+  uint64_t expect{};
+  Message messages[batch_size];
+  while (expect < uint64_t(num_elements)) {
+    const int num_read = ring.read_range(messages, batch_size);
+    if (num_read == 0) {
+      std::this_thread::yield();
+    }
+    for (int i = 0; i < num_read; i++) {
+      if (messages[i].sequence != expect++) {
+        std::printf("Out of order element.\n");
+      }
+    }
+  }
+  producer.join();
+  return ws::elapsed_time(t0, ws::now());
+}
+
+void report(const char* name, double t) {
+  std::printf("%-24s %8.3f s  %8.2f M msg/s\n", name, t, double(num_elements) / t * 1e-6);
+}
+
+} //  anon
+
+int main(int, char**) {
+  report("legacy read()", run_single<legacy::RingBuffer<Message, capacity>>());
+  report("RingBuffer read()", run_single<ws::RingBuffer<Message, capacity>>());
+  report("RingBuffer read_range()", run_range<ws::RingBuffer<Message, capacity>>());
+  return 0;
+}
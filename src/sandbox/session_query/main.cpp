@@ -0,0 +1,627 @@
+#include "common/waveform_store.hpp"
+#include "nlohmann/json.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * session_query - Index the files that task sessions write to the data directory and run
+ * aggregate queries over them.
+ *
+ * Files are grouped into sessions by name: <date>_<animal1>_<animal2>_<kind>_<postfix>.<ext>, where
+ * the postfix of a session run as one of several rigs starts with the rig's name. Record files that
+ * are still being written, or whose session failed to save, end in `.part` and are skipped.
+ * Sessions are processed in parallel by a pool of worker threads, each reading its session's files
+ * with a SAX parser that keeps only the fields the query needs rather than building a document.
+ * Per-session results are merged in session order, so output does not depend on scheduling.
+ *
+ *   session_query <index | success | latency | waveforms> [--dir PATH] [--date YYYYMMDD]
+ *                 [--animal NAME] [--task-type N] [--threads N]
+ */
+
+namespace {
+
+using json = nlohmann::json;
+
+enum class FileKind {
+  TrialRecord = 0,
+  BehaviorData,
+  SessionInfo,
+  LeverReading,
+  LeverWaveforms,
+  NumKinds,
+};
+
+constexpr int num_file_kinds = int(FileKind::NumKinds);
+
+constexpr const char* file_kind_markers[num_file_kinds]{
+  "_TrialRecord_",
+  "_bhv_data_",
+  "_session_info_",
+  "_lever_reading_",
+  "_lever_waveforms_",
+};
+
+constexpr const char* file_kind_extensions[num_file_kinds]{
+  ".json",
+  ".json",
+  ".json",
+  ".json",
+  ".wswf",
+};
+
+constexpr const char* unfinished_file_extension = ".part";
+
+//  `BehaviorData::behavior_events` codes.
+constexpr int event_lever1_pulled = 1;
+constexpr int event_lever2_pulled = 2;
+constexpr int event_trial_end = 9;
+
+struct Session {
+  std::string date;
+  std::string animals;
+  std::string postfix;
+  std::string files[num_file_kinds];
+};
+
+struct QueryParams {
+  std::string command;
+  std::string dir{WS_DATA_DIR};
+  std::string date;
+  std::string animal;
+  int task_type{-1};
+  int num_threads{};
+};
+
+/*
+ * Indexing
+ */
+
+bool ends_with(const std::string& str, const char* suffix) {
+  const auto len = std::strlen(suffix);
+  return str.size() >= len && str.compare(str.size() - len, len, suffix) == 0;
+}
+
+bool parse_file_name(const std::string& name, FileKind* kind, Session* session) {
+  for (int k = 0; k < num_file_kinds; k++) {
+    const auto marker = name.find(file_kind_markers[k]);
+    if (marker == std::string::npos) {
+      continue;
+    }
+    if (!ends_with(name, file_kind_extensions[k])) {
+      return false;
+    }
+    const auto ext = name.size() - std::strlen(file_kind_extensions[k]);
+    const auto prefix = name.substr(0, marker);
+    const auto date_end = prefix.find('_');
+    if (date_end == std::string::npos) {
+      return false;
+    }
+    const auto postfix_begin = marker + std::strlen(file_kind_markers[k]);
+    if (postfix_begin > ext) {
+      return false;
+    }
+    *kind = FileKind(k);
+    session->date = prefix.substr(0, date_end);
+    session->animals = prefix.substr(date_end + 1);
+    session->postfix = name.substr(postfix_begin, ext - postfix_begin);
+    return true;
+  }
+  return false;
+}
+
+bool matches_filter(const Session& session, const QueryParams& params) {
+  if (!params.date.empty() && session.date != params.date) {
+    return false;
+  }
+  if (!params.animal.empty()) {
+    //  Animal names are separated by '_' in `animals`.
+    const auto names = "_" + session.animals + "_";
+    if (names.find("_" + params.animal + "_") == std::string::npos) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::vector<Session> index_sessions(const QueryParams& params) {
+  std::map<std::string, Session> sessions;
+  int num_unfinished{};
+  std::error_code err;
+  for (auto& entry : std::filesystem::directory_iterator(params.dir, err)) {
+    if (!entry.is_regular_file()) {
+      continue;
+    }
+    const auto name = entry.path().filename().string();
+    if (ends_with(name, unfinished_file_extension)) {
+      num_unfinished++;
+      continue;
+    }
+    FileKind kind;
+    Session parsed;
+    if (!parse_file_name(name, &kind, &parsed) || !matches_filter(parsed, params)) {
+      continue;
+    }
+    auto& session = sessions[parsed.date + "_" + parsed.animals + "_" + parsed.postfix];
+    if (session.date.empty()) {
+      session = parsed;
+    }
+    session.files[int(kind)] = entry.path().string();
+  }
+  if (err) {
+    std::fprintf(stderr, "Failed to list %s: %s\n", params.dir.c_str(), err.message().c_str());
+  }
+  if (num_unfinished > 0) {
+    std::fprintf(stderr, "Skipped %d unfinished (%s) file(s)\n", num_unfinished,
+                 unfinished_file_extension);
+  }
+
+  std::vector<Session> result;
+  for (auto& [key, session] : sessions) {
+    result.push_back(std::move(session));
+  }
+  return result;
+}
+
+/*
+ * Reading
+ */
+
+//  SAX handler for a JSON array of flat objects, such as the task's record files. For each object,
+//  calls `on_record(const double* fields)` with the values of the requested numeric fields, in the
+//  order requested; fields that are absent or not numbers are NaN. Nested values are skipped.
+template <typename F>
+class RecordReader {
+  static constexpr int max_num_fields = 8;
+
+public:
+  RecordReader(const char* const* field_names, int num_fields, F on_record) :
+    field_names{field_names}, num_fields{num_fields}, on_record{std::move(on_record)} {
+    //
+  }
+
+  bool null() {
+    return true;
+  }
+  bool boolean(bool v) {
+    return set_value(v ? 1.0 : 0.0);
+  }
+  bool number_integer(json::number_integer_t v) {
+    return set_value(double(v));
+  }
+  bool number_unsigned(json::number_unsigned_t v) {
+    return set_value(double(v));
+  }
+  bool number_float(json::number_float_t v, const json::string_t&) {
+    return set_value(double(v));
+  }
+  bool string(json::string_t&) {
+    return true;
+  }
+  bool binary(json::binary_t&) {
+    return true;
+  }
+  bool start_object(std::size_t) {
+    if (++depth == record_depth) {
+      std::fill(values, values + num_fields, NAN);
+    }
+    return true;
+  }
+  bool end_object() {
+    if (depth-- == record_depth) {
+      on_record(static_cast<const double*>(values));
+    }
+    return true;
+  }
+  bool start_array(std::size_t) {
+    depth++;
+    return true;
+  }
+  bool end_array() {
+    depth--;
+    return true;
+  }
+  bool key(json::string_t& key) {
+    field = -1;
+    for (int i = 0; i < num_fields; i++) {
+      if (key == field_names[i]) {
+        field = i;
+        break;
+      }
+    }
+    return true;
+  }
+  bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) {
+    return false;
+  }
+
+private:
+  bool set_value(double v) {
+    if (depth == record_depth && field >= 0) {
+      values[field] = v;
+    }
+    return true;
+  }
+
+private:
+  static constexpr int record_depth = 2;
+
+  const char* const* field_names;
+  int num_fields;
+  F on_record;
+  int depth{};
+  int field{-1};
+  double values[max_num_fields]{};
+};
+
+bool read_file(const std::string& file_path, std::vector<char>* data) {
+  std::ifstream file(file_path, std::ios::binary);
+  if (!file.good()) {
+    return false;
+  }
+  data->assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return true;
+}
+
+template <typename F>
+bool read_records(const std::string& file_path, const char* const* field_names, int num_fields,
+                  F&& on_record) {
+  std::vector<char> data;
+  if (!read_file(file_path, &data)) {
+    return false;
+  }
+  RecordReader<F> reader{field_names, num_fields, std::forward<F>(on_record)};
+  return json::sax_parse(data.begin(), data.end(), &reader);
+}
+
+struct Trial {
+  int trial_number;
+  int task_type;
+  int rewarded;
+  double start_time;
+  //  Relative to `start_time`. NaN if the trial did not end.
+  double end_time{NAN};
+  std::vector<double> partner_pull_times;
+};
+
+bool read_trials(const Session& session, std::vector<Trial>* trials) {
+  const char* fields[]{"trial_number", "task_type", "rewarded", "trial_starttime"};
+  return read_records(session.files[int(FileKind::TrialRecord)], fields, 4,
+                      [trials](const double* v) {
+    if (std::isnan(v[0]) || std::isnan(v[1]) || std::isnan(v[2])) {
+      return;
+    }
+    Trial trial{};
+    trial.trial_number = int(v[0]);
+    trial.task_type = int(v[1]);
+    trial.rewarded = int(v[2]);
+    trial.start_time = v[3];
+    trials->push_back(trial);
+  });
+}
+
+Trial* find_trial(std::vector<Trial>& trials, int trial_number) {
+  auto it = std::lower_bound(trials.begin(), trials.end(), trial_number, [](auto& trial, int n) {
+    return trial.trial_number < n;
+  });
+  return it != trials.end() && it->trial_number == trial_number ? &*it : nullptr;
+}
+
+//  Requires `trials` sorted by trial number.
+bool read_trial_events(const Session& session, std::vector<Trial>* trials) {
+  const char* fields[]{"trial_number", "time_points", "behavior_events"};
+  return read_records(session.files[int(FileKind::BehaviorData)], fields, 3,
+                      [trials](const double* v) {
+    auto* trial = std::isnan(v[0]) || std::isnan(v[2]) ? nullptr : find_trial(*trials, int(v[0]));
+    if (!trial) {
+      return;
+    }
+    const int event = int(v[2]);
+    if (event == event_trial_end) {
+      trial->end_time = v[1];
+    } else if ((event == event_lever1_pulled || event == event_lever2_pulled) && v[1] > 0.0) {
+      //  The pull that starts a trial is logged at time 0; later pulls are the partner's.
+      trial->partner_pull_times.push_back(v[1]);
+    }
+  });
+}
+
+/*
+ * Queries
+ */
+
+struct TaskTypeStats {
+  int64_t num_sessions{};
+  int64_t num_trials{};
+  int64_t num_rewarded{};
+  //  From the end of the previous trial to the pull that starts the trial, in seconds.
+  std::vector<double> first_pull_latency;
+  //  From the pull that starts the trial to each later pull in it, in seconds.
+  std::vector<double> partner_pull_latency;
+};
+
+using StatsByTaskType = std::map<int, TaskTypeStats>;
+
+//  Of one lever's recorded waveform; the decoded samples are not kept.
+struct WaveformSummary {
+  uint32_t lever;
+  size_t num_samples;
+  //  From the first sample to the last, in seconds.
+  double duration;
+};
+
+struct SessionResult {
+  bool ok{};
+  StatsByTaskType stats;
+  std::vector<WaveformSummary> waveforms;
+};
+
+bool summarize_waveforms(const std::string& file_path, std::vector<WaveformSummary>* summaries) {
+  std::vector<ws::LeverWaveform> waveforms;
+  if (!ws::read_waveform_file(file_path, &waveforms)) {
+    return false;
+  }
+  for (auto& waveform : waveforms) {
+    const auto n = waveform.time_us.size();
+    auto& summary = summaries->emplace_back();
+    summary.lever = waveform.lever;
+    summary.num_samples = n;
+    summary.duration = n > 1 ? double(waveform.time_us.back() - waveform.time_us[0]) * 1e-6 : 0.0;
+  }
+  return true;
+}
+
+void add_trial_stats(const std::vector<Trial>& trials, const QueryParams& params,
+                     StatsByTaskType* stats) {
+  const Trial* prev{};
+  for (auto& trial : trials) {
+    if (params.task_type < 0 || trial.task_type == params.task_type) {
+      auto& dst = (*stats)[trial.task_type];
+      dst.num_trials++;
+      dst.num_rewarded += trial.rewarded > 0 ? 1 : 0;
+      if (prev && !std::isnan(prev->end_time)) {
+        dst.first_pull_latency.push_back(trial.start_time - (prev->start_time + prev->end_time));
+      }
+      dst.partner_pull_latency.insert(
+        dst.partner_pull_latency.end(),
+        trial.partner_pull_times.begin(), trial.partner_pull_times.end());
+    }
+    prev = &trial;
+  }
+  for (auto& [task_type, dst] : *stats) {
+    dst.num_sessions = 1;
+  }
+}
+
+SessionResult run_session_query(const Session& session, const QueryParams& params) {
+  SessionResult result;
+  if (params.command == "waveforms") {
+    const auto& file = session.files[int(FileKind::LeverWaveforms)];
+    result.ok = !file.empty() && summarize_waveforms(file, &result.waveforms);
+    return result;
+  }
+
+  std::vector<Trial> trials;
+  const bool need_events = params.command == "latency";
+  if (session.files[int(FileKind::TrialRecord)].empty() ||
+      (need_events && session.files[int(FileKind::BehaviorData)].empty())) {
+    return result;
+  }
+  if (!read_trials(session, &trials)) {
+    return result;
+  }
+  std::sort(trials.begin(), trials.end(), [](auto& a, auto& b) {
+    return a.trial_number < b.trial_number;
+  });
+  if (need_events && !read_trial_events(session, &trials)) {
+    return result;
+  }
+  add_trial_stats(trials, params, &result.stats);
+  result.ok = true;
+  return result;
+}
+
+//  Run `f(i)` for each i in [0, count) on `num_threads` threads. Work is handed out one item at a
+//  time, so sessions of very different sizes still balance.
+template <typename F>
+void parallel_for(int count, int num_threads, F&& f) {
+  std::atomic<int> next{};
+  const auto work = [&]() {
+    int i;
+    while ((i = next.fetch_add(1)) < count) {
+      f(i);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (int t = 1; t < num_threads; t++) {
+    threads.emplace_back(work);
+  }
+  work();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+void merge_stats(const StatsByTaskType& src, StatsByTaskType* dst) {
+  for (auto& [task_type, stats] : src) {
+    auto& merged = (*dst)[task_type];
+    merged.num_sessions += stats.num_sessions;
+    merged.num_trials += stats.num_trials;
+    merged.num_rewarded += stats.num_rewarded;
+    merged.first_pull_latency.insert(
+      merged.first_pull_latency.end(),
+      stats.first_pull_latency.begin(), stats.first_pull_latency.end());
+    merged.partner_pull_latency.insert(
+      merged.partner_pull_latency.end(),
+      stats.partner_pull_latency.begin(), stats.partner_pull_latency.end());
+  }
+}
+
+/*
+ * Output
+ */
+
+void print_index(const std::vector<Session>& sessions) {
+  const char* kind_names[num_file_kinds]{"trials", "bhv", "info", "lever", "waveforms"};
+  std::printf("%-10s %-24s %-20s files\n", "date", "animals", "postfix");
+  for (auto& session : sessions) {
+    std::printf("%-10s %-24s %-20s", session.date.c_str(), session.animals.c_str(),
+                session.postfix.c_str());
+    for (int k = 0; k < num_file_kinds; k++) {
+      if (!session.files[k].empty()) {
+        std::printf(" %s", kind_names[k]);
+      }
+    }
+    std::printf("\n");
+  }
+  std::printf("%d session(s)\n", int(sessions.size()));
+}
+
+void print_success(const StatsByTaskType& stats) {
+  std::printf("%-9s %8s %8s %9s %8s\n", "task_type", "sessions", "trials", "rewarded", "rate");
+  for (auto& [task_type, s] : stats) {
+    const double rate = s.num_trials > 0 ? double(s.num_rewarded) / double(s.num_trials) : 0.0;
+    std::printf("%-9d %8lld %8lld %9lld %8.3f\n", task_type, (long long) s.num_sessions,
+                (long long) s.num_trials, (long long) s.num_rewarded, rate);
+  }
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+  const double pos = p * double(sorted.size() - 1);
+  const auto i = size_t(pos);
+  const double f = pos - double(i);
+  return i + 1 < sorted.size() ? sorted[i] * (1.0 - f) + sorted[i + 1] * f : sorted[i];
+}
+
+void print_distribution(int task_type, const char* name, std::vector<double> values) {
+  if (values.empty()) {
+    std::printf("%-9d %-14s %8d\n", task_type, name, 0);
+    return;
+  }
+  std::sort(values.begin(), values.end());
+  double sum{};
+  for (double v : values) {
+    sum += v;
+  }
+  std::printf("%-9d %-14s %8d %8.3f %8.3f %8.3f %8.3f %8.3f %8.3f\n", task_type, name,
+              int(values.size()), sum / double(values.size()), percentile(values, 0.1),
+              percentile(values, 0.25), percentile(values, 0.5), percentile(values, 0.75),
+              percentile(values, 0.9));
+}
+
+void print_latency(const StatsByTaskType& stats) {
+  std::printf("%-9s %-14s %8s %8s %8s %8s %8s %8s %8s\n", "task_type", "latency (s)", "count",
+              "mean", "p10", "p25", "p50", "p75", "p90");
+  for (auto& [task_type, s] : stats) {
+    print_distribution(task_type, "first_pull", s.first_pull_latency);
+    print_distribution(task_type, "partner_pull", s.partner_pull_latency);
+  }
+}
+
+void print_waveforms(const std::vector<Session>& sessions, const std::vector<SessionResult>& results) {
+  std::printf("%-10s %-24s %-20s %6s %10s %10s %8s\n", "date", "animals", "postfix", "lever",
+              "samples", "duration", "rate");
+  for (size_t i = 0; i < sessions.size(); i++) {
+    for (auto& waveform : results[i].waveforms) {
+      const auto n = waveform.num_samples;
+      const double duration = waveform.duration;
+      std::printf("%-10s %-24s %-20s %6u %10zu %10.1f %8.1f\n", sessions[i].date.c_str(),
+                  sessions[i].animals.c_str(), sessions[i].postfix.c_str(), waveform.lever, n,
+                  duration, duration > 0.0 ? double(n - 1) / duration : 0.0);
+    }
+  }
+}
+
+void print_usage() {
+  std::printf(
+    "usage: session_query <command> [options]\n"
+    "commands:\n"
+    "  index       list the sessions in the data directory and their files\n"
+    "  success     fraction of trials rewarded, by task type\n"
+    "  latency     pull latency distributions, by task type: first_pull is from the end of the\n"
+    "              previous trial to the pull that starts the trial; partner_pull is from that\n"
+    "              pull to each later pull in the trial\n"
+    "  waveforms   samples, duration and rate of each lever's recorded waveform\n"
+    "options:\n"
+    "  --dir PATH       data directory (default: %s)\n"
+    "  --date YYYYMMDD  only sessions from this experiment date\n"
+    "  --animal NAME    only sessions with this animal\n"
+    "  --task-type N    only trials of this task type\n"
+    "  --threads N      worker threads (default: hardware concurrency)\n", WS_DATA_DIR);
+}
+
+bool parse_args(int argc, char** argv, QueryParams* params) {
+  if (argc < 2) {
+    return false;
+  }
+  params->command = argv[1];
+  for (int i = 2; i + 1 < argc; i += 2) {
+    if (std::strcmp(argv[i], "--dir") == 0) {
+      params->dir = argv[i + 1];
+    } else if (std::strcmp(argv[i], "--date") == 0) {
+      params->date = argv[i + 1];
+    } else if (std::strcmp(argv[i], "--animal") == 0) {
+      params->animal = argv[i + 1];
+    } else if (std::strcmp(argv[i], "--task-type") == 0) {
+      params->task_type = std::atoi(argv[i + 1]);
+    } else if (std::strcmp(argv[i], "--threads") == 0) {
+      params->num_threads = std::atoi(argv[i + 1]);
+    } else {
+      return false;
+    }
+  }
+  return (argc % 2) == 0 &&
+    (params->command == "index" || params->command == "success" ||
+     params->command == "latency" || params->command == "waveforms");
+}
+
+} //  anon
+
+int main(int argc, char** argv) {
+  QueryParams params;
+  if (!parse_args(argc, argv, &params)) {
+    print_usage();
+    return 1;
+  }
+  if (params.num_threads <= 0) {
+    params.num_threads = std::max(1, int(std::thread::hardware_concurrency()));
+  }
+
+  const auto sessions = index_sessions(params);
+  if (params.command == "index") {
+    print_index(sessions);
+    return 0;
+  }
+
+  std::vector<SessionResult> results(sessions.size());
+  parallel_for(int(sessions.size()), params.num_threads, [&](int i) {
+    results[i] = run_session_query(sessions[i], params);
+  });
+
+  int num_ok{};
+  StatsByTaskType stats;
+  for (auto& result : results) {
+    num_ok += result.ok ? 1 : 0;
+    merge_stats(result.stats, &stats);
+  }
+
+  if (params.command == "success") {
+    print_success(stats);
+  } else if (params.command == "latency") {
+    print_latency(stats);
+  } else {
+    print_waveforms(sessions, results);
+  }
+  std::printf("%d of %d session(s) read\n", num_ok, int(sessions.size()));
+  return 0;
+}
@@ -0,0 +1,102 @@
+#include "common/session_data.hpp"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+
+/*
+ * session_recover - Rebuild a session's JSON output files from its write-ahead log, after the task
+ * exited without saving them.
+ *
+ * The log <date>_<animal1>_<animal2>_session_log_<postfix>.wal is written next to the session's
+ * other files and removed once they are saved, so a log left in the data directory belongs to a
+ * session that did not finish. Its intact records are written to the files the session would
+ * have saved, with the same names. Existing files are not overwritten unless --force is given.
+ *
+ *   session_recover <log file> [--out DIR] [--force]
+ */
+
+namespace {
+
+constexpr const char* log_marker = "_session_log_";
+
+struct RecoverParams {
+  std::string log_path;
+  std::string out_dir;
+  bool force{};
+};
+
+bool parse_args(int argc, char** argv, RecoverParams* params) {
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+      params->out_dir = argv[++i];
+    } else if (std::strcmp(argv[i], "--force") == 0) {
+      params->force = true;
+    } else if (params->log_path.empty() && argv[i][0] != '-') {
+      params->log_path = argv[i];
+    } else {
+      return false;
+    }
+  }
+  return !params->log_path.empty();
+}
+
+//  The path of the session's file of `kind`: the log's name with the kind in place of the log's.
+std::string output_path(const RecoverParams& params, const char* kind) {
+  const std::filesystem::path log_path{params.log_path};
+  std::string name = log_path.stem().string();
+  const auto marker = name.find(log_marker);
+  if (marker != std::string::npos) {
+    name.replace(marker, std::strlen(log_marker), std::string{"_"} + kind + "_");
+  } else {
+    name += std::string{"_"} + kind;
+  }
+  const auto dir = params.out_dir.empty() ? log_path.parent_path() : std::filesystem::path{params.out_dir};
+  return (dir / (name + ".json")).string();
+}
+
+template <typename T>
+bool save(const RecoverParams& params, const char* kind, const T& records, int num_records) {
+  const auto file_path = output_path(params, kind);
+  if (!params.force && std::filesystem::exists(file_path)) {
+    std::printf("%s exists; not overwriting it (use --force).\n", file_path.c_str());
+    return false;
+  }
+  if (!ws::save_json(file_path, records)) {
+    std::printf("Failed to write %s.\n", file_path.c_str());
+    return false;
+  }
+  std::printf("Wrote %d record(s) to %s.\n", num_records, file_path.c_str());
+  return true;
+}
+
+} //  anon
+
+int main(int argc, char** argv) {
+  RecoverParams params;
+  if (!parse_args(argc, argv, &params)) {
+    std::printf("usage: session_recover <log file> [--out DIR] [--force]\n");
+    return 1;
+  }
+
+  ws::RecoveredSession session;
+  if (!ws::recover_session(params.log_path, &session)) {
+    std::printf("Failed to read session log %s.\n", params.log_path.c_str());
+    return 1;
+  }
+
+  std::printf("Read %llu record(s). ", (unsigned long long) session.num_records);
+  if (session.ended) {
+    std::printf("The session ended normally; its files may already have been saved.\n");
+  } else if (!session.trial_records.empty()) {
+    std::printf("The log ends during trial %d.\n", session.trial_records.back().trial_number + 1);
+  } else {
+    std::printf("The log ends before the first trial was saved.\n");
+  }
+
+  bool ok = save(params, "TrialRecord", session.trial_records, int(session.trial_records.size()));
+  ok &= save(params, "bhv_data", session.behavior_data, int(session.behavior_data.size()));
+  ok &= save(params, "session_info", session.session_info, int(session.session_info.size()));
+  ok &= save(params, "lever_reading", session.lever_readout, int(session.lever_readout.size()));
+  return ok ? 0 : 1;
+}
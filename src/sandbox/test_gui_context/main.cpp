@@ -1,68 +1,133 @@
 #include "common/app.hpp"
 #include "common/lever_gui.hpp"
 #include "common/juice_pump_gui.hpp"
+#include "common/channel_gui.hpp"
+#include "common/port_discovery.hpp"
 #include "common/lever_pull.hpp"
+#include "common/chunked_log.hpp"
 #include "common/common.hpp"
 #include "common/juice_pump.hpp"
 #include "common/random.hpp"
+#include "common/replay.hpp"
+#include "common/rig_host.hpp"
+#include "common/session_data.hpp"
+#include "common/state_machine.hpp"
+#include "common/trace.hpp"
+#include "common/trace_gui.hpp"
+#include "common/trial_schedule.hpp"
+#include "common/waveform_store.hpp"
+#include "common/write_ahead_log.hpp"
 #include "training.hpp"
-#include "nlohmann/json.hpp"
 #include <imgui.h>
+#include <nlohmann/json.hpp>
 
 #ifdef _MSC_VER
 #include <Windows.h>
 #endif
 
 #include <time.h>
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
 #include <thread>
 #include <iostream>
 #include <fstream>
 
-using json = nlohmann::json;
-
 struct App;
 
+// a pull or release detected by a lever direction's pull detector, with the sample it was detected on
+struct LeverEvent {
+    ws::lever::PullEvent event;
+    ws::LeverState sample;
+};
+
 void render_gui(App& app);
 void task_update(App& app);
 void setup(App& app);
 void shutdown(App& app);
 
-struct TrialRecord {
-    double trial_start_time_stamp;  // time since the session starts
-    int trial_number;
-    int first_pull_id;
-    int rewarded;
-    int task_type; // indicate the task type 
+// trial states. A trial waits in NewTrial until a lever is released (or the trial times out),
+// then delivers the two rewards after their delays, waits out the end of the trial and saves the
+// trial record. the waits are timed states, so the levers keep being read while they run.
+struct LeverReleased {};
+struct TrialTimedOut {};
+struct Juice1Delivered {};
+struct Juice2Delivered {};
+struct RewardDelivered {};
+struct TrialSaved {};
+
+struct NewTrial {
+    void enter(App& app);
+    ws::fsm::Emits<TrialTimedOut> tick(App& app);
+
+    ws::NewTrialState new_trial{};
+    bool entry{ true };
 };
 
-struct BehaviorData {
-    int trial_number;
-    double time_points;
-    int behavior_events;
+// from the end of the trial to the first animal's juice
+struct Juice1Delay {
+    void enter(App& app);
+    ws::fsm::Emits<Juice1Delivered> tick(App& app);
+
+    ws::DelayState delay{};
+    bool entry{ true };
 };
 
-struct SessionInfo {
-    std::string animal1_name;
-    std::string animal2_name;
-    std::string experiment_date;
-    int task_type;
-    int task_type_block;
-    int task_type_random;
-    int task_type_blocklength;
-    float large_juice_volume;
-    float small_juice_volume;
+// from the first animal's juice to the second's
+struct Juice2Delay {
+    void enter(App& app);
+    ws::fsm::Emits<Juice2Delivered> tick(App& app);
 
+    ws::DelayState delay{};
+    bool entry{ true };
 };
 
-struct LeverReadout {
-    int trial_number;
-    double readout_timepoint;
-    float strain_gauge_lever;
-    float potentiometer_lever;
-    int pull_or_release;
-    int lever_id;
-}; // under construction ... -WS
+// from the second animal's juice to the end of the trial
+struct AfterDelivery {
+    void enter(App& app);
+    ws::fsm::Emits<RewardDelivered> tick(App& app);
 
+    ws::DelayState delay{};
+    bool entry{ true };
+};
+
+struct SaveTrial {
+    ws::fsm::Emits<TrialSaved> tick(App& app);
+};
+
+using TrialTransitions = ws::fsm::TransitionTable<
+    ws::fsm::Transition<NewTrial, LeverReleased, Juice1Delay>,
+    ws::fsm::Transition<NewTrial, TrialTimedOut, Juice1Delay>,
+    ws::fsm::Transition<Juice1Delay, Juice1Delivered, Juice2Delay>,
+    ws::fsm::Transition<Juice2Delay, Juice2Delivered, AfterDelivery>,
+    ws::fsm::Transition<AfterDelivery, RewardDelivered, SaveTrial>,
+    ws::fsm::Transition<SaveTrial, TrialSaved, NewTrial>>;
+
+using TrialStateMachine = ws::fsm::StateMachine<
+    TrialTransitions, NewTrial, Juice1Delay, Juice2Delay, AfterDelivery, SaveTrial>;
+
+// ids of the task parameters that can change during a session, as stored in replay logs. add new
+// parameters at the end, so that existing logs stay readable.
+enum TaskParameter : uint32_t {
+    TaskParameter_HasLever = 0,
+    TaskParameter_TaskType,
+    TaskParameter_TaskTypeBlock,
+    TaskParameter_TaskTypeRandom,
+    TaskParameter_BlockLength,
+    TaskParameter_AllowAutomatedJuiceDelivery,
+    TaskParameter_Juice1DelayTime,
+    TaskParameter_Juice2DelayTime,
+    TaskParameter_AfterDeliveryTime,
+    TaskParameter_LargeJuiceVolume,
+    TaskParameter_SmallJuiceVolume,
+    TaskParameter_NewTotalTime,
+    TaskParameter_PlayTrialStartSound,
+    TaskParameter_PullDetect, // 4 per lever direction
+    TaskParameter_LeverPositionLimits = TaskParameter_PullDetect + 8, // 2 per lever direction
+    TaskParameter_InvertLeverPosition = TaskParameter_LeverPositionLimits + 4, // 1 per lever direction
+    TaskParameter_PullDetectLever = TaskParameter_InvertLeverPosition + 2,
+};
 
 struct App : public ws::App {
     ~App() override = default;
@@ -94,6 +159,8 @@ struct App : public ws::App {
     int block_length{ 15 }; // initiation: the length of the (mini)block, only function if "tasktype_block" or "tasktype_random" is 1
 
     int tasktype{ 2 }; // initiation; 1:competing 2: delimma 
+    int tasktype_max_run{ 0 }; // random task types: at most this many trials (or blocks) in a row of the same type; 0 for no limit
+    bool tasktype_balanced{ false }; // random task types: each pair of trials (or blocks) has one of each type
     // int tasktype{rand()%2};
 
     // lever force setting condition
@@ -104,7 +171,10 @@ struct App : public ws::App {
     bool allow_automated_juice_delivery{ false };
 
     // int lever_force_limits[2]{0, 550};
-    ws::lever::PullDetect detect_pull[2]{}; // one lever, but treat the two directions as two levers
+    ws::lever::PullDetector detect_pull[2]{}; // one lever, but treat the two directions as two levers
+    uint64_t lever_sample_cursors[2]{}; // read position in the lever's sample history, per direction
+    int pull_detect_lever_id{}; // of the lever that detect_pull and lever_sample_cursors follow; 0 for none
+    std::vector<LeverEvent> lever_events; // detected by the latest update_pull_detector, oldest first
     float lever_position_limits[4]{ 27.7e3f, 32.2e3f, 32.2e3f, 36.7e3f };  // one lever, but treat the two directions as two levers
     bool invert_lever_position[2]{ true, false }; // one lever, but treat the two directions as two levers
 
@@ -126,6 +196,16 @@ struct App : public ws::App {
     int total_trial_number{ 500 }; // the maximal trial number of a session
 
 
+    // the session's trial sequence, generated at setup; random draws for trial i come from the
+    // stream keyed by (session_seed, i)
+    uint64_t session_seed{};
+    ws::TrialSchedule trial_schedule;
+    ws::ScheduledTrial current_trial{};
+
+    // trial state, advanced once per task_update
+    TrialStateMachine trial_states;
+    bool play_trial_start_sound{ true };
+
     // variables that are updated every trial
     int trialnumber{ 0 };
     int first_pull_id{ 0  };
@@ -173,161 +253,295 @@ struct App : public ws::App {
     // std::ofstream save_trial_data_file;
 
     bool dont_save_data{};
-    std::vector<TrialRecord> trial_records;
-    std::vector<BehaviorData> behavior_data;
-    std::vector<SessionInfo> session_info;
-    std::vector<LeverReadout> lever_readout; // under construction
+    bool headless{}; // replaying a recorded session, without windows, audio or devices
+    // appended to during the session; chunked, so that appends never reallocate and copy
+    ws::ChunkedLog<ws::TrialRecord> trial_records;
+    ws::ChunkedLog<ws::BehaviorData> behavior_data;
+    std::vector<ws::SessionInfo> session_info;
+    ws::ChunkedLog<ws::LeverReadout> lever_readout; // under construction
+    // the logs' output files, written a chunk at a time as the session runs so that the logs only
+    // hold their latest chunk. the session info is written at shutdown.
+    ws::SessionRecordFile trial_records_file;
+    ws::SessionRecordFile behavior_data_file;
+    ws::SessionRecordFile lever_readout_file;
+
+    // every lever sample, pushed by the lever workers, compressed and written to disk by a
+    // background thread as the session runs
+    ws::WaveformWriter* waveform_writer{};
+    std::string waveform_file_path;
+    ws::TimePoint waveform_start_time{};
+    std::string file_postfix; // shared by all of the session's output files, so that they can be grouped
+    std::string rig_name; // when running several rigs, in the output file names so that rigs' files never collide
+
+    // each record is also appended to this log as it is made, so that the session's data can be
+    // recovered (with session_recover) if the app exits without saving. removed once saved, or at
+    // shutdown if saving is off.
+    ws::WriteAheadLog* session_log{};
+    std::string session_log_path;
+    bool session_files_opened{}; // the output files and log are opened once, when saving is first on
 
 };
 
-// save data for Trial Record
-json to_json(const TrialRecord& trial) {
-    json result;
-    result["trial_number"] = trial.trial_number;
-    result["rewarded"] = trial.rewarded;
-    result["first_pull_id"] = trial.first_pull_id;
-    result["task_type"] = trial.task_type;
-    result["trial_starttime"] = trial.trial_start_time_stamp;
-    return result;
+ws::TrialScheduleParams make_trial_schedule_params(const App& app) {
+    // condition i is task type i + 1. the pulling animal's reward size depends on the task type,
+    // so both conditions use the same pair of volumes.
+    ws::TrialCondition competition{ app.large_juice_volume, app.small_juice_volume, 1500 };
+    ws::TrialCondition dilemma{ app.large_juice_volume, app.small_juice_volume, 750 };
+
+    ws::TrialScheduleParams params{};
+    params.num_trials = std::max(1, app.total_trial_number);
+    params.seed = app.session_seed;
+    params.conditions = { competition, dilemma };
+    params.max_run_length = app.tasktype_max_run;
+    params.balanced = app.tasktype_balanced;
+
+    if (app.tasktype_block) {
+        // task types switch every block, and the first block is the other type to `tasktype`,
+        // as when the type was switched on entry to trial 0.
+        params.order = app.tasktype_random ? ws::TrialOrder::RandomBlocks : ws::TrialOrder::Blocked;
+        params.block_length = app.block_length;
+        params.first_condition = app.tasktype == 1 ? 1 : 0;
+    }
+    else if (app.tasktype_random) {
+        params.order = ws::TrialOrder::Random;
+    }
+    else {
+        // one block of `tasktype`
+        params.order = ws::TrialOrder::Blocked;
+        params.block_length = params.num_trials;
+        params.first_condition = app.tasktype - 1;
+    }
+    return params;
 }
 
-json to_json(const std::vector<TrialRecord>& records) {
-    json result;
-    for (auto& record : records) {
-        result.push_back(to_json(record));
+// the session's output file name for files of `kind`
+std::string session_file_path(const App& app, const char* kind, const char* extension) {
+    std::string name = app.experiment_date + "_" + app.animal1_name + "_" + app.animal2_name + "_" + kind + "_";
+    if (!app.rig_name.empty()) {
+        name += app.rig_name + "_";
     }
-    return result;
+    name += app.file_postfix + extension;
+    return std::string{ WS_DATA_DIR } + "/" + name;
 }
 
-
-// save data for behavior data
-json to_json(const BehaviorData& bhv_data) {
-    json result;
-    result["trial_number"] = bhv_data.trial_number;
-    result["time_points"] = bhv_data.time_points;
-    result["behavior_events"] = bhv_data.behavior_events;
-    return result;
+// save some task information into session_info
+ws::SessionInfo make_session_info(const App& app) {
+    ws::SessionInfo session_info{};
+    session_info.animal1_name = app.animal1_name;
+    session_info.animal2_name = app.animal2_name;
+    session_info.experiment_date = app.experiment_date;
+    session_info.task_type = app.tasktype;
+    session_info.task_type_block = app.tasktype_block;
+    session_info.task_type_random = app.tasktype_random;
+    session_info.task_type_blocklength = app.block_length;
+    session_info.large_juice_volume = app.large_juice_volume;
+    session_info.small_juice_volume = app.small_juice_volume;
+    session_info.session_seed = app.session_seed;
+    for (int i = 0; i < ws::num_trials(app.trial_schedule); i++) {
+        auto trial = ws::trial_at(app.trial_schedule, i);
+        session_info.scheduled_task_types.push_back(trial.condition + 1);
+        session_info.scheduled_large_juice_volumes.push_back(trial.large_juice_volume);
+        session_info.scheduled_small_juice_volumes.push_back(trial.small_juice_volume);
+    }
+    return session_info;
 }
 
-json to_json(const std::vector<BehaviorData>& time_stamps) {
-    json result;
-    for (auto& time_stamp : time_stamps) {
-        result.push_back(to_json(time_stamp));
+// stream the data to the file as json
+template <typename T>
+bool save_session_file(const std::string& file_path, const T& data) {
+    if (ws::save_json(file_path, data)) {
+        return true;
     }
-    return result;
+    std::cout << "Failed to save: " << file_path << std::endl;
+    return false;
 }
 
+// start writing the record logs' output files
+void open_session_record_files(App& app) {
+    auto open = [&app](ws::SessionRecordFile& file, const char* kind) {
+        auto file_path = session_file_path(app, kind, ".json");
+        if (!ws::open_session_record_file(&file, file_path)) {
+            std::cout << "Failed to open: " << file_path << "; its records are kept in memory until the session ends." << std::endl;
+        }
+    };
+    open(app.trial_records_file, "TrialRecord");
+    open(app.behavior_data_file, "bhv_data");
+    open(app.lever_readout_file, "lever_reading");
+}
 
-// save data for session information
-json to_json(const SessionInfo& session_info) {
-    json result;
-    result["animal1_name"] = session_info.animal1_name;
-    result["animal2_name"] = session_info.animal2_name;
-    result["experiment_date"] = session_info.experiment_date;
-    result["task_type"] = session_info.task_type;
-    result["tasktype_block"] = session_info.task_type_block;
-    result["tasktype_random"] = session_info.task_type_random;
-    result["tasktype_blocklength"] = session_info.task_type_blocklength;
-    result["large_reward_volume"] = session_info.large_juice_volume;
-    result["small_reward_volume"] = session_info.small_juice_volume;
+// write out the records' full chunks, releasing their memory
+void write_full_record_chunks(App& app) {
+    ws::write_full_chunks(&app.trial_records_file, app.trial_records);
+    ws::write_full_chunks(&app.behavior_data_file, app.behavior_data);
+    ws::write_full_chunks(&app.lever_readout_file, app.lever_readout);
+}
 
-    return result;
+// write the rest of the log's records and move its file into place. if the file could not be
+// opened during the session, the log still holds every record, so try again now.
+template <typename T, int N>
+bool finish_record_file(App& app, ws::SessionRecordFile& file, const char* kind, ws::ChunkedLog<T, N>& records) {
+    if (!file.writer.is_open()) {
+        (void)ws::open_session_record_file(&file, session_file_path(app, kind, ".json"));
+    }
+    if (ws::finish_session_record_file(&file, records)) {
+        return true;
+    }
+    std::cout << "Failed to save: " << session_file_path(app, kind, ".json") << std::endl;
+    return false;
 }
 
-json to_json(const std::vector<SessionInfo>& session_info) {
-    json result;
-    for (auto& sessioninfos : session_info) {
-        result.push_back(to_json(sessioninfos));
+// keep a record for the session's output files, and append it to the write-ahead log so that it
+// survives a crash
+template <typename T, int N>
+void log_record(App& app, ws::ChunkedLog<T, N>& log, const T& record) {
+    log.push_back(record);
+    if (app.session_log && !ws::append_session_record(app.session_log, record)) {
+        std::cout << "Failed to append to the session log; closing it." << std::endl;
+        ws::close_write_ahead_log(app.session_log);
+        app.session_log = nullptr;
     }
-    return result;
 }
 
-// save data for lever information
-json to_json(const LeverReadout& lever_reading) {
-    json result;
-    result["trial_number"] = lever_reading.trial_number;
-    result["readout_timepoint"] = lever_reading.readout_timepoint;
-    result["potentiometer_lever2"] = lever_reading.potentiometer_lever;
-    result["potentiometer_lever1"] = lever_reading.strain_gauge_lever;
-    result["pull_or_release"] = lever_reading.pull_or_release;
-    return result;
+// called on a lever worker thread with every sample it reads, so that samples keep being captured
+// while the task thread is blocked, e.g. waiting out a reward delivery. this reads the levers
+// directly rather than through the replay log: the waveforms are a record of the session, not an
+// input to the task.
+void push_lever_waveform_sample(void* context, ws::lever::SerialLeverHandle lh, const ws::LeverState& state) {
+    const auto* app = static_cast<const App*>(context);
+    ws::WaveformSample dst{};
+    dst.lever = lh.id;
+    dst.time_us = std::chrono::duration_cast<std::chrono::microseconds>(state.sample_time - app->waveform_start_time).count();
+    dst.strain_gauge = state.strain_gauge;
+    dst.potentiometer = state.potentiometer_reading;
+    dst.calculated_pwm = state.calculated_pwm;
+    dst.actual_pwm = state.actual_pwm;
+    dst.force = state.force;
+    (void)ws::push_waveform_samples(app->waveform_writer, &dst, 1);
 }
 
-json to_json(const std::vector<LeverReadout>& lever_reads) {
-    json result;
-    for (auto& lever_read : lever_reads) {
-        result.push_back(to_json(lever_read));
+// start the session's output files and its write-ahead log, once saving is on: at setup, or when
+// SaveData is first checked. records logged before then are all still in memory, so they are
+// written to the log now.
+void open_session_files(App& app) {
+    app.session_files_opened = true;
+    open_session_record_files(app);
+    if (app.headless) {
+        return;
     }
-    return result;
-}
 
+    // stream the levers' waveforms to disk, alongside the event-level lever readout
+    app.waveform_file_path = session_file_path(app, "lever_waveforms", ".wswf");
+    app.waveform_writer = ws::open_waveform_writer(app.waveform_file_path, ws::make_default_waveform_writer_params());
+    app.waveform_start_time = ws::now();
+    if (app.waveform_writer) {
+        ws::lever::set_sample_sink(app.lever_system, ws::lever::SampleSink{ push_lever_waveform_sample, &app });
+    }
+    else {
+        std::cout << "Failed to open lever waveform file: " << app.waveform_file_path << std::endl;
+    }
 
-void setup(App& app) {
+    app.session_log_path = session_file_path(app, "session_log", ".wal");
+    app.session_log = ws::open_write_ahead_log(app.session_log_path);
+    if (!app.session_log) {
+        std::cout << "Failed to open session log: " << app.session_log_path << std::endl;
+        return;
+    }
+    bool logged = ws::append_session_record(app.session_log, make_session_info(app));
+    auto log_all = [&app, &logged](const auto& records) {
+        records.for_each([&app, &logged](const auto& record) {
+            logged = logged && ws::append_session_record(app.session_log, record);
+        });
+    };
+    log_all(app.trial_records);
+    log_all(app.behavior_data);
+    log_all(app.lever_readout);
+    if (!logged) {
+        std::cout << "Failed to append to the session log; closing it." << std::endl;
+        ws::close_write_ahead_log(app.session_log);
+        app.session_log = nullptr;
+    }
+}
 
+void setup(App& app) {
 
-    auto buff_p_task1 = std::string{ WS_RES_DIR } + "/sounds/start_trial_beep_task1.wav";
-    app.start_trial_audio_buffer_task1 = ws::audio::read_buffer(buff_p_task1.c_str());
+    // sounds are only played live, not when replaying a session
+    if (!app.headless) {
+        auto buff_p_task1 = std::string{ WS_RES_DIR } + "/sounds/start_trial_beep_task1.wav";
+        app.start_trial_audio_buffer_task1 = ws::audio::read_buffer(buff_p_task1.c_str());
 
-    auto buff_p_task2 = std::string{ WS_RES_DIR } + "/sounds/start_trial_beep_task2.wav";
-    app.start_trial_audio_buffer_task2 = ws::audio::read_buffer(buff_p_task2.c_str());
+        auto buff_p_task2 = std::string{ WS_RES_DIR } + "/sounds/start_trial_beep_task2.wav";
+        app.start_trial_audio_buffer_task2 = ws::audio::read_buffer(buff_p_task2.c_str());
 
-    // auto buff_p1 = std::string{ WS_RES_DIR } + "/sounds/" + app.animal1_name + "_large_juice_beep_" + std::to_string(app.tasktype) + ".wav";
-    auto buff_p1 = std::string{ WS_RES_DIR } + "/sounds/" + app.animal1_name + "_large_juice_beep_1.wav";
-    app.lever1_large_juice_audio_buffer = ws::audio::read_buffer(buff_p1.c_str());
+        // auto buff_p1 = std::string{ WS_RES_DIR } + "/sounds/" + app.animal1_name + "_large_juice_beep_" + std::to_string(app.tasktype) + ".wav";
+        auto buff_p1 = std::string{ WS_RES_DIR } + "/sounds/" + app.animal1_name + "_large_juice_beep_1.wav";
+        app.lever1_large_juice_audio_buffer = ws::audio::read_buffer(buff_p1.c_str());
 
-    //auto buff_p2 = std::string{ WS_RES_DIR } + "/sounds/" + app.animal1_name + "_small_juice_beep_" + std::to_string(app.tasktype) + ".wav";
-    auto buff_p2 = std::string{ WS_RES_DIR } + "/sounds/" + app.animal1_name + "_small_juice_beep_1.wav";
-    app.lever1_small_juice_audio_buffer = ws::audio::read_buffer(buff_p2.c_str());
+        //auto buff_p2 = std::string{ WS_RES_DIR } + "/sounds/" + app.animal1_name + "_small_juice_beep_" + std::to_string(app.tasktype) + ".wav";
+        auto buff_p2 = std::string{ WS_RES_DIR } + "/sounds/" + app.animal1_name + "_small_juice_beep_1.wav";
+        app.lever1_small_juice_audio_buffer = ws::audio::read_buffer(buff_p2.c_str());
+    }
 
     // define the threshold of pulling
     const float dflt_rising_edge = 0.45f;  // 0.6f
     const float dflt_falling_edge = 0.25f; // 0.25f
-    app.detect_pull[0].rising_edge = dflt_rising_edge;
-    app.detect_pull[1].rising_edge = dflt_rising_edge;
-    app.detect_pull[0].falling_edge = dflt_falling_edge;
-    app.detect_pull[1].falling_edge = dflt_falling_edge;
+    const double dflt_min_hold = 0.02; // s
+    const double dflt_max_sample_interval = 0.1; // s; the levers are read every ~10ms
+    for (auto& detect : app.detect_pull) {
+        detect.params.rising_edge = dflt_rising_edge;
+        detect.params.falling_edge = dflt_falling_edge;
+        detect.params.min_hold_s = dflt_min_hold;
+        detect.params.max_sample_interval_s = dflt_max_sample_interval;
+    }
+
+    // generate the session's trials
+    app.session_seed = ws::replay::random_seed();
+    app.trial_schedule = ws::make_trial_schedule(make_trial_schedule_params(app));
+
+    app.file_postfix = ws::date_string();
 
+    if (!app.dont_save_data) {
+        open_session_files(app);
+    }
 
+    // enter the first trial
+    app.trial_states.start(app);
 }
 
 void shutdown(App& app) {
     (void)app;
 
-    auto postfix = ws::date_string();
-    std::string trialrecords_name = app.experiment_date + "_" + app.animal1_name + "_" + app.animal2_name + "_TrialRecord_" + postfix + ".json";
-    std::string bhvdata_name = app.experiment_date + "_" + app.animal1_name + "_" + app.animal2_name + "_bhv_data_" + postfix + ".json";
-    std::string sessioninfo_name = app.experiment_date + "_" + app.animal1_name + "_" + app.animal2_name + "_session_info_" + postfix + ".json";
-    std::string leverread_name = app.experiment_date + "_" + app.animal1_name + "_" + app.animal2_name + "_lever_reading_" + postfix + ".json";
+    if (app.waveform_writer) {
+        ws::lever::set_sample_sink(app.lever_system, std::nullopt);
+        ws::close_waveform_writer(app.waveform_writer);
+        app.waveform_writer = nullptr;
+        if (app.dont_save_data) {
+            std::remove(app.waveform_file_path.c_str());
+        }
+    }
 
+    bool saved{};
     if (!app.dont_save_data) {
-        std::string file_path1 = std::string{ WS_DATA_DIR } + "/" + trialrecords_name;
-        std::ofstream output_file1(file_path1);
-        output_file1 << to_json(app.trial_records);
-
-        std::string file_path2 = std::string{ WS_DATA_DIR } + "/" + bhvdata_name;
-        std::ofstream output_file2(file_path2);
-        output_file2 << to_json(app.behavior_data);
-
-        // save some task information into session_info
-        SessionInfo session_info{};
-        session_info.animal1_name = app.animal1_name;
-        session_info.animal2_name = app.animal2_name;
-        session_info.experiment_date = app.experiment_date;
-        session_info.task_type = app.tasktype;
-        session_info.task_type_block = app.tasktype_block;
-        session_info.task_type_random = app.tasktype_random;
-        session_info.task_type_blocklength = app.block_length;
-        session_info.large_juice_volume = app.large_juice_volume;
-        session_info.small_juice_volume = app.small_juice_volume;
-        app.session_info.push_back(session_info);
-
-        std::string file_path3 = std::string{ WS_DATA_DIR } + "/" + sessioninfo_name;
-        std::ofstream output_file3(file_path3);
-        output_file3 << to_json(app.session_info);
+        app.session_info.push_back(make_session_info(app));
+        saved = finish_record_file(app, app.trial_records_file, "TrialRecord", app.trial_records);
+        saved &= finish_record_file(app, app.behavior_data_file, "bhv_data", app.behavior_data);
+        saved &= save_session_file(session_file_path(app, "session_info", ".json"), app.session_info);
+        saved &= finish_record_file(app, app.lever_readout_file, "lever_reading", app.lever_readout);
+    }
+    else {
+        ws::discard_session_record_file(&app.trial_records_file);
+        ws::discard_session_record_file(&app.behavior_data_file);
+        ws::discard_session_record_file(&app.lever_readout_file);
+    }
 
-        std::string file_path4 = std::string{ WS_DATA_DIR } + "/" + leverread_name;
-        std::ofstream output_file4(file_path4);
-        output_file4 << to_json(app.lever_readout);
+    // the data is safely on disk, or the user chose not to save it, so the log is no longer needed.
+    // if saving failed, keep it for recovery.
+    if (app.session_log) {
+        ws::append_session_end(app.session_log);
+        ws::close_write_ahead_log(app.session_log);
+        app.session_log = nullptr;
+        if (saved || app.dont_save_data) {
+            std::remove(app.session_log_path.c_str());
+        }
     }
 }
 
@@ -338,8 +552,19 @@ void render_lever_gui(App& app) {
     gui_params.num_serial_ports = int(app.ports.size());
     gui_params.num_levers = int(app.levers.size());
     gui_params.levers = app.levers.data();
-    gui_params.lever_system = ws::lever::get_global_lever_system();
+    gui_params.lever_system = app.lever_system;
     auto gui_res = ws::gui::render_lever_gui(gui_params);
+
+    if (gui_res.remove_lever_index) {
+        auto it = app.levers.begin() + gui_res.remove_lever_index.value();
+        ws::lever::remove_lever(gui_params.lever_system, *it);
+        app.levers.erase(it);
+    }
+    if (gui_res.add_lever) {
+        if (auto lever = ws::lever::add_lever(gui_params.lever_system)) {
+            app.levers.push_back(lever.value());
+        }
+    }
 }
 
 
@@ -347,6 +572,7 @@ void render_juice_pump_gui(App& app) {
     ws::gui::JuicePumpGUIParams gui_params{};
     gui_params.serial_ports = app.ports.data();
     gui_params.num_ports = int(app.ports.size());
+    gui_params.pump_system = app.pump_system;
     gui_params.num_pumps = 2;
     gui_params.allow_automated_run = app.allow_automated_juice_delivery;
     auto res = ws::gui::render_juice_pump_gui(gui_params);
@@ -378,7 +604,7 @@ void render_gui(App& app) {
 
     ImGui::Begin("GUI");
     if (ImGui::Button("Refresh ports")) {
-        app.ports = ws::enumerate_ports();
+        ws::request_port_rescan();
     }
     
     if (ImGui::Button("start the trial")) {
@@ -406,11 +632,17 @@ void render_gui(App& app) {
         ImGui::InputFloat2("PositionLimits1", lever_position_limits1);
 
         auto& detect = app.detect_pull;
-        if (ImGui::InputFloat("RisingEdge", &detect[0].rising_edge, 0.0f, 0.0f, "%0.3f", enter_flag)) {
-            detect[1].rising_edge = detect[0].rising_edge;
+        if (ImGui::InputFloat("RisingEdge", &detect[0].params.rising_edge, 0.0f, 0.0f, "%0.3f", enter_flag)) {
+            detect[1].params.rising_edge = detect[0].params.rising_edge;
+        }
+        if (ImGui::InputFloat("FallingEdge", &detect[0].params.falling_edge, 0.0f, 0.0f, "%0.3f", enter_flag)) {
+            detect[1].params.falling_edge = detect[0].params.falling_edge;
         }
-        if (ImGui::InputFloat("FallingEdge", &detect[0].falling_edge, 0.0f, 0.0f, "%0.3f", enter_flag)) {
-            detect[1].falling_edge = detect[1].rising_edge;
+        if (ImGui::InputFloat("MinPullVelocity", &detect[0].params.min_pull_velocity, 0.0f, 0.0f, "%0.3f", enter_flag)) {
+            detect[1].params.min_pull_velocity = detect[0].params.min_pull_velocity;
+        }
+        if (ImGui::InputDouble("MinHold", &detect[0].params.min_hold_s, 0.0, 0.0, "%0.3f", enter_flag)) {
+            detect[1].params.min_hold_s = detect[0].params.min_hold_s;
         }
 
         ImGui::TreePop();
@@ -436,6 +668,23 @@ void render_gui(App& app) {
     ImGui::Begin("JuicePump");
     render_juice_pump_gui(app);
     ImGui::End();
+
+    ImGui::Begin("Channels");
+    ws::gui::render_channel_gui();
+    ImGui::End();
+
+    ImGui::Begin("Trace");
+    if (ws::gui::render_trace_gui().save_trace) {
+        // open with chrome://tracing or ui.perfetto.dev
+        auto file_path = std::string{ WS_DATA_DIR } + "/trace_" + ws::date_string() + ".json";
+        if (ws::trace::write_chrome_trace(file_path)) {
+            std::cout << "Saved trace: " << file_path << std::endl;
+        }
+        else {
+            std::cout << "Failed to save trace: " << file_path << std::endl;
+        }
+    }
+    ImGui::End();
 }
 
 
@@ -450,369 +699,603 @@ float to_normalized(float v, float min, float max, bool inv) {
     return inv ? 1.0f - v : v;
 }
 
+float to_normalized_velocity(float v, float min, float max, bool inv) {
+    v = min == max ? 0.0f : v / (max - min);
+    return inv ? -v : v;
+}
 
-void task_update(App& app) {
-    using namespace ws;
+// run lever direction i's pull detector over the samples received since the last call, and replace
+// `*events` with the pulls and releases detected, oldest first. event times are the interpolated
+// threshold crossing times, except across samples that were lost.
+void update_pull_detector(App& app, int i, ws::lever::SerialLeverHandle lh, std::vector<LeverEvent>* events) {
+    constexpr int max_num_samples = 64;
+    ws::LeverState samples[max_num_samples];
+    float position[max_num_samples];
+    float velocity[max_num_samples];
+    ws::TimePoint time[max_num_samples];
+
+    events->clear();
+    auto* lever_sys = app.lever_system;
+    auto* cursor = &app.lever_sample_cursors[i];
+    while (true) {
+        const uint64_t prev_cursor = *cursor;
+        const int num_samples = ws::replay::read_samples(lever_sys, lh, cursor, samples, max_num_samples);
+        if (num_samples == 0) {
+            break;
+        }
+        // the cursor skips samples that fell out of the lever's history before they were read
+        if (*cursor - prev_cursor > uint64_t(num_samples)) {
+            ws::lever::mark_sample_gap(&app.detect_pull[i]);
+        }
 
-    static int state{};
-    static bool entry{ true };
-    static NewTrialState new_trial{};
-    static DelayState delay{};
-    static InnerDelayState innerdelay{};
-    static bool start_session_sound{ true };
+        const float min = app.lever_position_limits[2 * i];
+        const float max = app.lever_position_limits[2 * i + 1];
+        const bool inv = app.invert_lever_position[i];
+        for (int s = 0; s < num_samples; s++) {
+            position[s] = to_normalized(samples[s].position, min, max, inv);
+            velocity[s] = to_normalized_velocity(samples[s].velocity, min, max, inv);
+            time[s] = samples[s].sample_time;
+        }
 
+        ws::lever::PullSamples pull_samples{};
+        pull_samples.count = num_samples;
+        pull_samples.position = position;
+        pull_samples.velocity = velocity;
+        pull_samples.time = time;
+
+        // each sample completes at most one event
+        ws::lever::PullEvent batch_events[max_num_samples];
+        const int num_events = ws::lever::detect_pulls(&app.detect_pull[i], pull_samples, batch_events, max_num_samples);
+        for (int e = 0; e < num_events; e++) {
+            events->push_back(LeverEvent{ batch_events[e], samples[batch_events[e].sample_index] });
+        }
+    }
+}
 
+void NewTrial::enter(App& app) {
+    using namespace ws;
 
-    //
-    // renew for every new trial
-    if (entry && state == 0) {
+    // renew for every new trial: look it up in the session's schedule
+    app.current_trial = ws::trial_at(app.trial_schedule, app.trialnumber);
+    app.tasktype = app.current_trial.condition + 1;
+    app.juice2_delay_time = app.current_trial.juice2_delay_ms;
+
+    app.rewarded[0] = 0;
+    app.rewarded[1] = 0;
+    app.leverpulled[0] = false;
+    app.leverpulled[1] = false;
+    app.leverpulledtime[0] = 0;
+    app.leverpulledtime[1] = 0;
 
-        if (app.tasktype_random) {
-            app.tasktype = rand() % 2 + 1; // for the trial by trial randomization condition; 1: competition; 2: dilemma
-        }
-        if (app.tasktype_block) {
-            if (!app.tasktype_random) {
-                if ((app.trialnumber % app.block_length) == 0) {
-                    if (app.tasktype == 1) { app.tasktype = 2; }
-                    else if (app.tasktype == 2) { app.tasktype = 1; }
-                }
-            }
-            else if (app.tasktype_random) {
-                app.block_length = app.block_length;
-                if (app.trialnumber % app.block_length == 0) {
-                    if (app.tasktype == 1) { app.tasktype = 2; }
-                    else if (app.tasktype == 2) { app.tasktype = 1; }
-                }
-            }
-        }
 
-        if (app.tasktype == 1) {
-            app.juice2_delay_time = 1500;
+    // sound to indicate the start of a TRIAL
+    if (app.play_trial_start_sound) {
+        if (app.tasktype == 1 && app.start_trial_audio_buffer_task1) {
+            ws::audio::play_buffer_both(app.audio_route, app.start_trial_audio_buffer_task1.value(), 0.5f);
         }
-        else if (app.tasktype == 2) {
-            app.juice2_delay_time = 750;
+        else if (app.tasktype == 2 && app.start_trial_audio_buffer_task2) {
+            ws::audio::play_buffer_both(app.audio_route, app.start_trial_audio_buffer_task2.value(), 0.5f);
         }
+    }
+    // get the session start time
+    if (app.trialnumber == 0) {
+        app.session_start_time = ws::replay::now();
+    }
+
+    // end session when trialnumber or total sesison time reach the threshold
+    //if (app.trialnumber > app.total_trial_number || elapsed_time(app.session_start_time, now()) > app.new_total_time) {
+    //  abort;
+    //}
+
+    // push the lever force back to normal
+    // if (app.allow_auto_lever_force_set) {
+    //     ws::lever::set_force(ws::lever::get_global_lever_system(), app.levers[0], app.normalforce);
+    //     ws::lever::set_force(ws::lever::get_global_lever_system(), app.levers[1], app.normalforce);
+    // }
+
+    // stimuli for this trial's task type
+    if (app.tasktype == 0) {
+        new_trial.stim0_image = std::nullopt;
+        new_trial.stim1_image = std::nullopt;
+        new_trial.stim0_color = app.stim0_color_noreward;
+        new_trial.stim1_color = app.stim1_color_noreward;
+    }
+    else if (app.tasktype == 1) {
+        new_trial.stim0_image = std::nullopt;
+        new_trial.stim1_image = std::nullopt;
+        new_trial.stim0_color = app.stim0_color;
+        new_trial.stim1_color = app.stim1_color;
+    }
+    else if (app.tasktype == 2) {
+        new_trial.stim0_image = app.debug_image;
+        new_trial.stim1_image = app.debug_image;
+    }
 
-        app.rewarded[0] = 0;
-        app.rewarded[1] = 0;
-        app.leverpulled[0] = false;
-        app.leverpulled[1] = false;
-        app.leverpulledtime[0] = 0;
-        app.leverpulledtime[1] = 0;
+    if (app.allow_automated_juice_delivery) {
+        auto pump_handle = ws::pump::ith_pump(1); // pump id: 0 - pump 1; 1 - pump 2
+        ws::pump::run_dispense_program(app.pump_system, pump_handle);
+    }
+}
 
+ws::fsm::Emits<TrialTimedOut> NewTrial::tick(App& app) {
+    using namespace ws;
 
-        // sound to indicate the start of a TRIAL
-        if (start_session_sound) {
-            if (app.tasktype == 1) {
-                ws::audio::play_buffer_both(app.start_trial_audio_buffer_task1.value(), 0.5f);
-            }
-            else if (app.tasktype == 2) {
-                ws::audio::play_buffer_both(app.start_trial_audio_buffer_task2.value(), 0.5f);
-            }
-            start_session_sound = true;
-        }
-        // get the session start time
-        if (app.trialnumber == 0) {
-            app.session_start_time = now();
-        }
+    new_trial.total_time = app.new_total_time;
+    new_trial.stim0_offset = app.stim0_offset;
+    new_trial.stim0_size = app.stim0_size;
+    new_trial.stim1_offset = app.stim1_offset;
+    new_trial.stim1_size = app.stim1_size;
 
-        // end session when trialnumber or total sesison time reach the threshold
-        //if (app.trialnumber > app.total_trial_number || elapsed_time(app.session_start_time, now()) > app.new_total_time) {
-        //  abort;
-        //}
+    auto nt_res = tick_new_trial(&new_trial, &entry);
+    if (nt_res.finished) {
+        return TrialTimedOut{};
+    }
+    return {};
+}
+
+void Juice1Delay::enter(App& app) {
+    delay.total_time = float(app.juice1_delay_time) * 1e-3f;
+    (void)ws::tick_delay(&delay, &entry); // start timing now, not at the first tick
+}
 
-        // push the lever force back to normal
-        // if (app.allow_auto_lever_force_set) {
-        //     ws::lever::set_force(ws::lever::get_global_lever_system(), app.levers[0], app.normalforce);
-        //     ws::lever::set_force(ws::lever::get_global_lever_system(), app.levers[1], app.normalforce);
-        // }
+ws::fsm::Emits<Juice1Delivered> Juice1Delay::tick(App& app) {
+    using namespace ws;
+
+    if (!tick_delay(&delay, &entry)) {
+        return {};
     }
 
-    // check the levers
-    for (int i = 0; i < 2; i++) {
-        // const auto lh = app.levers[i];
-        const auto lh = app.levers[0];
-        auto& pd = app.detect_pull[i];
-        if (auto lever_state = ws::lever::get_state(ws::lever::get_global_lever_system(), lh)) {
-            ws::lever::PullDetectParams params{};
-            params.current_position = to_normalized(
-                lever_state.value().potentiometer_reading,
-                app.lever_position_limits[2 * i],
-                app.lever_position_limits[2 * i + 1],
-                app.invert_lever_position[i]);
-            auto pull_res = ws::lever::detect_pull(&pd, params);
-            if (pull_res.pulled_lever) {
-
-
-                // trial starts # 1
-                // trial starts whenever one of the animal pulls
-                if (!app.leverpulled[0] || !app.leverpulled[1]) {
-                    app.trialnumber = app.trialnumber + 1;
-                    app.first_pull_id = i + 1;
-                    app.timepoint = 0;
-                    app.trialstart_time = now();
-                    app.trial_start_time_forsave = elapsed_time(app.session_start_time, now());
-                    app.first_pull_time = now();
-                    app.behavior_event = 0; // start of a trial
-                    BehaviorData time_stamps{};
-                    time_stamps.trial_number = app.trialnumber;
-                    time_stamps.time_points = app.timepoint;
-                    time_stamps.behavior_events = app.behavior_event;
-                    app.behavior_data.push_back(time_stamps);
-                }
+    // deliver the juice for animal 1
+    auto pump_handle1_1 = ws::pump::ith_pump(abs(app.first_pull_id - 1)); // pump id: 0 - pump 1; 1 - pump 2  -WS 
+    ws::pump::run_dispense_program(app.pump_system, pump_handle1_1);
+    app.getreward[app.first_pull_id - 1] = true;
+    app.rewarded[app.first_pull_id - 1] = 1;
+    //
+    app.timepoint = elapsed_time(app.trialstart_time, ws::replay::now());
+    app.behavior_event = abs(app.first_pull_id - 1) + 3; // pump 1 or 2 deliver  
+    ws::BehaviorData time_stamps3{};
+    time_stamps3.trial_number = app.trialnumber;
+    time_stamps3.time_points = app.timepoint;
+    time_stamps3.behavior_events = app.behavior_event;
+    log_record(app, app.behavior_data, time_stamps3);
+    return Juice1Delivered{};
+}
 
+void Juice2Delay::enter(App& app) {
+    delay.total_time = float(app.juice2_delay_time) * 1e-3f;
+    (void)ws::tick_delay(&delay, &entry); // start timing now, not at the first tick
+}
 
-                // save some behavioral events data
-                app.timepoint = elapsed_time(app.trialstart_time, now());
-                app.behavior_event = i + 1; // lever i+1 (1 or 2) is pulled
-                app.other_pull_time = elapsed_time(app.first_pull_time, now());
-                BehaviorData time_stamps2{};
-                time_stamps2.trial_number = app.trialnumber;
-                time_stamps2.time_points = app.timepoint;
-                time_stamps2.behavior_events = app.behavior_event;
-                app.behavior_data.push_back(time_stamps2);
-
-                // save some lever information data
-                LeverReadout lever_read{};
-                lever_read.trial_number = app.trialnumber;
-                lever_read.readout_timepoint = app.timepoint;
-                lever_read.strain_gauge_lever = lever_state.value().strain_gauge;
-                lever_read.potentiometer_lever = lever_state.value().potentiometer_reading;
-                lever_read.lever_id = i + 1;
-                lever_read.pull_or_release = int(pull_res.pulled_lever);
-                app.lever_readout.push_back(lever_read);
-
-                app.leverpulled[i] = true;
-
-
-                // deliver juice accordingly
-                // competition condition
-                if (app.tasktype == 1) {
-                    // sound cue
-                    // the aninal who pulls get large reward
-                    if (i == 0) {
-                        // ws::audio::play_buffer_on_channel(app.lever1_large_juice_audio_buffer.value(), abs(i - 1), 0.5f
-                        ws::audio::play_buffer_both(app.lever1_large_juice_audio_buffer.value(), 0.5f);
-                    }
-                    else if (i == 1) {
-                        // ws::audio::play_buffer_on_channel(app.lever1_small_juice_audio_buffer.value(), abs(i), 0.5f);
-                        ws::audio::play_buffer_both(app.lever1_small_juice_audio_buffer.value(), 0.5f);
-                    }
-                    // juice delivery time       
-                    // the aninal who pulls get large reward      
-                    // set the reward size - the delivery will happen in (states==1)
-                    auto pump_handle1 = ws::pump::ith_pump(abs(i)); // pump id: 0 - pump 1; 1 - pump 2  -WS 
-                    auto desired_pump_state1 = ws::pump::read_desired_pump_state(pump_handle1);
-                    desired_pump_state1.volume = app.large_juice_volume;
-                    ws::pump::set_dispensed_volume(pump_handle1, desired_pump_state1.volume, desired_pump_state1.volume_units);
-                    //        
-                    // the aninal who does not pull get small reward
-                    // set the reward size - the delivery will happen in (states==1)
-                    auto pump_handle2 = ws::pump::ith_pump(abs(i - 1)); // pump id: 0 - pump 1; 1 - pump 2  -WS              
-                    auto desired_pump_state2 = ws::pump::read_desired_pump_state(pump_handle2);
-                    desired_pump_state2.volume = app.small_juice_volume;
-                    ws::pump::set_dispensed_volume(pump_handle2, desired_pump_state2.volume, desired_pump_state2.volume_units);                    
-                }
+ws::fsm::Emits<Juice2Delivered> Juice2Delay::tick(App& app) {
+    using namespace ws;
 
-                // social dilemma condition
-                else if (app.tasktype == 2) {
-                    // sound cue
-                    // the aninal who pulls get large reward
-                    if (i == 1) {
-                        // ws::audio::play_buffer_on_channel(app.lever1_large_juice_audio_buffer.value(), abs(i - 1), 0.5f
-                        ws::audio::play_buffer_both(app.lever1_large_juice_audio_buffer.value(), 0.5f);
-                    }
-                    else if (i == 0) {
-                        // ws::audio::play_buffer_on_channel(app.lever1_small_juice_audio_buffer.value(), abs(i), 0.5f);
-                        ws::audio::play_buffer_both(app.lever1_small_juice_audio_buffer.value(), 0.5f);
-                    }
-
-                    // juice delivery time       
-                    // the aninal who pulls get large reward      
-                    // set the reward size - the delivery will happen in (states==1)
-                    auto pump_handle1 = ws::pump::ith_pump(abs(i)); // pump id: 0 - pump 1; 1 - pump 2  -WS 
-                    auto desired_pump_state1 = ws::pump::read_desired_pump_state(pump_handle1);
-                    desired_pump_state1.volume = app.small_juice_volume;
-                    ws::pump::set_dispensed_volume(pump_handle1, desired_pump_state1.volume, desired_pump_state1.volume_units);
-                    //        
-                    // the aninal who does not pull get small reward
-                    // set the reward size - the delivery will happen in (states==1)
-                    auto pump_handle2 = ws::pump::ith_pump(abs(i - 1)); // pump id: 0 - pump 1; 1 - pump 2  -WS              
-                    auto desired_pump_state2 = ws::pump::read_desired_pump_state(pump_handle2);
-                    desired_pump_state2.volume = app.large_juice_volume;
-                    ws::pump::set_dispensed_volume(pump_handle2, desired_pump_state2.volume, desired_pump_state2.volume_units);
-                }
+    if (!tick_delay(&delay, &entry)) {
+        return {};
+    }
 
-                
-                // define the start of the new trial
-                else if (lever_read.lever_id == app.first_pull_id) {
+    // deliver the juice for animal 2
+    auto pump_handle2_1 = ws::pump::ith_pump(abs(app.first_pull_id - 1 - 1)); // pump id: 0 - pump 1; 1 - pump 2  -WS
+    ws::pump::run_dispense_program(app.pump_system, pump_handle2_1);
+    app.getreward[abs(app.first_pull_id - 1 - 1)] = true;
+    app.rewarded[abs(app.first_pull_id - 1 - 1)] = 1;
+    //
+    app.timepoint = elapsed_time(app.trialstart_time, ws::replay::now());
+    app.behavior_event = abs(app.first_pull_id - 1 - 1) + 3; // pump 1 or 2 deliver  
+    ws::BehaviorData time_stamps4{};
+    time_stamps4.trial_number = app.trialnumber;
+    time_stamps4.time_points = app.timepoint;
+    time_stamps4.behavior_events = app.behavior_event;
+    log_record(app, app.behavior_data, time_stamps4);
+    return Juice2Delivered{};
+}
 
-                    // old edition
-                    app.first_pull_time = now();
-                    
-                }
+void AfterDelivery::enter(App& app) {
+    delay.total_time = float(app.after_delivery_time) * 1e-3f;
+    (void)ws::tick_delay(&delay, &entry); // start timing now, not at the first tick
+}
 
-            }
+ws::fsm::Emits<RewardDelivered> AfterDelivery::tick(App& app) {
+    using namespace ws;
 
+    if (!tick_delay(&delay, &entry)) {
+        return {};
+    }
 
-            else if (pull_res.released_lever) {
-  
-                // save some lever information data
-                LeverReadout lever_read{};
-                lever_read.trial_number = app.trialnumber;
-                lever_read.readout_timepoint = elapsed_time(app.trialstart_time, now());;           
-                lever_read.strain_gauge_lever = lever_state.value().strain_gauge;
-                lever_read.potentiometer_lever = lever_state.value().potentiometer_reading;
-                lever_read.lever_id = i + 1;
-                lever_read.pull_or_release = int(pull_res.pulled_lever);
-                app.lever_readout.push_back(lever_read);
+    app.timepoint = elapsed_time(app.trialstart_time, ws::replay::now());
+    app.behavior_event = 9; // end of a trial
+    ws::BehaviorData time_stamps{};
+    time_stamps.trial_number = app.trialnumber;
+    time_stamps.time_points = app.timepoint;
+    time_stamps.behavior_events = app.behavior_event;
+    log_record(app, app.behavior_data, time_stamps);
+    app.getreward[0] = false;
+    app.getreward[1] = false;
+    return RewardDelivered{};
+}
 
-                // end of trial
-                state = 1;
+ws::fsm::Emits<TrialSaved> SaveTrial::tick(App& app) {
+    ws::TrialRecord trial_record{};
+    trial_record.trial_number = app.trialnumber;
+    trial_record.first_pull_id = app.first_pull_id;
+    trial_record.rewarded = app.rewarded[0] + app.rewarded[1];
+    trial_record.task_type = app.tasktype;
+    trial_record.trial_start_time_stamp = app.trial_start_time_forsave;
+    //  Add to the array of trials.
+    log_record(app, app.trial_records, trial_record);
+    return TrialSaved{};
+}
 
-            }
+// log the task parameters edited since the last update, or apply the logged edits when replaying
+void sync_task_parameters(App& app) {
+    using ws::replay::parameter;
+
+    parameter(TaskParameter_TaskType, &app.tasktype);
+    parameter(TaskParameter_TaskTypeBlock, &app.tasktype_block);
+    parameter(TaskParameter_TaskTypeRandom, &app.tasktype_random);
+    parameter(TaskParameter_BlockLength, &app.block_length);
+    parameter(TaskParameter_AllowAutomatedJuiceDelivery, &app.allow_automated_juice_delivery);
+    parameter(TaskParameter_Juice1DelayTime, &app.juice1_delay_time);
+    parameter(TaskParameter_Juice2DelayTime, &app.juice2_delay_time);
+    parameter(TaskParameter_AfterDeliveryTime, &app.after_delivery_time);
+    parameter(TaskParameter_LargeJuiceVolume, &app.large_juice_volume);
+    parameter(TaskParameter_SmallJuiceVolume, &app.small_juice_volume);
+    parameter(TaskParameter_NewTotalTime, &app.new_total_time);
+    parameter(TaskParameter_PlayTrialStartSound, &app.play_trial_start_sound);
+
+    for (uint32_t i = 0; i < 2; i++) {
+        auto& params = app.detect_pull[i].params;
+        const uint32_t pull_detect = TaskParameter_PullDetect + 4 * i;
+        parameter(pull_detect, &params.rising_edge);
+        parameter(pull_detect + 1, &params.falling_edge);
+        parameter(pull_detect + 2, &params.min_pull_velocity);
+        parameter(pull_detect + 3, &params.min_hold_s);
+        parameter(TaskParameter_LeverPositionLimits + 2 * i, &app.lever_position_limits[2 * i]);
+        parameter(TaskParameter_LeverPositionLimits + 2 * i + 1, &app.lever_position_limits[2 * i + 1]);
+        parameter(TaskParameter_InvertLeverPosition + i, &app.invert_lever_position[i]);
+    }
+}
 
-             
-        }
+// a pull of lever direction i, detected at `pull_time`; `sample` is the lever sample the pull was
+// detected on.
+void handle_lever_pull(App& app, int i, const ws::TimePoint& pull_time, const ws::LeverState& sample) {
+    using namespace ws;
+
+    // trial starts # 1
+    // trial starts whenever one of the animal pulls
+    if (!app.leverpulled[0] || !app.leverpulled[1]) {
+        app.trialnumber = app.trialnumber + 1;
+        app.first_pull_id = i + 1;
+        app.timepoint = 0;
+        app.trialstart_time = pull_time;
+        app.trial_start_time_forsave = elapsed_time(app.session_start_time, pull_time);
+        app.first_pull_time = pull_time;
+        app.behavior_event = 0; // start of a trial
+        ws::BehaviorData time_stamps{};
+        time_stamps.trial_number = app.trialnumber;
+        time_stamps.time_points = app.timepoint;
+        time_stamps.behavior_events = app.behavior_event;
+        log_record(app, app.behavior_data, time_stamps);
     }
 
 
-    switch (state) {
-    case 0: {
-        // new_trial.play_sound_on_entry = app.start_trial_audio_buffer;
-        new_trial.total_time = app.new_total_time;
-        new_trial.stim0_offset = app.stim0_offset;
-        new_trial.stim0_size = app.stim0_size;
-        new_trial.stim1_offset = app.stim1_offset;
-        new_trial.stim1_size = app.stim1_size;
-        if (app.tasktype == 0) {
-            //auto buff_p = std::string{ WS_RES_DIR } + "/sounds/start_trial_beep.wav";
-            //app.start_trial_audio_buffer = ws::audio::read_buffer(buff_p.c_str());
-            // auto debug_image_p = std::string{ WS_RES_DIR } + "/images/calla_leaves.png";
-            // app.debug_image = ws::gfx::read_2d_image(debug_image_p.c_str());
-            //
-            new_trial.stim0_image = std::nullopt;
-            new_trial.stim1_image = std::nullopt;
-            new_trial.stim0_color = app.stim0_color_noreward;
-            new_trial.stim1_color = app.stim1_color_noreward;
+    // save some behavioral events data
+    app.timepoint = elapsed_time(app.trialstart_time, pull_time);
+    app.behavior_event = i + 1; // lever i+1 (1 or 2) is pulled
+    app.other_pull_time = elapsed_time(app.first_pull_time, pull_time);
+    ws::BehaviorData time_stamps2{};
+    time_stamps2.trial_number = app.trialnumber;
+    time_stamps2.time_points = app.timepoint;
+    time_stamps2.behavior_events = app.behavior_event;
+    log_record(app, app.behavior_data, time_stamps2);
+
+    // save some lever information data
+    ws::LeverReadout lever_read{};
+    lever_read.trial_number = app.trialnumber;
+    lever_read.readout_timepoint = app.timepoint;
+    lever_read.strain_gauge_lever = sample.strain_gauge;
+    lever_read.potentiometer_lever = sample.potentiometer_reading;
+    lever_read.lever_id = i + 1;
+    lever_read.pull_or_release = 1;
+    log_record(app, app.lever_readout, lever_read);
+
+    app.leverpulled[i] = true;
+
+
+    // deliver juice accordingly
+    // competition condition
+    if (app.tasktype == 1) {
+        // sound cue
+        // the aninal who pulls get large reward
+        if (i == 0 && app.lever1_large_juice_audio_buffer) {
+            // ws::audio::play_buffer_on_channel(app.lever1_large_juice_audio_buffer.value(), abs(i - 1), 0.5f
+            ws::audio::play_buffer_both(app.audio_route, app.lever1_large_juice_audio_buffer.value(), 0.5f);
         }
-        else if (app.tasktype == 1) {
-            //auto buff_p = std::string{ WS_RES_DIR } + "/sounds/start_trial_beep.wav";
-            //app.start_trial_audio_buffer = ws::audio::read_buffer(buff_p.c_str());
-            //
-            new_trial.stim0_image = std::nullopt;
-            new_trial.stim1_image = std::nullopt;
-            new_trial.stim0_color = app.stim0_color;
-            new_trial.stim1_color = app.stim1_color;
+        else if (i == 1 && app.lever1_small_juice_audio_buffer) {
+            // ws::audio::play_buffer_on_channel(app.lever1_small_juice_audio_buffer.value(), abs(i), 0.5f);
+            ws::audio::play_buffer_both(app.audio_route, app.lever1_small_juice_audio_buffer.value(), 0.5f);
+        }
+        // juice delivery time       
+        // the aninal who pulls get large reward      
+        // set the reward size - the delivery will happen in (states==1)
+        auto pump_handle1 = ws::pump::ith_pump(abs(i)); // pump id: 0 - pump 1; 1 - pump 2  -WS 
+        auto desired_pump_state1 = ws::pump::read_desired_pump_state(app.pump_system, pump_handle1);
+        desired_pump_state1.volume = app.current_trial.large_juice_volume;
+        ws::pump::set_dispensed_volume(app.pump_system, pump_handle1, desired_pump_state1.volume, desired_pump_state1.volume_units);
+        //        
+        // the aninal who does not pull get small reward
+        // set the reward size - the delivery will happen in (states==1)
+        auto pump_handle2 = ws::pump::ith_pump(abs(i - 1)); // pump id: 0 - pump 1; 1 - pump 2  -WS              
+        auto desired_pump_state2 = ws::pump::read_desired_pump_state(app.pump_system, pump_handle2);
+        desired_pump_state2.volume = app.current_trial.small_juice_volume;
+        ws::pump::set_dispensed_volume(app.pump_system, pump_handle2, desired_pump_state2.volume, desired_pump_state2.volume_units);                    
+    }
+
+    // social dilemma condition
+    else if (app.tasktype == 2) {
+        // sound cue
+        // the aninal who pulls get large reward
+        if (i == 1 && app.lever1_large_juice_audio_buffer) {
+            // ws::audio::play_buffer_on_channel(app.lever1_large_juice_audio_buffer.value(), abs(i - 1), 0.5f
+            ws::audio::play_buffer_both(app.audio_route, app.lever1_large_juice_audio_buffer.value(), 0.5f);
         }
-        else if (app.tasktype == 2) {
-            //auto buff_p = std::string{ WS_RES_DIR } + "/sounds/start_trial_beep.wav";
-            //app.start_trial_audio_buffer = ws::audio::read_buffer(buff_p.c_str());
-            //auto debug_image_p = std::string{ WS_RES_DIR } + "/images/blue_triangle.png";
-           // app.debug_image = ws::gfx::read_2d_image(debug_image_p.c_str());
-            //
-            new_trial.stim0_image = app.debug_image;
-            new_trial.stim1_image = app.debug_image;
+        else if (i == 0 && app.lever1_small_juice_audio_buffer) {
+            // ws::audio::play_buffer_on_channel(app.lever1_small_juice_audio_buffer.value(), abs(i), 0.5f);
+            ws::audio::play_buffer_both(app.audio_route, app.lever1_small_juice_audio_buffer.value(), 0.5f);
         }
+
+        // juice delivery time       
+        // the aninal who pulls get large reward      
+        // set the reward size - the delivery will happen in (states==1)
+        auto pump_handle1 = ws::pump::ith_pump(abs(i)); // pump id: 0 - pump 1; 1 - pump 2  -WS 
+        auto desired_pump_state1 = ws::pump::read_desired_pump_state(app.pump_system, pump_handle1);
+        desired_pump_state1.volume = app.current_trial.small_juice_volume;
+        ws::pump::set_dispensed_volume(app.pump_system, pump_handle1, desired_pump_state1.volume, desired_pump_state1.volume_units);
+        //        
+        // the aninal who does not pull get small reward
+        // set the reward size - the delivery will happen in (states==1)
+        auto pump_handle2 = ws::pump::ith_pump(abs(i - 1)); // pump id: 0 - pump 1; 1 - pump 2  -WS              
+        auto desired_pump_state2 = ws::pump::read_desired_pump_state(app.pump_system, pump_handle2);
+        desired_pump_state2.volume = app.current_trial.large_juice_volume;
+        ws::pump::set_dispensed_volume(app.pump_system, pump_handle2, desired_pump_state2.volume, desired_pump_state2.volume_units);
+    }
+
+    
+    // define the start of the new trial
+    else if (lever_read.lever_id == app.first_pull_id) {
+
+        // old edition
+        app.first_pull_time = ws::replay::now();
         
+    }
+}
 
+// a release of lever direction i at `release_time`, detected on `sample`; ends the trial.
+void handle_lever_release(App& app, int i, const ws::TimePoint& release_time, const ws::LeverState& sample) {
+    using namespace ws;
 
-        if (entry && app.allow_automated_juice_delivery) {
-            auto pump_handle = ws::pump::ith_pump(1); // pump id: 0 - pump 1; 1 - pump 2
-            ws::pump::run_dispense_program(pump_handle);
-        }
+    // save some lever information data
+    ws::LeverReadout lever_read{};
+    lever_read.trial_number = app.trialnumber;
+    lever_read.readout_timepoint = elapsed_time(app.trialstart_time, release_time);
+    lever_read.strain_gauge_lever = sample.strain_gauge;
+    lever_read.potentiometer_lever = sample.potentiometer_reading;
+    lever_read.lever_id = i + 1;
+    lever_read.pull_or_release = 0;
+    log_record(app, app.lever_readout, lever_read);
+
+    // end of trial
+    app.trial_states.dispatch<LeverReleased>(app);
+}
 
+void task_update(App& app) {
+    using namespace ws;
+
+    if (!ws::replay::begin_frame()) {
+        return;
+    }
+    sync_task_parameters(app);
 
-        auto nt_res = tick_new_trial(&new_trial, &entry);
-        if (nt_res.finished) {
-            state = 1;
-            entry = true;
+    // SaveData can be checked during the session
+    if (!app.dont_save_data && !app.session_files_opened) {
+        open_session_files(app);
+    }
+
+    // levers can be added and removed from the gui, so whether there is one is an input too
+    bool has_lever = !app.levers.empty();
+    ws::replay::parameter(TaskParameter_HasLever, &has_lever);
+
+    // the pull detectors follow the first lever. when it is replaced, start over on the new lever's
+    // samples, rather than from the old lever's read position and detector state.
+    int lever_id = has_lever ? int(app.levers[0].id) : 0;
+    ws::replay::parameter(TaskParameter_PullDetectLever, &lever_id);
+    if (lever_id != app.pull_detect_lever_id) {
+        app.pull_detect_lever_id = lever_id;
+        for (int i = 0; i < 2; i++) {
+            app.lever_sample_cursors[i] = 0;
+            ws::lever::reset_pull_detector(&app.detect_pull[i]);
         }
-        break;
     }
 
-    case 1: {
+    // check the levers. every pull and release is handled in the order it happened, with its own
+    // time and sample, so a pull and release that arrive together are both seen. the detectors keep
+    // running between trials, but only events during NewTrial belong to a trial: pulls while the
+    // rewards are delivered, or before the trial is saved, are not counted towards the next one.
+    for (int i = 0; i < 2 && has_lever; i++) {
+        // const auto lh = app.levers[i];
+        const auto lh = app.levers[0];
+        if (ws::replay::get_state(app.lever_system, lh)) {
+            update_pull_detector(app, i, lh, &app.lever_events);
+            for (const auto& ev : app.lever_events) {
+                if (!app.trial_states.is_in<NewTrial>()) {
+                    break;
+                }
+                if (ev.event.pulled) {
+                    handle_lever_pull(app, i, ev.event.time, ev.sample);
+                }
+                else if (ev.event.released) {
+                    handle_lever_release(app, i, ev.event.time, ev.sample);
+                }
+            }
+        }
+    }
 
-        // juice delivery time       
-        // deliver the juice for animal 1
-        std::this_thread::sleep_for(std::chrono::milliseconds(app.juice1_delay_time));
-        auto pump_handle1_1 = ws::pump::ith_pump(abs(app.first_pull_id - 1)); // pump id: 0 - pump 1; 1 - pump 2  -WS 
-        ws::pump::run_dispense_program(pump_handle1_1);
-        ws::pump::submit_commands();
-        app.getreward[app.first_pull_id - 1] = true;
-        app.rewarded[app.first_pull_id - 1] = 1;
-        //
-        app.timepoint = elapsed_time(app.trialstart_time, now());
-        app.behavior_event = abs(app.first_pull_id - 1) + 3; // pump 1 or 2 deliver  
-        BehaviorData time_stamps3{};
-        time_stamps3.trial_number = app.trialnumber;
-        time_stamps3.time_points = app.timepoint;
-        time_stamps3.behavior_events = app.behavior_event;
-        app.behavior_data.push_back(time_stamps3);
-
-        // deliver the juice for animal 2
-        std::this_thread::sleep_for(std::chrono::milliseconds(app.juice2_delay_time));
-        auto pump_handle2_1 = ws::pump::ith_pump(abs(app.first_pull_id - 1 - 1)); // pump id: 0 - pump 1; 1 - pump 2  -WS
-        ws::pump::run_dispense_program(pump_handle2_1);
-        ws::pump::submit_commands();
-        app.getreward[abs(app.first_pull_id - 1 - 1)] = true;
-        app.rewarded[abs(app.first_pull_id - 1 - 1)] = 1;
-        //
-        app.timepoint = elapsed_time(app.trialstart_time, now());
-        app.behavior_event = abs(app.first_pull_id - 1 - 1) + 3; // pump 1 or 2 deliver  
-        BehaviorData time_stamps4{};
-        time_stamps4.trial_number = app.trialnumber;
-        time_stamps4.time_points = app.timepoint;
-        time_stamps4.behavior_events = app.behavior_event;
-        app.behavior_data.push_back(time_stamps4);
-
-        state = 2;
-        entry = true;
-        std::this_thread::sleep_for(std::chrono::milliseconds(app.after_delivery_time));
-        app.timepoint = elapsed_time(app.trialstart_time, now());
-        app.behavior_event = 9; // end of a trial
-        BehaviorData time_stamps{};
-        time_stamps.trial_number = app.trialnumber;
-        time_stamps.time_points = app.timepoint;
-        time_stamps.behavior_events = app.behavior_event;
-        app.behavior_data.push_back(time_stamps);
-        app.getreward[0] = false;
-        app.getreward[1] = false;
-        break;
+    app.trial_states.tick(app);
+    write_full_record_chunks(app);
+}
 
+
+
+// re-run a recorded session as fast as possible, with the recorded inputs in place of the live
+// ones. the session's data is saved as usual.
+int run_replay(App& app, const char* file_path) {
+    if (!ws::replay::start_replay(file_path)) {
+        std::cout << "Failed to open replay log: " << file_path << std::endl;
+        return 1;
+    }
+
+    app.headless = true;
+    app.levers.resize(1); // the lever's state is read from the log
+    app.lever_system = ws::lever::get_global_lever_system();
+    app.pump_system = ws::pump::get_global_pump_system();
+    const auto t0 = ws::now();
+
+    setup(app);
+    int num_updates{};
+    while (!ws::replay::replay_finished()) {
+        task_update(app);
+        ws::gfx::discard_frame();
+        num_updates++;
     }
+    shutdown(app);
 
-    // save some data
-    case 2: {
+    std::cout << "Replayed " << num_updates << " task updates, " << app.trialnumber << " trials in "
+        << ws::elapsed_time(t0, ws::now()) << " s." << std::endl;
+    const bool diverged = ws::replay::replay_diverged();
+    if (diverged) {
+        std::cout << "The task diverged from the recorded session." << std::endl;
+    }
+    ws::replay::stop();
+    return diverged ? 1 : 0;
+}
 
-        TrialRecord trial_record{};
-        trial_record.trial_number = app.trialnumber;
-        trial_record.first_pull_id = app.first_pull_id;
-        trial_record.rewarded = app.rewarded[0] + app.rewarded[1];
-        trial_record.task_type = app.tasktype;
-        trial_record.trial_start_time_stamp = app.trial_start_time_forsave;
-        //  Add to the array of trials.
-        app.trial_records.push_back(trial_record);
+// set by ctrl+c, to end the sessions of a multi-rig run
+volatile std::sig_atomic_t rigs_interrupted{};
 
- 
-        state = 0;
-        entry = true;
-        break;
+void on_rigs_interrupt(int) {
+    rigs_interrupted = 1;
+}
+
+// run several rigs from one process, each with its own levers, pumps, speakers and task thread,
+// without windows. the rigs are described by a json file:
+//   { "audio_output_channels": 4,
+//     "rigs": [ { "name": "box1", "lever_ports": ["COM3"], "pump_port": "COM4", "num_pumps": 2,
+//                 "audio_channels": [0, 1], "animal1_name": "Vermelho", "animal2_name": "Koala",
+//                 "allow_automated_juice_delivery": false }, ... ] }
+// every field but "rigs" is optional. each rig's data is saved under its animals' names, as usual,
+// when the sessions end on ctrl+c.
+int run_rigs(const char* config_path) {
+    std::ifstream file(config_path);
+    auto config = nlohmann::json::parse(file, nullptr, false);
+    if (config.is_discarded()) {
+        std::cout << "Failed to read rig config: " << config_path << std::endl;
+        return 1;
+    }
+
+    auto params = ws::make_default_rig_host_params();
+    std::vector<ws::RigConfig> rigs;
+    std::vector<std::unique_ptr<App>> apps;
+    try {
+        params.num_audio_output_channels = config.value("audio_output_channels", params.num_audio_output_channels);
+        for (auto& rig_config : config.at("rigs")) {
+            ws::RigConfig rig{};
+            rig.name = rig_config.value("name", "rig" + std::to_string(rigs.size() + 1));
+            rig.lever_ports = rig_config.value("lever_ports", std::vector<std::string>{});
+            rig.pump_port = rig_config.value("pump_port", std::string{});
+            rig.num_pumps = rig_config.value("num_pumps", 2);
+            // a single channel plays both of a sound's channels
+            auto channels = rig_config.value("audio_channels", std::vector<int>{ 0, 1 });
+            rig.audio_route = ws::audio::make_default_output_route();
+            if (!channels.empty()) {
+                rig.audio_route.channels[0] = channels[0];
+                rig.audio_route.channels[1] = channels.size() > 1 ? channels[1] : channels[0];
+            }
+
+            // rig names go in the rigs' output file names, which must not collide
+            for (auto& other : rigs) {
+                if (other.name == rig.name) {
+                    std::cout << "Invalid rig config: " << config_path << " (rig name \"" << rig.name << "\" is used more than once)" << std::endl;
+                    return 1;
+                }
+            }
+
+            auto app = std::make_unique<App>();
+            app->rig_name = rig.name;
+            app->animal1_name = rig_config.value("animal1_name", app->animal1_name);
+            app->animal2_name = rig_config.value("animal2_name", app->animal2_name);
+            app->allow_automated_juice_delivery = rig_config.value("allow_automated_juice_delivery", app->allow_automated_juice_delivery);
+            rigs.push_back(std::move(rig));
+            apps.push_back(std::move(app));
+        }
+    }
+    catch (const nlohmann::json::exception& e) {
+        std::cout << "Invalid rig config: " << config_path << " (" << e.what() << ")" << std::endl;
+        return 1;
+    }
+
+    std::vector<ws::App*> rig_apps;
+    for (auto& app : apps) {
+        rig_apps.push_back(app.get());
     }
 
-    default: {
-        assert(false);
+    std::signal(SIGINT, on_rigs_interrupt);
+    auto* host = ws::start_rigs(params, rigs, rig_apps);
+    std::cout << "Running " << rigs.size() << " rig(s); press Ctrl+C to end the sessions." << std::endl;
+    while (!rigs_interrupted) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
+    ws::stop_rigs(host);
+
+    for (size_t i = 0; i < rigs.size(); i++) {
+        std::cout << rigs[i].name << ": " << apps[i]->trialnumber << " trials." << std::endl;
     }
+    return 0;
 }
 
+int main(int argc, char** argv) {
+    const char* record_path{};
+    const char* replay_path{};
+    const char* rigs_path{};
+    for (int i = 1; i + 1 < argc; i++) {
+        if (std::strcmp(argv[i], "--record") == 0) {
+            record_path = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--replay") == 0) {
+            replay_path = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--rigs") == 0) {
+            rigs_path = argv[++i];
+        }
+    }
 
+    if (rigs_path) {
+        // the replay log is process-wide, so it cannot follow several rigs
+        if (record_path || replay_path) {
+            std::cout << "--rigs cannot be combined with --record or --replay." << std::endl;
+            return 1;
+        }
+        return run_rigs(rigs_path);
+    }
 
-int main(int, char**) {
-    srand(time(NULL));
     auto app = std::make_unique<App>();
-    return app->run();
-
+    if (replay_path) {
+        return run_replay(*app, replay_path);
+    }
 
+    if (record_path && !ws::replay::start_recording(record_path)) {
+        std::cout << "Failed to open replay log: " << record_path << std::endl;
+    }
+    const int result = app->run();
+    ws::replay::stop();
+    return result;
 }
 
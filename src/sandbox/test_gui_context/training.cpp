@@ -1,5 +1,6 @@
 #include "training.hpp"
 #include "common/render.hpp"
+#include "common/replay.hpp"
 
 namespace ws {
 
@@ -7,7 +8,7 @@ namespace {
 
 template <typename State>
 bool elapsed(const State* state) {
-  return elapsed_time(state->t0, now()) >= state->total_time;
+  return elapsed_time(state->t0, replay::now()) >= state->total_time;
 }
 
 bool enter(bool* entry) {
@@ -27,7 +28,7 @@ NewTrialResult tick_new_trial(NewTrialState* state, bool* entry) {
     // if (state->play_sound_on_entry) {
     //  audio::play_buffer(state->play_sound_on_entry.value(), 0.25f);
     //}
-    state->t0 = now();
+    state->t0 = replay::now();
   }
 
   if (state->stim0_image) {
@@ -51,7 +52,7 @@ NewTrialResult tick_new_trial(NewTrialState* state, bool* entry) {
 
 bool tick_delay(DelayState* state, bool* entry) {
   if (enter(entry)) {
-    state->t0 = now();
+    state->t0 = replay::now();
   }
   return elapsed(state);
 }